@@ -0,0 +1,1002 @@
+#ifndef CAPTURE_SERVER_H_
+#define CAPTURE_SERVER_H_
+
+#include <ros/ros.h>
+#include <sensor_msgs/Image.h>
+#include <sensor_msgs/CameraInfo.h>
+#include <sensor_msgs/image_encodings.h>
+#include <nav_msgs/Odometry.h>
+#include <message_filters/subscriber.h>
+#include <message_filters/synchronizer.h>
+#include <message_filters/sync_policies/approximate_time.h>
+
+#include <tf/message_filter.h>
+
+#include <cv_bridge/cv_bridge.h>
+#include <opencv2/core/core.hpp>
+
+#include <tf/transform_listener.h>
+#include <tf/transform_broadcaster.h>
+#include <tf_conversions/tf_eigen.h>
+#include <eigen_conversions/eigen_msg.h>
+
+#include <tbb/concurrent_vector.h>
+#include <tbb/concurrent_queue.h>
+#include <tbb/flow_graph.h>
+#include <tbb/atomic.h>
+#include <tbb/tick_count.h>
+#include <boost/thread/thread.hpp>
+
+#include <std_srvs/Empty.h>
+#include <rm_localization/UpdateMap.h>
+#include <rm_localization/PredictedPose.h>
+#include <diagnostic_msgs/DiagnosticArray.h>
+
+#include <frame.h>
+#include <keyframe.h>
+#include <keyframe_publisher.h>
+#include <keyframe_index.h>
+#include <latest_slot.h>
+#include <motion_prior.h>
+#include <telemetry.h>
+#include <trajectory_recorder.h>
+#include <sstream>
+#include <algorithm>
+
+class CaptureServer {
+protected:
+
+	typedef message_filters::sync_policies::ApproximateTime<sensor_msgs::Image,
+			sensor_msgs::Image, sensor_msgs::CameraInfo> SyncPolicy;
+
+	typedef message_filters::Synchronizer<SyncPolicy> Synchronizer;
+
+	// Camera frame passed through the ingest -> build -> track -> publish
+	// pipeline.
+	struct rgbd_frame {
+		typedef boost::shared_ptr<rgbd_frame> Ptr;
+
+		sensor_msgs::CameraInfo::ConstPtr info_msg;
+		cv_bridge::CvImageConstPtr yuv2;
+		cv_bridge::CvImageConstPtr depth;
+
+		// Pyramid built ahead of tracking.
+		frame::Ptr f;
+
+		// Tracking result.
+		Sophus::SE3f camera_position;
+		keyframe::Ptr new_keyframe;
+		rm_localization::Keyframe::Ptr keyframe_msg;
+
+		// Filled by every stage when the trajectory is saved.
+		trajectory_record record;
+
+		EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+	};
+
+	// Keyframe poses and intrinsics from the mapper. Prepared on the
+	// service thread and applied by the tracker between frames.
+	struct map_update {
+		typedef boost::shared_ptr<map_update> Ptr;
+
+		bool clear;
+		bool update_intrinsics;
+		Eigen::Vector3f intrinsics;
+		std::vector<int> idx;
+		std::vector<Sophus::SE3f, Eigen::aligned_allocator<Sophus::SE3f> > poses;
+
+		EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+	};
+
+	// Rebuilds keyframe geometry for new intrinsics, one task per keyframe.
+	struct update_keyframe_intrinsics {
+		const std::vector<keyframe::Ptr> & keyframes;
+		Eigen::Vector3f intrinsics;
+
+		update_keyframe_intrinsics(const std::vector<keyframe::Ptr> & keyframes,
+				const Eigen::Vector3f & intrinsics) :
+				keyframes(keyframes), intrinsics(intrinsics) {
+		}
+
+		void operator()(const tbb::blocked_range<size_t> & r) const {
+			for (size_t i = r.begin(); i != r.end(); i++) {
+				keyframes[i]->update_intrinsics(intrinsics);
+			}
+		}
+	};
+
+	typedef tbb::flow::function_node<tbb::flow::continue_msg,
+			tbb::flow::continue_msg> build_node_type;
+	typedef tbb::flow::function_node<tbb::flow::continue_msg,
+			rgbd_frame::Ptr> track_node_type;
+	typedef tbb::flow::function_node<rgbd_frame::Ptr,
+			tbb::flow::continue_msg> publish_node_type;
+
+	ros::NodeHandle nh_;
+	ros::NodeHandle nh_private;
+
+	message_filters::Subscriber<sensor_msgs::Image> rgb_sub;
+	message_filters::Subscriber<sensor_msgs::Image> depth_sub;
+	message_filters::Subscriber<sensor_msgs::CameraInfo> info_sub;
+
+	tf::MessageFilter<sensor_msgs::Image> * rgb_tf_sub;
+
+	boost::shared_ptr<Synchronizer> sync;
+
+	int queue_size_;
+
+	tf::TransformBroadcaster br;
+	tf::TransformListener lr;
+
+	Eigen::Vector3f intrinsics;
+
+	tbb::concurrent_vector<keyframe::Ptr> keyframes;
+	keyframe_index keyframes_index;
+	int closest_keyframe_idx;
+	Sophus::SE3f camera_position;
+
+	// Only the tracker changes the map. Other threads hand it updates
+	// through map_updates and only lock keyframes_mutex to read keyframe
+	// pointers, which the tracker takes to clear the map.
+	tbb::concurrent_queue<map_update::Ptr> map_updates;
+	boost::mutex keyframes_mutex;
+
+	nav_msgs::Odometry odom;
+
+	ros::Publisher odom_pub;
+	ros::Publisher predicted_pose_pub;
+	ros::Publisher diagnostics_pub;
+	ros::WallTimer diagnostics_timer;
+	ros::Publisher keyframe_pub;
+	boost::shared_ptr<keyframe_publisher> keyframe_pub_worker;
+	ros::ServiceServer update_map_service;
+	ros::ServiceServer send_all_keyframes_service;
+	ros::ServiceServer clear_keyframes_service;
+
+	std::string base_frame;
+
+	// Pose, tracking quality and stage times of every frame, written by
+	// the publish stage when save_trajectory is set.
+	boost::shared_ptr<trajectory_recorder> trajectory;
+
+	tracking_mode keyframe_tracking_mode;
+	int max_tracking_points;
+	int pyramid_levels;
+	float convergence_threshold;
+
+	// Seeds tracking with a constant velocity prediction when enabled.
+	bool use_motion_prior;
+	motion_prior camera_motion;
+
+	// Poses extrapolated by camera_motion are published at this rate
+	// between frames, 0 disables it.
+	double predicted_pose_rate;
+	boost::thread predicted_pose_worker;
+	// Child frame of the predicted tf. It differs from base_frame so that
+	// predictions stamped now do not interleave with tracked poses on the
+	// same edge.
+	std::string predicted_frame;
+	std::string camera_frame;
+	boost::mutex camera_frame_mutex;
+
+	// Each stage runs serially, so building the pyramid of the next frame
+	// overlaps tracking of the current one. Stages are linked by single
+	// item slots where a newer frame replaces one that was not taken yet.
+	tbb::flow::graph pipeline;
+	boost::shared_ptr<build_node_type> build_node;
+	boost::shared_ptr<track_node_type> track_node;
+	boost::shared_ptr<publish_node_type> publish_node;
+
+	latest_slot<rgbd_frame::Ptr> build_slot;
+	latest_slot<rgbd_frame::Ptr> track_slot;
+
+	tbb::atomic<size_t> frames_received;
+	tbb::atomic<size_t> frames_dropped;
+	tbb::atomic<size_t> frames_processed;
+
+	// Keyframes far from the camera are evicted while the resident ones use
+	// more memory than this, 0 disables eviction.
+	size_t keyframe_memory_budget;
+	tbb::atomic<size_t> num_evicted_keyframes;
+	latency_histogram restore_latency;
+
+	// Stage latencies and tracking quality, published on diagnostics and
+	// printed on shutdown when enabled.
+	telemetry node_telemetry;
+
+public:
+
+	CaptureServer(ros::NodeHandle & nh, ros::NodeHandle & nh_private) :
+			nh_(nh), nh_private(nh_private) {
+
+		ROS_INFO("Creating localization");
+
+		double var = 1e-10;
+		odom.pose.covariance = { {
+				var, 0, 0, 0, 0, 0,
+				0, var, 0, 0, 0, 0,
+				0, 0, var, 0, 0, 0,
+				0, 0, 0, var, 0, 0,
+				0, 0, 0, 0, var, 0,
+				0, 0, 0, 0, 0, var}};
+
+		queue_size_ = 5;
+
+		std::string mode;
+		nh_private.param<std::string>("tracking_mode", mode, "fused");
+		if (mode == "two_pass") {
+			keyframe_tracking_mode = TRACKING_TWO_PASS;
+		} else if (mode == "inverse_compositional") {
+			keyframe_tracking_mode = TRACKING_INVERSE_COMPOSITIONAL;
+		} else {
+			keyframe_tracking_mode = TRACKING_FUSED;
+		}
+		ROS_INFO("Using %s tracking", mode.c_str());
+
+		nh_private.param<int>("max_tracking_points", max_tracking_points, 0);
+		nh_private.param<int>("pyramid_levels", pyramid_levels, 3);
+
+		double threshold;
+		nh_private.param<double>("convergence_threshold", threshold, 0.0);
+		convergence_threshold = threshold;
+		nh_private.param<bool>("motion_prior", use_motion_prior, false);
+		nh_private.param<double>("predicted_pose_rate", predicted_pose_rate,
+				0.0);
+
+		int tile_rows, tile_cols;
+		get_image_tile_size(tile_rows, tile_cols);
+		nh_private.param<int>("tile_rows", tile_rows, tile_rows);
+		nh_private.param<int>("tile_cols", tile_cols, tile_cols);
+		set_image_tile_size(tile_rows, tile_cols);
+
+		int memory_budget_mb;
+		nh_private.param<int>("keyframe_memory_budget", memory_budget_mb, 0);
+		keyframe_memory_budget = size_t(memory_budget_mb) << 20;
+
+		bool enable_telemetry;
+		double telemetry_period;
+		nh_private.param<bool>("telemetry", enable_telemetry, false);
+		nh_private.param<double>("telemetry_period", telemetry_period, 10.0);
+		node_telemetry.set_enabled(enable_telemetry);
+
+		bool save_trajectory;
+		std::string trajectory_filename;
+		nh_private.param<bool>("save_trajectory", save_trajectory, false);
+		nh_private.param<std::string>("trajectory_file", trajectory_filename,
+				"/tmp/trajectory.bin");
+		if (save_trajectory) {
+			trajectory.reset(new trajectory_recorder(trajectory_filename));
+			if (trajectory->is_open()) {
+				ROS_INFO("Saving trajectory to %s",
+						trajectory_filename.c_str());
+			} else {
+				ROS_ERROR("Could not open trajectory file %s",
+						trajectory_filename.c_str());
+				trajectory.reset();
+			}
+		}
+
+		frames_received = 0;
+		frames_dropped = 0;
+		frames_processed = 0;
+		closest_keyframe_idx = -1;
+		num_evicted_keyframes = 0;
+
+		build_node.reset(
+				new build_node_type(pipeline, tbb::flow::serial,
+						boost::bind(&CaptureServer::build, this, _1)));
+		track_node.reset(
+				new track_node_type(pipeline, tbb::flow::serial,
+						boost::bind(&CaptureServer::track, this, _1)));
+		publish_node.reset(
+				new publish_node_type(pipeline, tbb::flow::serial,
+						boost::bind(&CaptureServer::publish, this, _1)));
+
+		tbb::flow::make_edge(*build_node, *track_node);
+		tbb::flow::make_edge(*track_node, *publish_node);
+
+		odom_pub = nh_.advertise<nav_msgs::Odometry>("vo", queue_size_);
+		predicted_pose_pub = nh_.advertise<rm_localization::PredictedPose>(
+				"predicted_pose", queue_size_);
+
+		if (enable_telemetry) {
+			diagnostics_pub = nh_.advertise<diagnostic_msgs::DiagnosticArray>(
+					"/diagnostics", 1);
+			diagnostics_timer = nh_.createWallTimer(
+					ros::WallDuration(telemetry_period),
+					&CaptureServer::publish_diagnostics, this);
+		}
+		keyframe_pub = nh_.advertise<rm_localization::Keyframe>("keyframe",
+				queue_size_);
+		std::string rgb_codec, depth_codec;
+		nh_private.param<std::string>("rgb_codec", rgb_codec, "png");
+		nh_private.param<std::string>("depth_codec", depth_codec,
+				"depth_rle");
+		keyframe_pub_worker.reset(
+				new keyframe_publisher(keyframe_pub, get_codec(rgb_codec),
+						get_codec(depth_codec)));
+
+		update_map_service = nh_.advertiseService("update_map",
+				&CaptureServer::update_map, this);
+
+		send_all_keyframes_service = nh_.advertiseService("send_all_keyframes",
+				&CaptureServer::send_all_keyframes, this);
+
+		clear_keyframes_service = nh_.advertiseService("clear_keyframes",
+				&CaptureServer::clear_keyframes, this);
+
+		rgb_sub.subscribe(nh_, "rgb/image_raw", queue_size_);
+		depth_sub.subscribe(nh_, "depth/image_raw", queue_size_);
+		info_sub.subscribe(nh_, "rgb/camera_info", queue_size_);
+
+		base_frame = "base_footprint";
+		nh_private.param<std::string>("predicted_frame", predicted_frame,
+				base_frame + "_predicted");
+
+		rgb_tf_sub = new tf::MessageFilter<sensor_msgs::Image>(rgb_sub, lr,
+				base_frame, queue_size_);
+
+		// Synchronize inputs.
+		sync.reset(
+				new Synchronizer(SyncPolicy(queue_size_), *rgb_tf_sub,
+						depth_sub, info_sub));
+
+		sync->registerCallback(
+				boost::bind(&CaptureServer::RGBDCallback, this, _1, _2, _3));
+
+		if (predicted_pose_rate > 0) {
+			ROS_INFO("Publishing predicted poses at %.1f Hz",
+					predicted_pose_rate);
+			predicted_pose_worker = boost::thread(
+					boost::bind(&CaptureServer::publish_predicted_poses,
+							this));
+		}
+
+	}
+
+	~CaptureServer(void) {
+		predicted_pose_worker.interrupt();
+		predicted_pose_worker.join();
+		pipeline.wait_for_all();
+
+		if (node_telemetry.is_enabled()) {
+			std::stringstream ss;
+			node_telemetry.print(ss);
+			keyframe_pub_worker->get_encode_latency().print(ss, "encode");
+			restore_latency.print(ss, "restore");
+			ROS_INFO_STREAM("Telemetry" << std::endl << ss.str());
+		}
+
+		keyframe_pub_worker.reset();
+		ROS_INFO_STREAM(
+				"Frames received " << frames_received << " processed " << frames_processed << " dropped " << frames_dropped);
+
+		if (trajectory) {
+			ROS_INFO_STREAM(
+					"Trajectory poses written " << trajectory->get_num_written() << " dropped " << trajectory->get_num_dropped());
+			trajectory.reset();
+		}
+
+		delete rgb_tf_sub;
+	}
+
+	// Where a stage stores its time for the trajectory, NULL when it is
+	// not saved.
+	inline uint32_t * stage_time(const rgbd_frame::Ptr & rf,
+			telemetry_stage stage) {
+		return trajectory ? &rf->record.stage_us[stage] : NULL;
+	}
+
+	void get_closest_keyframe(int & res, float & dist) {
+		keyframes_index.get_closest(camera_position, res, dist);
+	}
+
+	void add_keyframe(const keyframe::Ptr & k) {
+		keyframes_index.insert(keyframes.size(), k->get_pos());
+		keyframes.push_back(k);
+		enforce_memory_budget();
+	}
+
+	void restore_keyframe(const keyframe::Ptr & k) {
+
+		tbb::tick_count start = tbb::tick_count::now();
+		k->restore();
+		restore_latency.add(start);
+
+		num_evicted_keyframes--;
+
+		enforce_memory_budget();
+	}
+
+	// Evicts the resident keyframes furthest from the camera until the
+	// budget is met. The closest keyframe and keyframes referenced outside
+	// of the map, for example queued for publishing, are kept.
+	void enforce_memory_budget() {
+
+		if (keyframe_memory_budget == 0)
+			return;
+
+		size_t memory_usage = 0;
+		std::vector<std::pair<float, int> > candidates;
+
+		for (size_t i = 0; i < keyframes.size(); i++) {
+			memory_usage += keyframes[i]->get_memory_usage();
+
+			if (!keyframes[i]->is_evicted() && (int) i != closest_keyframe_idx
+					&& keyframes[i].unique()) {
+				candidates.push_back(
+						std::make_pair(
+								keyframe_distance(camera_position,
+										keyframes[i]->get_pos()), i));
+			}
+		}
+
+		std::sort(candidates.begin(), candidates.end());
+
+		for (int j = candidates.size() - 1;
+				j >= 0 && memory_usage > keyframe_memory_budget; j--) {
+			keyframe::Ptr & k = keyframes[candidates[j].second];
+
+			// Keyframes that are being rebuilt for new intrinsics are
+			// skipped instead of waiting.
+			memory_usage -= k->get_memory_usage();
+			if (k->try_evict())
+				num_evicted_keyframes++;
+			memory_usage += k->get_memory_usage();
+		}
+	}
+
+	void publish_odom(const std::string & frame, const ros::Time & time) {
+
+		tf::StampedTransform transform;
+		try {
+			lr.lookupTransform(frame, base_frame, time, transform);
+
+			Eigen::Quaterniond q;
+			Eigen::Vector3d t;
+
+			tf::quaternionTFToEigen(transform.getRotation(), q);
+			tf::vectorTFToEigen(transform.getOrigin(), t);
+
+			Sophus::SE3f Mcb = Sophus::SE3f(q.cast<float>(), t.cast<float>());
+			Sophus::SE3f Mob = camera_position * Mcb;
+
+			odom.header.stamp = ros::Time::now();
+			odom.header.frame_id = frame;
+
+			tf::quaternionEigenToMsg(Mob.unit_quaternion().cast<double>(),
+					odom.pose.pose.orientation);
+			tf::pointEigenToMsg(Mob.translation().cast<double>(),
+					odom.pose.pose.position);
+
+			odom_pub.publish(odom);
+
+		} catch (tf::TransformException & ex) {
+			ROS_ERROR("%s", ex.what());
+		}
+
+	}
+
+	void publish_tf(const std::string & frame, const ros::Time & time,
+			const Sophus::SE3f & camera_position) {
+		publish_tf(frame, time, time, camera_position, base_frame);
+	}
+
+	// Looks up the camera mount at lookup_time and sends the base pose
+	// stamped with stamp as child_frame. Returns the base pose in Mob.
+	bool publish_tf(const std::string & frame, const ros::Time & lookup_time,
+			const ros::Time & stamp, const Sophus::SE3f & camera_position,
+			const std::string & child_frame, Sophus::SE3f * Mob_out = NULL) {
+
+		tf::StampedTransform transform;
+		try {
+			lr.lookupTransform(frame, base_frame, lookup_time, transform);
+
+			Eigen::Quaterniond q;
+			Eigen::Vector3d t;
+
+			tf::quaternionTFToEigen(transform.getRotation(), q);
+			tf::vectorTFToEigen(transform.getOrigin(), t);
+
+			Sophus::SE3f Mcb = Sophus::SE3f(q.cast<float>(), t.cast<float>());
+
+			Sophus::SE3f Mob = camera_position * Mcb;
+
+			geometry_msgs::TransformStamped tr;
+
+			tf::quaternionEigenToMsg(Mob.unit_quaternion().cast<double>(),
+					tr.transform.rotation);
+			tf::vectorEigenToMsg(Mob.translation().cast<double>(),
+					tr.transform.translation);
+
+			tr.header.frame_id = "odom_combined";
+			tr.header.stamp = stamp;
+			tr.child_frame_id = child_frame;
+
+			br.sendTransform(tr);
+
+			if (Mob_out)
+				*Mob_out = Mob;
+
+		} catch (tf::TransformException & ex) {
+			ROS_ERROR("%s", ex.what());
+			return false;
+		}
+
+		return true;
+	}
+
+	// Predicted pose thread. Extrapolates the camera to the current time
+	// and publishes it as the predicted_frame tf and as a message with the
+	// age of the last tracked pose. Tracking corrects the filter as frames
+	// are processed.
+	void publish_predicted_poses() {
+
+		ros::WallRate rate(predicted_pose_rate);
+
+		try {
+			while (ros::ok()) {
+				boost::this_thread::interruption_point();
+
+				ros::Time now = ros::Time::now();
+				Sophus::SE3f predicted_position, Mob;
+				double measurement_stamp;
+
+				if (camera_motion.extrapolate(now.toSec(), predicted_position,
+						measurement_stamp)) {
+
+					std::string frame;
+					{
+						boost::mutex::scoped_lock lock(camera_frame_mutex);
+						frame = camera_frame;
+					}
+
+					// The camera mount is static, the latest one is used.
+					if (publish_tf(frame, ros::Time(0), now,
+							predicted_position, predicted_frame, &Mob)) {
+
+						rm_localization::PredictedPose::Ptr msg(
+								new rm_localization::PredictedPose);
+						msg->header.stamp = now;
+						msg->header.frame_id = "odom_combined";
+						msg->child_frame_id = predicted_frame;
+						tf::quaternionEigenToMsg(
+								Mob.unit_quaternion().cast<double>(),
+								msg->pose.orientation);
+						tf::pointEigenToMsg(Mob.translation().cast<double>(),
+								msg->pose.position);
+						msg->measurement_age = now
+								- ros::Time(measurement_stamp);
+
+						predicted_pose_pub.publish(msg);
+					}
+				}
+
+				rate.sleep();
+			}
+		} catch (boost::thread_interrupted &) {
+		}
+
+	}
+
+	void publish_diagnostics(const ros::WallTimerEvent &) {
+
+		diagnostic_msgs::DiagnosticArray::Ptr msg(
+				new diagnostic_msgs::DiagnosticArray);
+		msg->header.stamp = ros::Time::now();
+		msg->status.resize(1);
+
+		diagnostic_msgs::DiagnosticStatus & status = msg->status[0];
+		status.level = diagnostic_msgs::DiagnosticStatus::OK;
+		status.name = ros::this_node::getName() + ": localization";
+
+		std::stringstream ss;
+		ss << "Frames received " << frames_received << " processed "
+				<< frames_processed << " dropped " << frames_dropped;
+		status.message = ss.str();
+
+		node_telemetry.to_msg(status);
+		keyframe_pub_worker->get_encode_latency().to_msg(status, "encode");
+		restore_latency.to_msg(status, "restore");
+
+		diagnostics_pub.publish(msg);
+	}
+
+	bool send_all_keyframes(std_srvs::Empty::Request &req,
+			std_srvs::Empty::Response &res) {
+
+		//for (size_t i = 0; i < keyframes.size(); i++) {
+		//	keyframe_pub.publish(keyframes[i]->to_msg(yuv2, i));
+		//}
+
+		return true;
+	}
+
+	bool clear_keyframes(std_srvs::Empty::Request &req,
+			std_srvs::Empty::Response &res) {
+
+		map_update::Ptr u(new map_update);
+		u->clear = true;
+		u->update_intrinsics = false;
+		map_updates.push(u);
+
+		return true;
+	}
+
+	// Runs on the service thread. New geometry for the intrinsics is built
+	// here, in parallel across keyframes, and swapped into each keyframe
+	// while tracking goes on with the old one. Poses are applied by the
+	// tracker before its next frame.
+	bool update_map(rm_localization::UpdateMap::Request &req,
+			rm_localization::UpdateMap::Response &res) {
+
+		map_update::Ptr u(new map_update);
+		u->clear = false;
+
+		u->intrinsics[0] = req.intrinsics[0];
+		u->intrinsics[1] = req.intrinsics[1];
+		u->intrinsics[2] = req.intrinsics[2];
+
+		u->update_intrinsics = u->intrinsics[0] != 0.0f;
+
+		u->idx.resize(req.idx.size());
+		u->poses.resize(req.idx.size());
+
+		for (size_t i = 0; i < req.idx.size(); i++) {
+
+			Eigen::Quaternionf orientation;
+			Eigen::Vector3f position;
+
+			orientation.coeffs()[0] = req.transform[i].unit_quaternion[0];
+			orientation.coeffs()[1] = req.transform[i].unit_quaternion[1];
+			orientation.coeffs()[2] = req.transform[i].unit_quaternion[2];
+			orientation.coeffs()[3] = req.transform[i].unit_quaternion[3];
+
+			position[0] = req.transform[i].position[0];
+			position[1] = req.transform[i].position[1];
+			position[2] = req.transform[i].position[2];
+
+			u->idx[i] = req.idx[i];
+			u->poses[i] = Sophus::SE3f(orientation, position);
+
+		}
+
+		if (u->update_intrinsics) {
+
+			std::vector<keyframe::Ptr> updated;
+			{
+				boost::mutex::scoped_lock lock(keyframes_mutex);
+				for (size_t i = 0; i < req.idx.size(); i++) {
+					if (req.idx[i] >= 0 && req.idx[i] < (int) keyframes.size())
+						updated.push_back(keyframes[req.idx[i]]);
+				}
+			}
+
+			tbb::tick_count start = tbb::tick_count::now();
+			tbb::parallel_for(tbb::blocked_range<size_t>(0, updated.size()),
+					update_keyframe_intrinsics(updated, u->intrinsics));
+
+			ROS_INFO_STREAM(
+					"Rebuilt " << updated.size() << " keyframes with intrinsics " << u->intrinsics.transpose() << " in " << (tbb::tick_count::now() - start).seconds() * 1000 << " ms");
+		}
+
+		map_updates.push(u);
+
+		return true;
+	}
+
+	// Runs on the tracker before each frame.
+	void apply_map_updates() {
+
+		map_update::Ptr u;
+		while (map_updates.try_pop(u)) {
+
+			if (u->clear) {
+				boost::mutex::scoped_lock lock(keyframes_mutex);
+
+				keyframes.clear();
+				keyframes_index.clear();
+				closest_keyframe_idx = -1;
+				num_evicted_keyframes = 0;
+				camera_motion.clear();
+				continue;
+			}
+
+			if (u->update_intrinsics) {
+				intrinsics = u->intrinsics;
+				ROS_INFO_STREAM("New intrinsics " << intrinsics.transpose());
+			}
+
+			for (size_t i = 0; i < u->idx.size(); i++) {
+
+				int idx = u->idx[i];
+				if (idx < 0 || idx >= (int) keyframes.size())
+					continue;
+
+				const Sophus::SE3f & new_pos = u->poses[i];
+
+				if (idx == closest_keyframe_idx) {
+
+					Sophus::SE3f correction = new_pos
+							* keyframes[idx]->get_pos().inverse();
+					camera_position = correction * camera_position;
+
+					if (camera_motion.is_initialized())
+						camera_motion.correct(correction);
+				}
+
+				keyframes[idx]->get_pos() = new_pos;
+				keyframes_index.update(idx, new_pos);
+
+			}
+		}
+
+	}
+
+	void init_camera_position(const std::string & frame,
+			const ros::Time & time) {
+
+		tf::StampedTransform transform;
+		try {
+			lr.lookupTransform(base_frame, frame, time, transform);
+
+			Eigen::Quaterniond q;
+			Eigen::Vector3d t;
+
+			tf::quaternionTFToEigen(transform.getRotation(), q);
+			tf::vectorTFToEigen(transform.getOrigin(), t);
+
+			camera_position = Sophus::SE3f(q.cast<float>(), t.cast<float>());
+		} catch (tf::TransformException & ex) {
+			ROS_ERROR("%s", ex.what());
+		}
+
+		//ROS_INFO_STREAM(
+		//		"Initial camera position" << std::endl << camera_position.matrix());
+	}
+
+	// Ingest stage, runs on the ROS callback thread.
+	void RGBDCallback(const sensor_msgs::Image::ConstPtr& yuv2_msg,
+			const sensor_msgs::Image::ConstPtr& depth_msg,
+			const sensor_msgs::CameraInfo::ConstPtr& info_msg) {
+
+		rgbd_frame::Ptr rf(new rgbd_frame);
+		rf->info_msg = info_msg;
+		rf->record = trajectory_record();
+		rf->record.keyframe_idx = -1;
+		{
+			scoped_timer t(node_telemetry, STAGE_BRIDGE,
+					stage_time(rf, STAGE_BRIDGE));
+			rf->yuv2 = cv_bridge::toCvShare(yuv2_msg);
+			rf->depth = cv_bridge::toCvShare(depth_msg);
+		}
+
+		frames_received++;
+		if (!build_slot.put(rf)) {
+			frames_dropped++;
+		}
+
+		build_node->try_put(tbb::flow::continue_msg());
+
+	}
+
+	// Every stage is triggered once per item put into its slot, so one
+	// invocation takes at most one frame. Triggers of dropped frames find
+	// the slot empty.
+	tbb::flow::continue_msg build(const tbb::flow::continue_msg &) {
+
+		rgbd_frame::Ptr rf;
+		if (build_slot.take(rf)) {
+
+			// Position and intrinsics are set when tracking starts. Images
+			// already in pyramid format are used in place, the messages stay
+			// alive as long as the frame.
+			scoped_timer t(node_telemetry, STAGE_PYRAMID,
+					stage_time(rf, STAGE_PYRAMID));
+			rf->f.reset(
+					new frame(rf->yuv2->image, rf->depth->image, rf->yuv2,
+							rf->depth, Sophus::SE3f(), Eigen::Vector3f::Zero(),
+							pyramid_levels));
+
+			if (!track_slot.put(rf)) {
+				frames_dropped++;
+			}
+		}
+
+		return tbb::flow::continue_msg();
+	}
+
+	rgbd_frame::Ptr track(const tbb::flow::continue_msg &) {
+
+		rgbd_frame::Ptr rf;
+		if (!track_slot.take(rf)) {
+			return rf;
+		}
+
+		apply_map_updates();
+
+		double stamp = rf->yuv2->header.stamp.toSec();
+
+		if (keyframes.size() != 0) {
+
+			if (camera_motion.is_initialized()) {
+				Sophus::SE3f predicted_position = camera_motion.predict(stamp);
+				if (use_motion_prior)
+					camera_position = predicted_position;
+			}
+
+			bool tracked;
+			float distance;
+			keyframe::Ptr closest_keyframe;
+
+			{
+				scoped_timer t(node_telemetry, STAGE_SEARCH,
+						stage_time(rf, STAGE_SEARCH));
+				get_closest_keyframe(closest_keyframe_idx, distance);
+
+				closest_keyframe = keyframes[closest_keyframe_idx];
+
+				if (closest_keyframe->is_evicted()) {
+					restore_keyframe(closest_keyframe);
+				}
+			}
+
+			ROS_DEBUG("Closest keyframe %d", closest_keyframe_idx);
+
+			tracking_stats stats;
+			tracking_stats * stats_ptr =
+					node_telemetry.is_enabled() || trajectory ? &stats : NULL;
+
+			if (distance > 1) {
+				keyframe::Ptr k;
+				{
+					scoped_timer t(node_telemetry, STAGE_KEYFRAME,
+							stage_time(rf, STAGE_KEYFRAME));
+					k.reset(
+							new keyframe(rf->yuv2->image, rf->depth->image,
+									camera_position, intrinsics,
+									pyramid_levels));
+					k->set_max_points(max_tracking_points);
+					k->set_tracking_mode(keyframe_tracking_mode);
+					k->set_convergence_threshold(convergence_threshold);
+				}
+
+				{
+					scoped_timer t(node_telemetry, STAGE_TRACK,
+							stage_time(rf, STAGE_TRACK));
+					tracked = closest_keyframe->estimate_position(*k,
+							stats_ptr);
+				}
+
+				camera_position = k->get_pos();
+
+				rf->new_keyframe = k;
+				rf->keyframe_msg = k->to_msg(rf->yuv2, keyframes.size(), false);
+				add_keyframe(k);
+				ROS_INFO_STREAM(
+						"Added keyframe with intrinsics " << k->get_intrinsics().transpose());
+				ROS_INFO_STREAM( "Closest keyframe at distance " << distance);
+
+			} else {
+				rf->f->get_pos() = camera_position;
+				rf->f->get_intrinsics() = intrinsics;
+
+				{
+					scoped_timer t(node_telemetry, STAGE_TRACK,
+							stage_time(rf, STAGE_TRACK));
+					tracked = closest_keyframe->estimate_position(*rf->f,
+							stats_ptr);
+				}
+
+				camera_position = rf->f->get_pos();
+
+			}
+
+			if (stats_ptr) {
+				node_telemetry.add(stats);
+
+				rf->record.keyframe_idx = closest_keyframe_idx;
+				rf->record.iterations = stats.iterations;
+				rf->record.residual = stats.residual;
+				rf->record.valid_ratio = stats.valid_ratio;
+				if (tracked)
+					rf->record.flags |= trajectory_record::FLAG_TRACKED;
+			}
+
+			if (tracked && camera_motion.is_initialized())
+				camera_motion.measure(camera_position);
+
+		} else {
+
+			init_camera_position(rf->yuv2->header.frame_id,
+					rf->yuv2->header.stamp);
+
+			intrinsics << rf->info_msg->K[0], rf->info_msg->K[2], rf->info_msg->K[5];
+
+			keyframe::Ptr k(
+					new keyframe(rf->yuv2->image, rf->depth->image,
+							camera_position, intrinsics, pyramid_levels));
+			k->set_max_points(max_tracking_points);
+			k->set_tracking_mode(keyframe_tracking_mode);
+			k->set_convergence_threshold(convergence_threshold);
+			rf->new_keyframe = k;
+			rf->keyframe_msg = k->to_msg(rf->yuv2, keyframes.size(), false);
+			add_keyframe(k);
+			ROS_INFO_STREAM(
+					"Added keyframe with intrinsics " << k->get_intrinsics().transpose());
+
+			{
+				boost::mutex::scoped_lock lock(camera_frame_mutex);
+				camera_frame = rf->yuv2->header.frame_id;
+			}
+
+			if (use_motion_prior || predicted_pose_rate > 0)
+				camera_motion.reset(camera_position, stamp);
+		}
+
+		if (trajectory) {
+			trajectory_record & r = rf->record;
+			r.stamp = stamp;
+			Eigen::Map<Eigen::Vector3f>(r.translation) =
+					camera_position.translation();
+			Eigen::Map<Eigen::Vector4f>(r.rotation) =
+					camera_position.unit_quaternion().coeffs();
+			if (rf->new_keyframe)
+				r.flags |= trajectory_record::FLAG_NEW_KEYFRAME;
+		}
+
+		rf->camera_position = camera_position;
+
+		// Give the pyramid back to the arena before publishing.
+		rf->f.reset();
+
+		frames_processed++;
+		return rf;
+	}
+
+	tbb::flow::continue_msg publish(const rgbd_frame::Ptr & rf) {
+
+		if (rf) {
+
+			{
+				scoped_timer t(node_telemetry, STAGE_PUBLISH,
+						stage_time(rf, STAGE_PUBLISH));
+
+				// Images of a new keyframe are encoded on the publisher
+				// thread.
+				if (rf->keyframe_msg) {
+					keyframe_pub_worker->publish(rf->new_keyframe, rf->yuv2,
+							rf->keyframe_msg);
+				}
+
+				publish_tf(rf->yuv2->header.frame_id, rf->yuv2->header.stamp,
+						rf->camera_position);
+			}
+
+			if (node_telemetry.is_enabled() || trajectory) {
+				int64_t total_ns = (ros::Time::now()
+						- rf->yuv2->header.stamp).toNSec();
+				size_t total_us = std::max<int64_t>(total_ns, 0) / 1000;
+				node_telemetry.add(STAGE_TOTAL, total_us);
+
+				// Publish stage is serial, the only producer of records.
+				if (trajectory) {
+					rf->record.stage_us[STAGE_TOTAL] = total_us;
+					trajectory->record(rf->record);
+				}
+			}
+
+			ROS_INFO_STREAM_THROTTLE(10,
+					"Frames received " << frames_received << " processed " << frames_processed << " dropped " << frames_dropped);
+			ROS_INFO_STREAM_THROTTLE(10,
+					"Keyframes resident " << keyframes.size() - num_evicted_keyframes << " evicted " << num_evicted_keyframes << " restored " << restore_latency.get_count() << " restore time mean " << restore_latency.get_mean() << " ms max " << restore_latency.get_max() << " ms");
+			ROS_INFO_STREAM_THROTTLE(10,
+					"Keyframe queue depth " << keyframe_pub_worker->get_queue_depth() << " encode time mean " << keyframe_pub_worker->get_mean_encode_time() << " ms max " << keyframe_pub_worker->get_max_encode_time() << " ms");
+		}
+
+		return tbb::flow::continue_msg();
+	}
+
+};
+
+#endif /* CAPTURE_SERVER_H_ */
@@ -0,0 +1,53 @@
+#ifndef CELL_HASH_H_
+#define CELL_HASH_H_
+
+#include <vector>
+#include <stdint.h>
+#include <boost/unordered_map.hpp>
+#include <Eigen/Core>
+
+// Keyframe indices hashed into integer voxel cells, shared by the spatial
+// indices of keyframe poses. Cell coordinates are packed into 21 bits each
+// and wrap around, so cells 2^21 apart share a bucket. Callers test the
+// keyframes they get back, which only adds candidates for huge maps.
+class cell_hash {
+
+public:
+
+	typedef boost::unordered_map<int64_t, std::vector<int> > map_type;
+
+	cell_hash();
+
+	// Moves idx to cell, returns false if it already was in it.
+	bool insert(int idx, const Eigen::Vector3i & cell);
+	void remove(int idx);
+	void clear();
+
+	// Keyframes in cell, NULL if there are none.
+	const std::vector<int> * find(const Eigen::Vector3i & cell) const;
+
+	inline size_t size() const {
+		return num_indices;
+	}
+
+	inline map_type::const_iterator begin() const {
+		return cells.begin();
+	}
+
+	inline map_type::const_iterator end() const {
+		return cells.end();
+	}
+
+	static int64_t get_key(const Eigen::Vector3i & cell);
+	// Coordinates of key modulo 2^21.
+	static Eigen::Vector3i get_cell(int64_t key);
+
+protected:
+
+	map_type cells;
+	std::vector<int64_t> keys;
+	size_t num_indices;
+
+};
+
+#endif /* CELL_HASH_H_ */
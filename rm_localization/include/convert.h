@@ -8,19 +8,24 @@
 #ifndef CONVERT_H_
 #define CONVERT_H_
 
-#include <tbb/blocked_range.h>
+#include <image_range.h>
 
 struct convert {
 	const uint8_t * yuv;
 	uint8_t * intencity;
+	int cols;
 
-	convert(const uint8_t * yuv, uint8_t * intencity) :
-			yuv(yuv), intencity(intencity) {
+	convert(const uint8_t * yuv, uint8_t * intencity, int cols) :
+			yuv(yuv), intencity(intencity), cols(cols) {
 	}
 
-	void operator()(const tbb::blocked_range<int>& range) const {
-		for (int i = range.begin(); i != range.end(); i++) {
-			intencity[i] = yuv[2 * i + 1];
+	void operator()(const image_range& range) const {
+		for (int v = range.rows().begin(); v != range.rows().end(); v++) {
+			const uint8_t * yuv_row = yuv + 2 * v * cols;
+			uint8_t * intencity_row = intencity + v * cols;
+			for (int u = range.cols().begin(); u != range.cols().end(); u++) {
+				intencity_row[u] = yuv_row[2 * u + 1];
+			}
 		}
 
 	}
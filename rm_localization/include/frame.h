@@ -5,8 +5,9 @@
 #include <opencv2/core/core.hpp>
 #include <sophus/se3.hpp>
 #include <convert.h>
-#include <subsample.h>
+#include <pyramid_builder.h>
 #include <warp.h>
+#include <pyramid_arena.h>
 
 class frame {
 
@@ -18,11 +19,19 @@ public:
 			const Sophus::SE3f & position, const Eigen::Vector3f & intrinsics,
 			int max_level = 3);
 
+	// Uses the images as level 0 of the pyramid instead of copying them when
+	// they already have the pyramid format, continuous 8 bit gray intencity
+	// and 16 bit depth. The owners keep the adopted memory alive as long as
+	// the frame and level 0 is never written. Other images are copied.
+	frame(const cv::Mat & yuv, const cv::Mat & depth,
+			const boost::shared_ptr<const void> & yuv_owner,
+			const boost::shared_ptr<const void> & depth_owner,
+			const Sophus::SE3f & position, const Eigen::Vector3f & intrinsics,
+			int max_level = 3);
+
 	~frame();
 
-	void warp(
-			const Eigen::Matrix<float, 4, Eigen::Dynamic, Eigen::ColMajor> & cloud,
-			const Sophus::SE3f & position, int level,
+	void warp(const cloud_map & cloud, const Sophus::SE3f & position, int level,
 			cv::Mat & intencity_warped, cv::Mat & depth_warped);
 
 	inline cv::Mat get_i(int level) {
@@ -49,8 +58,18 @@ public:
 
 protected:
 
+	void init(const cv::Mat & yuv, const cv::Mat & depth,
+			const Sophus::SE3f & position, const Eigen::Vector3f & intrinsics,
+			int max_level);
+	void build_pyramid(const cv::Mat & yuv, const cv::Mat & depth);
+	void release_pyramid();
+
 	uint8_t ** intencity_pyr;
 	uint16_t ** depth_pyr;
+
+	// Set while level 0 is adopted from outside the arena.
+	boost::shared_ptr<const void> intencity_owner;
+	boost::shared_ptr<const void> depth_owner;
 	Sophus::SE3f position;
 	Eigen::Vector3f intrinsics;
 
@@ -0,0 +1,19 @@
+#ifndef IMAGE_RANGE_H_
+#define IMAGE_RANGE_H_
+
+#include <tbb/blocked_range2d.h>
+
+// Per pixel functors run over tiles of an image. Rows are the outer
+// dimension and columns the inner one, so a tile is a few contiguous row
+// segments and pixel coordinates come from the loop counters.
+typedef tbb::blocked_range2d<int> image_range;
+
+// Grain of the tiles, tbb splits a tile while it is larger than this.
+// tile_cols of 0 keeps whole rows together.
+void set_image_tile_size(int tile_rows, int tile_cols);
+void get_image_tile_size(int & tile_rows, int & tile_cols);
+
+// Range over a cols x rows image with the current tile size.
+image_range get_image_range(int cols, int rows);
+
+#endif /* IMAGE_RANGE_H_ */
@@ -7,12 +7,43 @@
 #include <sophus/se3.hpp>
 #include <tbb/parallel_for.h>
 #include <tbb/parallel_reduce.h>
+#include <tbb/spin_mutex.h>
+#include <boost/thread/mutex.hpp>
 
 #include <cv_bridge/cv_bridge.h>
 #include <rm_localization/Keyframe.h>
 
 #include <convert_depth_to_cloud.h>
 #include <reduce_jacobian.h>
+#include <reduce_warp_jacobian.h>
+#include <reduce_warp_residual.h>
+#include <point_set.h>
+#include <keyframe_codec.h>
+
+// How keyframe::estimate_relative_position builds the normal equations.
+enum tracking_mode {
+	// Warp the frame into intermediate images, then reduce them.
+	TRACKING_TWO_PASS,
+	// Warp and accumulate in one pass.
+	TRACKING_FUSED,
+	// Jacobians are computed once per keyframe, each iteration only warps
+	// and accumulates the points that stay in view.
+	TRACKING_INVERSE_COMPOSITIONAL
+};
+
+// Filled by keyframe::estimate_relative_position on request.
+struct tracking_stats {
+	static const int max_levels = 8;
+
+	int iterations;
+	// Fraction of level 0 pixels with a valid warp in the last iteration.
+	float valid_ratio;
+	// Root mean square intencity error of the last iteration.
+	float residual;
+	// Time spent on each tracked level in microseconds.
+	int num_levels;
+	int level_us[max_levels];
+};
 
 class keyframe: public frame {
 
@@ -26,9 +57,13 @@ public:
 
 	~keyframe();
 
-	bool estimate_position(frame & f);
-	bool estimate_relative_position(frame & f, Sophus::SE3f & Mrc);
+	bool estimate_position(frame & f, tracking_stats * stats = NULL);
+	bool estimate_relative_position(frame & f, Sophus::SE3f & Mrc,
+			tracking_stats * stats = NULL);
 
+	// Builds clouds, point sets and jacobians for the new intrinsics and
+	// swaps them in. Tracking from another thread keeps the previous ones
+	// until it finishes. Evicted keyframes are updated on restore.
 	void update_intrinsics(const Eigen::Vector3f & intrinsics);
 
 	inline cv::Mat get_i_dx(int level) {
@@ -41,8 +76,17 @@ public:
 				intencity_pyr_dy[level]);
 	}
 
+	// Without images the message only holds pose and intrinsics, images can
+	// be added later with encode_images outside of the map lock.
 	rm_localization::Keyframe::Ptr to_msg(
-			const cv_bridge::CvImageConstPtr & yuv2, int idx);
+			const cv_bridge::CvImageConstPtr & yuv2, int idx,
+			bool with_images = true);
+
+	// Falls back to PNG if a codec does not support the image.
+	void encode_images(const cv_bridge::CvImageConstPtr & yuv2,
+			rm_localization::Keyframe & k,
+			uint8_t rgb_codec = rm_localization::Keyframe::CODEC_PNG,
+			uint8_t depth_codec = rm_localization::Keyframe::CODEC_PNG);
 
 	inline long int get_id() {
 		return id;
@@ -52,14 +96,88 @@ public:
 		this->id = id;
 	}
 
+	// Mode and point limit change the current point sets in place, set them
+	// before the keyframe is tracked from other threads.
+	void set_tracking_mode(tracking_mode mode);
+
+	inline tracking_mode get_tracking_mode() {
+		return mode;
+	}
+
+	// Limits the points tracked at level 0 to the max_points with the
+	// largest gradients (scaled down by 4 per level). 0 tracks all points
+	// with depth. Does not apply to TRACKING_TWO_PASS.
+	void set_max_points(int max_points);
+
+	// The remaining iterations of a level are skipped once no component of
+	// the pose update is larger than threshold. 0 always runs all of them.
+	inline void set_convergence_threshold(float threshold) {
+		convergence_threshold = threshold;
+	}
+
+	// Evicted keyframes only keep level 0 intencity and compressed depth,
+	// everything else is rebuilt by restore. Pose and intrinsics stay
+	// valid, tracking against or encoding an evicted keyframe is not.
+	void evict();
+	void restore();
+
+	// Does not wait for update_intrinsics, returns false if it is running.
+	bool try_evict();
+
+	inline bool is_evicted() {
+		return evicted;
+	}
+
+	size_t get_memory_usage();
+
 protected:
 
+	// Everything that depends on the intrinsics. Tracking works on a
+	// reference to the current geometry, so update_intrinsics can replace
+	// it at any time. Buffers go back to the arena with the last reference.
+	struct geometry {
+		typedef boost::shared_ptr<geometry> Ptr;
+
+		Eigen::Vector3f intrinsics;
+		std::vector<cloud_map> clouds;
+		std::vector<point_set> points;
+
+		// Only used in TRACKING_INVERSE_COMPOSITIONAL mode.
+		std::vector<jacobian_map> jacobians;
+
+		~geometry();
+		void release_jacobians();
+
+		EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+	};
+
+	void build_gradients();
+	void release_gradients();
+	geometry::Ptr build_geometry(const Eigen::Vector3f & intrinsics);
+	void build_point_sets(geometry & g);
+	void compute_jacobians(geometry & g);
+	void evict_locked();
+
+	geometry::Ptr get_geometry() const;
+	void set_geometry(const geometry::Ptr & g);
+
 	long int id;
+	tracking_mode mode;
+	int max_points;
+	float convergence_threshold;
+
+	bool evicted;
+	std::vector<uint8_t> evicted_intencity;
+	std::vector<uint8_t> evicted_depth;
 
 	int16_t ** intencity_pyr_dx;
 	int16_t ** intencity_pyr_dy;
 
-	std::vector<Eigen::Matrix<float, 4, Eigen::Dynamic, Eigen::ColMajor> > clouds;
+	geometry::Ptr geom;
+	mutable tbb::spin_mutex geometry_mutex;
+
+	// Serializes eviction, restore and geometry rebuilds.
+	boost::mutex state_mutex;
 
 };
 
@@ -0,0 +1,32 @@
+#ifndef KEYFRAME_CODEC_H_
+#define KEYFRAME_CODEC_H_
+
+#include <vector>
+#include <string>
+#include <stdint.h>
+#include <opencv2/core/core.hpp>
+#include <rm_localization/Keyframe.h>
+
+// Image codecs for keyframe messages, codec ids are the CODEC_* constants of
+// rm_localization::Keyframe.
+//
+// CODEC_PNG        any image, slow to encode on ARM.
+// CODEC_RAW        any image, uncompressed pixels after a small header.
+// CODEC_JPEG       8 bit color, lossy.
+// CODEC_DEPTH_RLE  16 bit depth, lossless. Every pixel is predicted from its
+//                  left neighbour (the one above for the first column), runs
+//                  of exact predictions are stored as one run length and the
+//                  other prediction errors as zigzag varints.
+
+// Returns false if the codec can not encode this image type.
+bool encode_image(const cv::Mat & image, uint8_t codec,
+		std::vector<uint8_t> & data);
+
+// Returns an empty matrix if the data can not be decoded, like cv::imdecode.
+cv::Mat decode_image(const std::vector<uint8_t> & data, uint8_t codec);
+
+// Codec id by name ("png", "raw", "jpeg", "depth_rle"), CODEC_PNG for
+// unknown names.
+uint8_t get_codec(const std::string & name);
+
+#endif /* KEYFRAME_CODEC_H_ */
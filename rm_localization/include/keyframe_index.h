@@ -0,0 +1,59 @@
+#ifndef KEYFRAME_INDEX_H_
+#define KEYFRAME_INDEX_H_
+
+#include <vector>
+#include <cmath>
+#include <Eigen/StdVector>
+#include <sophus/se3.hpp>
+#include <cell_hash.h>
+
+// 1.0 when 10 degrees rotation or 0.3m translation
+inline float keyframe_distance(const Sophus::SE3f & t1,
+		const Sophus::SE3f & t2) {
+	float distance = (t1.translation() - t2.translation()).norm();
+	float angle = t1.unit_quaternion().angularDistance(t2.unit_quaternion());
+
+	return angle / (M_PI / 18) + distance / 0.3;
+}
+
+// Keyframe poses hashed into voxels by translation. Closest keyframe search
+// visits voxels in growing cubes around the query and stops as soon as the
+// translation part alone of every unvisited keyframe is further away than
+// the best match, so the result is the same as a linear scan.
+class keyframe_index {
+
+public:
+
+	keyframe_index(float cell_size = 0.3);
+
+	// Keyframe indices are the ones of the keyframe vector.
+	void insert(int idx, const Sophus::SE3f & pos);
+	void update(int idx, const Sophus::SE3f & pos);
+	void clear();
+
+	inline size_t size() const {
+		return cells.size();
+	}
+
+	// res is -1 if the index is empty.
+	void get_closest(const Sophus::SE3f & pos, int & res, float & dist) const;
+
+protected:
+
+	Eigen::Vector3i get_cell(const Sophus::SE3f & pos) const;
+
+	void visit(const Eigen::Vector3i & cell, const Sophus::SE3f & pos,
+			int & res, float & dist) const;
+
+	float cell_size;
+
+	cell_hash cells;
+	std::vector<Sophus::SE3f, Eigen::aligned_allocator<Sophus::SE3f> > positions;
+
+	// Bounding box of all cells that were ever used.
+	Eigen::Vector3i min_cell;
+	Eigen::Vector3i max_cell;
+
+};
+
+#endif /* KEYFRAME_INDEX_H_ */
@@ -0,0 +1,71 @@
+#ifndef KEYFRAME_PUBLISHER_H_
+#define KEYFRAME_PUBLISHER_H_
+
+#include <ros/ros.h>
+#include <boost/thread/thread.hpp>
+#include <boost/noncopyable.hpp>
+#include <tbb/concurrent_queue.h>
+#include <tbb/atomic.h>
+#include <algorithm>
+#include <keyframe.h>
+#include <telemetry.h>
+
+// Encodes and publishes keyframe messages on a background thread. Messages
+// are published in the order they were queued. Each queued item holds a
+// reference to the keyframe and the color image, so level 0 data stays
+// alive until it is encoded. When the queue is full publish blocks.
+class keyframe_publisher: boost::noncopyable {
+
+public:
+
+	keyframe_publisher(const ros::Publisher & pub,
+			uint8_t rgb_codec = rm_localization::Keyframe::CODEC_PNG,
+			uint8_t depth_codec = rm_localization::Keyframe::CODEC_PNG,
+			size_t capacity = 8);
+
+	// Publishes the remaining queued keyframes and stops the worker.
+	~keyframe_publisher();
+
+	// Message must have pose and intrinsics filled, see keyframe::to_msg.
+	void publish(const keyframe::Ptr & k,
+			const cv_bridge::CvImageConstPtr & yuv2,
+			const rm_localization::Keyframe::Ptr & msg);
+
+	inline size_t get_queue_depth() const {
+		return std::max<std::ptrdiff_t>(queue.size(), 0);
+	}
+
+	inline size_t get_num_published() const {
+		return num_published;
+	}
+
+	// Encode latency in milliseconds.
+	double get_mean_encode_time() const;
+	double get_max_encode_time() const;
+
+	inline const latency_histogram & get_encode_latency() const {
+		return encode_latency;
+	}
+
+protected:
+
+	struct item {
+		keyframe::Ptr k;
+		cv_bridge::CvImageConstPtr yuv2;
+		rm_localization::Keyframe::Ptr msg;
+	};
+
+	void run();
+
+	ros::Publisher pub;
+	uint8_t rgb_codec;
+	uint8_t depth_codec;
+	tbb::concurrent_bounded_queue<item> queue;
+	boost::thread worker;
+
+	tbb::atomic<size_t> num_published;
+	latency_histogram encode_latency;
+
+};
+
+#endif /* KEYFRAME_PUBLISHER_H_ */
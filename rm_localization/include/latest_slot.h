@@ -0,0 +1,40 @@
+#ifndef LATEST_SLOT_H_
+#define LATEST_SLOT_H_
+
+#include <boost/thread/mutex.hpp>
+#include <boost/noncopyable.hpp>
+
+// Single item buffer between two pipeline stages where only the latest item
+// matters. Putting an item replaces the one that was not taken yet. T is a
+// smart pointer, an empty pointer means the slot is empty.
+template<typename T>
+class latest_slot: boost::noncopyable {
+
+public:
+
+	// Returns false if a pending item was dropped.
+	bool put(const T & item) {
+		boost::mutex::scoped_lock lock(item_mutex);
+		bool dropped = !!this->item;
+		this->item = item;
+		return !dropped;
+	}
+
+	bool take(T & item) {
+		boost::mutex::scoped_lock lock(item_mutex);
+		if (!this->item)
+			return false;
+
+		item = this->item;
+		this->item.reset();
+		return true;
+	}
+
+protected:
+
+	boost::mutex item_mutex;
+	T item;
+
+};
+
+#endif /* LATEST_SLOT_H_ */
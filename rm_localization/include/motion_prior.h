@@ -0,0 +1,52 @@
+#ifndef MOTION_PRIOR_H_
+#define MOTION_PRIOR_H_
+
+#include <se3ukf.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+
+// Constant velocity motion model for the camera on top of SE3UKF. Tracking
+// starts from the predicted pose instead of the last one and the tracked
+// pose is fed back as a measurement. All methods lock, so poses can be
+// extrapolated from another thread while tracking runs.
+class motion_prior {
+
+public:
+
+	// Variance of tracked poses, the same for all 6 components.
+	motion_prior(float measurement_noise = 1e-4);
+
+	// Starts at pose with zero velocity.
+	void reset(const Sophus::SE3f & pose, double stamp);
+	void clear();
+
+	inline bool is_initialized() const {
+		boost::mutex::scoped_lock lock(mutex);
+		return ukf.get() != NULL;
+	}
+
+	// Pose at stamp. Stamps that do not advance return the last pose.
+	Sophus::SE3f predict(double stamp);
+	void measure(const Sophus::SE3f & pose);
+
+	// Pose at stamp predicted on a copy of the filter, so the filter state
+	// is left for tracking. Also gives the stamp of the last measurement.
+	// Returns false when not initialized.
+	bool extrapolate(double stamp, Sophus::SE3f & pose,
+			double & measurement_stamp) const;
+
+	// Moves the filter with the camera when the map is corrected,
+	// pose = correction * pose.
+	void correct(const Sophus::SE3f & correction);
+
+protected:
+
+	boost::shared_ptr<SE3UKFf> ukf;
+	double last_stamp;
+	double last_measurement_stamp;
+	mutable boost::mutex mutex;
+	float measurement_noise;
+
+};
+
+#endif /* MOTION_PRIOR_H_ */
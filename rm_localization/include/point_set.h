@@ -0,0 +1,36 @@
+#ifndef POINT_SET_H_
+#define POINT_SET_H_
+
+#include <stdint.h>
+#include <pyramid_arena.h>
+
+// Keyframe points of one pyramid level that have depth, stored as structure
+// of arrays in arena buffers. Optionally only the points with the largest
+// gradient magnitude are kept (semi dense tracking). Points stay in pixel
+// order.
+struct point_set {
+
+	int size;
+	// Number of points with depth before the gradient selection.
+	int num_candidates;
+
+	float * x;
+	float * y;
+	float * z;
+	uint8_t * intencity;
+	int16_t * intencity_dx;
+	int16_t * intencity_dy;
+	int32_t * idx;
+
+	point_set();
+
+	// Rebuilds the set from a dense level. max_points <= 0 keeps all points.
+	void build(const cloud_map & cloud, const uint8_t * intencity,
+			const int16_t * intencity_dx, const int16_t * intencity_dy,
+			int max_points = 0);
+
+	void release();
+
+};
+
+#endif /* POINT_SET_H_ */
@@ -0,0 +1,110 @@
+#ifndef PYRAMID_ARENA_H_
+#define PYRAMID_ARENA_H_
+
+#include <map>
+#include <vector>
+#include <cstddef>
+#include <Eigen/Core>
+#include <boost/thread/mutex.hpp>
+#include <boost/noncopyable.hpp>
+#include <tbb/atomic.h>
+
+// Point cloud of one pyramid level stored in an arena buffer.
+typedef Eigen::Map<Eigen::Matrix<float, 4, Eigen::Dynamic, Eigen::ColMajor>,
+		Eigen::Aligned> cloud_map;
+
+// Recycling pool for pyramid level buffers. Blocks are 64 byte aligned and
+// padded with one extra cache line at the end so that vectorized kernels can
+// safely read past the last pixel of a level. Released blocks are kept in a
+// free list keyed by their size and handed out again, so once every level
+// size has been seen frame construction does not touch the heap.
+class pyramid_arena: boost::noncopyable {
+
+public:
+
+	static const size_t alignment = 64;
+
+	static pyramid_arena & get();
+
+	~pyramid_arena();
+
+	void * acquire(size_t size);
+	void release(void * ptr, size_t size);
+
+	template<typename T>
+	inline T * acquire(size_t num_elements) {
+		return static_cast<T *>(acquire(num_elements * sizeof(T)));
+	}
+
+	template<typename T>
+	inline void release(T * ptr, size_t num_elements) {
+		release(static_cast<void *>(ptr), num_elements * sizeof(T));
+	}
+
+	// Frees all cached blocks. Blocks that are in use are not affected.
+	void trim();
+
+	// Number of blocks that were obtained from the heap since start.
+	inline size_t get_num_heap_allocations() const {
+		return num_heap_allocations;
+	}
+
+	// Number of blocks handed out by acquire since start.
+	inline size_t get_num_acquired() const {
+		return num_acquired;
+	}
+
+	// Number of blocks currently handed out.
+	inline size_t get_num_in_use() const {
+		return num_in_use;
+	}
+
+	// Bytes held in the free lists.
+	inline size_t get_cached_bytes() const {
+		return cached_bytes;
+	}
+
+protected:
+
+	pyramid_arena();
+
+	static size_t block_size(size_t size);
+
+	boost::mutex free_blocks_mutex;
+	std::map<size_t, std::vector<void *> > free_blocks;
+
+	tbb::atomic<size_t> num_heap_allocations;
+	tbb::atomic<size_t> num_acquired;
+	tbb::atomic<size_t> num_in_use;
+	tbb::atomic<size_t> cached_bytes;
+
+};
+
+// Scoped arena buffer of num_elements values of type T, NULL for 0.
+template<typename T>
+class arena_buffer: boost::noncopyable {
+
+public:
+
+	arena_buffer(size_t num_elements) :
+			num_elements(num_elements) {
+		data = num_elements ?
+				pyramid_arena::get().acquire<T>(num_elements) : NULL;
+	}
+
+	~arena_buffer() {
+		pyramid_arena::get().release<T>(data, num_elements);
+	}
+
+	inline T * get() {
+		return data;
+	}
+
+protected:
+
+	size_t num_elements;
+	T * data;
+
+};
+
+#endif /* PYRAMID_ARENA_H_ */
@@ -0,0 +1,69 @@
+#ifndef PYRAMID_BUILDER_H_
+#define PYRAMID_BUILDER_H_
+
+#include <stdint.h>
+#include <tbb/blocked_range.h>
+
+// Builds levels 1 to num_levels - 1 of the intencity and depth pyramids
+// from level 0. Intencity is the truncated mean of each 2x2 block, depth
+// the second largest of the four values. The range is over rows of the
+// coarsest level. Such a band covers the same image area on every level,
+// so all levels of a band are built while its rows are still in cache.
+struct subsample_pyramid {
+	uint8_t * const * intencity;
+	uint16_t * const * depth;
+	int cols;
+	int rows;
+	int num_levels;
+
+	subsample_pyramid(uint8_t * const * intencity, uint16_t * const * depth,
+			int cols, int rows, int num_levels) :
+			intencity(intencity), depth(depth), cols(cols), rows(rows), num_levels(
+					num_levels) {
+	}
+
+	// Rows of the coarsest level, the range to split.
+	inline int get_num_bands() const {
+		return rows >> (num_levels - 1);
+	}
+
+	void operator()(const tbb::blocked_range<int>& range) const;
+
+};
+
+// Central difference intencity gradients of every pyramid level, one sided
+// at the borders. The range is over rows of the coarsest level, like
+// subsample_pyramid.
+struct compute_gradients {
+	uint8_t * const * intencity;
+	int16_t * const * intencity_dx;
+	int16_t * const * intencity_dy;
+	int cols;
+	int rows;
+	int num_levels;
+
+	compute_gradients(uint8_t * const * intencity,
+			int16_t * const * intencity_dx, int16_t * const * intencity_dy,
+			int cols, int rows, int num_levels) :
+			intencity(intencity), intencity_dx(intencity_dx), intencity_dy(
+					intencity_dy), cols(cols), rows(rows), num_levels(
+					num_levels) {
+	}
+
+	inline int get_num_bands() const {
+		return rows >> (num_levels - 1);
+	}
+
+	void operator()(const tbb::blocked_range<int>& range) const;
+
+};
+
+// Row ranges of one level used by both functors. The last band also takes
+// the rows left over when rows is not divisible by the band height.
+inline void get_band_rows(int band_begin, int band_end, int num_bands,
+		int level_rows, int level_shift, int & begin, int & end) {
+	begin = band_begin << level_shift;
+	end = band_end == num_bands ? level_rows : band_end << level_shift;
+}
+
+#endif /* PYRAMID_BUILDER_H_ */
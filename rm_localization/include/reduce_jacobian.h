@@ -10,6 +10,7 @@
 
 #include <sophus/se3.hpp>
 #include <tbb/parallel_for.h>
+#include <pyramid_arena.h>
 
 struct reduce_jacobian {
 
@@ -24,19 +25,20 @@ struct reduce_jacobian {
 	const float * intencity_warped;
 	const float * depth_warped;
 	const Eigen::Vector3f & intrinsics;
-	const Eigen::Matrix<float, 4, Eigen::Dynamic, Eigen::ColMajor> & cloud;
+	const cloud_map & cloud;
 	int cols;
 	int rows;
 
 	reduce_jacobian(const uint8_t * intencity, const int16_t * intencity_dx,
 			const int16_t * intencity_dy, const float * intencity_warped,
 			const float * depth_warped, const Eigen::Vector3f & intrinsics,
-			const Eigen::Matrix<float, 4, Eigen::Dynamic, Eigen::ColMajor> & cloud,
+			const cloud_map & cloud,
 			int cols, int rows);
 
 	reduce_jacobian(reduce_jacobian & rb, tbb::split);
 
-	void compute_jacobian(const Eigen::Vector4f & p, Eigen::Matrix<float, 2, 6> & J);
+	static void compute_jacobian(const Eigen::Vector4f & p,
+			Eigen::Matrix<float, 2, 6> & J);
 
 	void operator()(const tbb::blocked_range<int>& range);
 
@@ -0,0 +1,37 @@
+#ifndef REDUCE_WARP_JACOBIAN_H_
+#define REDUCE_WARP_JACOBIAN_H_
+
+#include <sophus/se3.hpp>
+#include <tbb/parallel_reduce.h>
+#include <reduce_jacobian.h>
+#include <warp.h>
+#include <point_set.h>
+
+// Same normal equations as reduce_jacobian, but points are warped on the
+// fly in small tiles that stay in cache instead of going through full
+// size intermediate images. Runs over the compacted point set of a level.
+struct reduce_warp_jacobian {
+
+	static const int tile_size = 256;
+
+	Sophus::Matrix6f JtJ;
+	Sophus::Vector6f Jte;
+	int num_points;
+	float error_sum;
+
+	const parallel_warp & warp;
+	const point_set & points;
+	const Eigen::Vector3f & intrinsics;
+
+	reduce_warp_jacobian(const parallel_warp & warp, const point_set & points,
+			const Eigen::Vector3f & intrinsics);
+
+	reduce_warp_jacobian(reduce_warp_jacobian & rb, tbb::split);
+
+	void operator()(const tbb::blocked_range<int>& range);
+
+	void join(reduce_warp_jacobian& rb);
+
+};
+
+#endif /* REDUCE_WARP_JACOBIAN_H_ */
@@ -0,0 +1,60 @@
+#ifndef REDUCE_WARP_RESIDUAL_H_
+#define REDUCE_WARP_RESIDUAL_H_
+
+#include <sophus/se3.hpp>
+#include <tbb/parallel_for.h>
+#include <tbb/parallel_reduce.h>
+#include <pyramid_arena.h>
+#include <reduce_jacobian.h>
+#include <warp.h>
+#include <point_set.h>
+
+// 1x6 jacobians of the points of a point_set stored in an arena buffer.
+typedef Eigen::Map<Eigen::Matrix<float, 6, Eigen::Dynamic, Eigen::ColMajor>,
+		Eigen::Aligned> jacobian_map;
+
+// Computes the jacobians of all keyframe points with tbb::parallel_for.
+// They depend only on the keyframe, so inverse compositional tracking does
+// it once per keyframe instead of once per iteration.
+struct parallel_jacobian {
+
+	const point_set & points;
+	const Eigen::Vector3f & intrinsics;
+	jacobian_map & jacobians;
+
+	parallel_jacobian(const point_set & points,
+			const Eigen::Vector3f & intrinsics, jacobian_map & jacobians);
+
+	void operator()(const tbb::blocked_range<int>& range) const;
+
+};
+
+// Residual pass of inverse compositional tracking. Warps the points and
+// accumulates JtJ and Jte with the precomputed jacobians. JtJ only counts
+// the points that warp into the frame like Jte does, otherwise the step is
+// too small when few of them do.
+struct reduce_warp_residual {
+
+	static const int tile_size = 256;
+
+	Sophus::Matrix6f JtJ;
+	Sophus::Vector6f Jte;
+	int num_points;
+	float error_sum;
+
+	const parallel_warp & warp;
+	const point_set & points;
+	const jacobian_map & jacobians;
+
+	reduce_warp_residual(const parallel_warp & warp, const point_set & points,
+			const jacobian_map & jacobians);
+
+	reduce_warp_residual(reduce_warp_residual & rb, tbb::split);
+
+	void operator()(const tbb::blocked_range<int>& range);
+
+	void join(reduce_warp_residual& rb);
+
+};
+
+#endif /* REDUCE_WARP_RESIDUAL_H_ */
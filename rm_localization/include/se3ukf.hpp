@@ -10,6 +10,7 @@
 
 #include <sophus/se3.hpp>
 #include <iostream>
+#include <cmath>
 
 template<typename _Scalar>
 class SE3UKF {
@@ -25,107 +26,248 @@ public:
 	typedef Eigen::Matrix<_Scalar, 12, 12> Matrix12;
 	typedef Eigen::Matrix<_Scalar, 12, 6> Matrix12_6;
 
+	// Sigma points are stored as structure of arrays, one column per point.
+	// Rotations are quaternion coefficients in x, y, z, w order.
+	typedef Eigen::Matrix<_Scalar, 4, 25> Matrix4_25;
+	typedef Eigen::Matrix<_Scalar, 3, 25> Matrix3_25;
+	typedef Eigen::Matrix<_Scalar, 6, 25> Matrix6_25;
+	typedef Eigen::Matrix<_Scalar, 12, 25> Matrix12_25;
+	typedef Eigen::Array<_Scalar, 1, 25> Array25;
+
 	SE3Type pose;
 	Vector6 velocity;
 	Matrix12 covariance, model_noise;
 
-	SE3Type sigma_pose[25];
-	Vector6 sigma_velocity[25];
+	Matrix4_25 sigma_rotation;
+	Matrix3_25 sigma_translation;
+	Matrix6_25 sigma_velocity;
+
+	// Sigma point deviations from the mean, filled by
+	// compute_mean_and_covariance.
+	Matrix12_25 sigma_deviation;
 
 	unsigned int iteration;
 
-	void print_if_too_large(const Vector3 & update, const std::string & name) {
-		if (update.array().abs().maxCoeff() > M_PI / 4) {
-			std::cout << "[" << iteration << "]" << name
-					<< " has too large elements " << std::endl
-					<< update.transpose() << std::endl;
+	// The mean is warm started from the center sigma point, which is
+	// already close, so a few iterations are enough.
+	int max_mean_iterations;
+
+	// Diagnostics of the last update, reported by print_diagnostics
+	// outside of predict and measure.
+	_Scalar max_sigma_rotation;
+	int mean_iterations;
+
+	static Matrix3_25 cross(const Matrix3_25 & a, const Matrix3_25 & b) {
+		Matrix3_25 c;
+		c.row(0) = a.row(1).cwiseProduct(b.row(2))
+				- a.row(2).cwiseProduct(b.row(1));
+		c.row(1) = a.row(2).cwiseProduct(b.row(0))
+				- a.row(0).cwiseProduct(b.row(2));
+		c.row(2) = a.row(0).cwiseProduct(b.row(1))
+				- a.row(1).cwiseProduct(b.row(0));
+		return c;
+	}
+
+	static void normalize(Matrix4_25 & q) {
+		Array25 inv_norm = q.colwise().norm().array().inverse();
+		q.array().rowwise() *= inv_norm;
+	}
+
+	// Rotates every column of v by the quaternion in the same column of q.
+	static Matrix3_25 rotate(const Matrix4_25 & q, const Matrix3_25 & v) {
+		Matrix3_25 u = q.template topRows<3>();
+		Matrix3_25 uv = cross(u, v);
+		uv *= 2;
+		Matrix3_25 r = v + cross(u, uv);
+		r.array() += uv.array().rowwise() * q.row(3).array();
+		return r;
+	}
+
+	// SE3 exponent of every column, same as SE3Type::exp.
+	static void exp(const Matrix6_25 & a, Matrix4_25 & q, Matrix3_25 & t) {
+
+		const _Scalar eps = Sophus::SophusConstants<_Scalar>::epsilon();
+
+		Matrix3_25 omega = a.template bottomRows<3>();
+		Matrix3_25 upsilon = a.template topRows<3>();
+
+		Array25 theta_sq = omega.colwise().squaredNorm().array();
+		Array25 theta = theta_sq.sqrt();
+		Array25 half_sin = (theta * _Scalar(0.5)).sin();
+		Array25 half_cos = (theta * _Scalar(0.5)).cos();
+
+		// Taylor expansions near zero, half angle forms elsewhere avoid
+		// cancellation in 1 - cos.
+		Array25 imag_factor = (theta < eps).select(
+				_Scalar(0.5) - theta_sq / 48
+						+ theta_sq.square() / 3840, half_sin / theta);
+		Array25 real_factor = (theta < eps).select(
+				_Scalar(1) - theta_sq / 8 + theta_sq.square() / 384,
+				half_cos);
+		Array25 a1 = (theta < eps).select(_Scalar(0.5) - theta_sq / 24,
+				2 * half_sin.square() / theta_sq);
+		Array25 a2 = (theta < eps).select(
+				_Scalar(1) / 6 - theta_sq / 120,
+				(theta - 2 * half_sin * half_cos) / (theta_sq * theta));
+
+		q.template topRows<3>() = omega;
+		q.template topRows<3>().array().rowwise() *= imag_factor;
+		q.row(3) = real_factor.matrix();
+
+		Matrix3_25 wu = cross(omega, upsilon);
+		Matrix3_25 wwu = cross(omega, wu);
+		wu.array().rowwise() *= a1;
+		wwu.array().rowwise() *= a2;
+		t = upsilon + wu + wwu;
+	}
+
+	// SE3 logarithm of every column, same as SE3Type::log.
+	static void log(const Matrix4_25 & q, const Matrix3_25 & t,
+			Matrix6_25 & a) {
+
+		const _Scalar eps = Sophus::SophusConstants<_Scalar>::epsilon();
+
+		Array25 n_sq = q.template topRows<3>().colwise().squaredNorm().array();
+		Array25 n = n_sq.sqrt();
+		Array25 w = q.row(3).array();
+
+		Array25 atan_n_w;
+		for (int i = 0; i < 25; i++) {
+			atan_n_w[i] = std::atan(n[i] / w[i]);
 		}
+
+		Array25 f = (n < eps).select(2 * w.inverse() - 2 * n_sq / w.cube(),
+				2 * atan_n_w / n);
+		Array25 theta = f * n;
+
+		Matrix3_25 omega = q.template topRows<3>();
+		omega.array().rowwise() *= f;
+
+		// theta / (2 tan(theta / 2)) is f * w / 2.
+		Array25 c = (theta.abs() < eps).select(Array25::Constant(
+				_Scalar(1) / 12), (1 - f * w / 2) / theta.square());
+
+		Matrix3_25 wt = cross(omega, t);
+		Matrix3_25 wwt = cross(omega, wt);
+		wwt.array().rowwise() *= c;
+
+		a.template topRows<3>() = t - wt / 2 + wwt;
+		a.template bottomRows<3>() = omega;
 	}
 
-	void compute_sigma_points(const Vector12 & delta = Vector12::Zero()) {
+	// Applies p from the left to every sigma point.
+	static void compose(const SE3Type & p, Matrix4_25 & q, Matrix3_25 & t) {
 
-		print_if_too_large(delta.template segment<3>(3), "Delta");
+		const Eigen::Quaternion<_Scalar> & r = p.unit_quaternion();
 
-		Eigen::LLT<Matrix12> llt_of_covariance(covariance);
-		assert(llt_of_covariance.info() == Eigen::Success);
-		Matrix12 L = llt_of_covariance.matrixL();
+		// Left multiplication by r as a matrix on x, y, z, w.
+		Eigen::Matrix<_Scalar, 4, 4> L;
+		L << r.w(), -r.z(), r.y(), r.x(),
+				r.z(), r.w(), -r.x(), r.y(),
+				-r.y(), r.x(), r.w(), r.z(),
+				-r.x(), -r.y(), -r.z(), r.w();
 
-		sigma_pose[0] = pose * SE3Type::exp(delta.template head<6>());
-		sigma_velocity[0] = velocity + delta.template tail<6>();
+		q = L * q;
+		normalize(q);
 
-		for (int i = 0; i < 12; i++) {
-			Vector12 eps = L.col(i);
+		t = p.rotationMatrix() * t;
+		t.colwise() += p.translation();
+	}
+
+	// Applies every column of qb, tb from the right to qa, ta.
+	static void compose(Matrix4_25 & qa, Matrix3_25 & ta,
+			const Matrix4_25 & qb, const Matrix3_25 & tb) {
 
-			sigma_pose[1 + i] = pose
-					* SE3Type::exp(
-							delta.template head<6>() + eps.template head<6>());
-			sigma_velocity[1 + i] = velocity + delta.template tail<6>()
-					+ eps.template tail<6>();
+		ta += rotate(qa, tb);
 
-			sigma_pose[13 + i] = pose
-					* SE3Type::exp(
-							delta.template head<6>() - eps.template head<6>());
-			sigma_velocity[13 + i] = velocity + delta.template tail<6>()
-					- eps.template tail<6>();
+		Matrix4_25 q;
+		Matrix3_25 ua = qa.template topRows<3>();
+		Matrix3_25 ub = qb.template topRows<3>();
+		q.template topRows<3>() = cross(ua, ub);
+		q.template topRows<3>().array() += ub.array().rowwise()
+				* qa.row(3).array() + ua.array().rowwise() * qb.row(3).array();
+		q.row(3) = qa.row(3).cwiseProduct(qb.row(3))
+				- ua.cwiseProduct(ub).colwise().sum();
 
-			print_if_too_large(eps.template segment<3>(3), "Epsilon");
-			print_if_too_large(
-					delta.template segment<3>(3) + eps.template segment<3>(3),
-					"Delta + Epsilon");
-			print_if_too_large(
-					delta.template segment<3>(3) - eps.template segment<3>(3),
-					"Delta - Epsilon");
+		qa = q;
+		normalize(qa);
+	}
 
+	void print_diagnostics(std::ostream & out = std::cout) const {
+		if (max_sigma_rotation > M_PI / 4) {
+			out << "[" << iteration << "] Sigma point rotation "
+					<< max_sigma_rotation << " is too large" << std::endl;
 		}
+		if (mean_iterations >= max_mean_iterations) {
+			out << "[" << iteration << "] Mean did not converge in "
+					<< mean_iterations << " iterations" << std::endl;
+		}
+	}
+
+	void compute_sigma_points(const Vector12 & delta = Vector12::Zero()) {
+
+		Eigen::LLT<Matrix12> llt_of_covariance(covariance);
+		assert(llt_of_covariance.info() == Eigen::Success);
+		Matrix12 L = llt_of_covariance.matrixL();
+
+		Matrix12_25 eps;
+		eps.col(0) = delta;
+		eps.template middleCols<12>(1) = L.colwise() + delta;
+		eps.template middleCols<12>(13) = (-L).colwise() + delta;
+
+		max_sigma_rotation =
+				eps.template middleRows<3>(3).array().abs().maxCoeff();
+
+		exp(eps.template topRows<6>(), sigma_rotation, sigma_translation);
+		compose(pose, sigma_rotation, sigma_translation);
+
+		sigma_velocity = eps.template bottomRows<6>();
+		sigma_velocity.colwise() += velocity;
 
 	}
 
 	void compute_mean(SE3Type & mean_pose, Vector6 & mean_velocity) {
 
-		mean_velocity.setZero();
-		for (int i = 0; i < 25; i++) {
-			mean_velocity += sigma_velocity[i];
-		}
-		mean_velocity /= 25.0f;
+		mean_velocity = sigma_velocity.rowwise().mean();
+
+		mean_pose = SE3Type(
+				Eigen::Quaternion<_Scalar>(sigma_rotation(3, 0),
+						sigma_rotation(0, 0), sigma_rotation(1, 0),
+						sigma_rotation(2, 0)), sigma_translation.col(0));
 
-		mean_pose = sigma_pose[0];
+		Matrix4_25 q;
+		Matrix3_25 t;
+		Matrix6_25 a;
 		Vector6 delta;
 
-		const static int max_iterations = 1000;
-		int iterations = 0;
+		mean_iterations = 0;
 
-		do {
-			delta.setZero();
+		for (;;) {
+			q = sigma_rotation;
+			t = sigma_translation;
+			compose(mean_pose.inverse(), q, t);
+			log(q, t, a);
 
-			for (int i = 0; i < 25; i++) {
-				delta += SE3Type::log(mean_pose.inverse() * sigma_pose[i]);
-			}
-			delta /= 25.0f;
+			delta = a.rowwise().mean();
+
+			if (delta.array().abs().maxCoeff()
+					<= Sophus::SophusConstants<_Scalar>::epsilon()
+					|| mean_iterations >= max_mean_iterations)
+				break;
 
 			mean_pose *= SE3Type::exp(delta);
-			iterations++;
+			mean_iterations++;
+		}
 
-		} while (delta.array().abs().maxCoeff()
-				> Sophus::SophusConstants<_Scalar>::epsilon()
-				&& iterations < max_iterations);
+		sigma_deviation.template topRows<6>() = a.colwise() - delta;
+		sigma_deviation.template bottomRows<6>() = sigma_velocity.colwise()
+				- mean_velocity;
 
 	}
 
 	void compute_mean_and_covariance() {
 		compute_mean(pose, velocity);
-		covariance.setZero();
-
-		for (int i = 0; i < 25; i++) {
-			Vector12 eps;
-
-			eps.template head<6>() = SE3Type::log(
-					pose.inverse() * sigma_pose[i]);
-			eps.template tail<6>() = sigma_velocity[i] - velocity;
-
-			covariance += eps * eps.transpose();
-		}
-		covariance /= 2;
-
+		covariance = sigma_deviation * sigma_deviation.transpose() / 2;
 	}
 
 public:
@@ -141,15 +283,20 @@ public:
 		model_noise.setIdentity();
 		model_noise *= 0.01;
 
+		max_mean_iterations = 10;
+		max_sigma_rotation = 0;
+		mean_iterations = 0;
+
 	}
 
 	void predict(_Scalar dt) {
 
 		compute_sigma_points();
 
-		for (int i = 0; i < 25; i++) {
-			sigma_pose[i] *= SE3Type::exp(dt * sigma_velocity[i]);
-		}
+		Matrix4_25 q;
+		Matrix3_25 t;
+		exp(dt * sigma_velocity, q, t);
+		compose(sigma_rotation, sigma_translation, q, t);
 
 		compute_mean_and_covariance();
 		covariance += model_noise * dt;
@@ -0,0 +1,73 @@
+#ifndef SPSC_QUEUE_H_
+#define SPSC_QUEUE_H_
+
+#include <tbb/atomic.h>
+#include <boost/noncopyable.hpp>
+#include <vector>
+
+// Bounded lock free queue for exactly one producer and one consumer thread.
+// Neither side ever blocks or calls into the kernel, a push to a full queue
+// fails instead. Capacity is rounded up to a power of two.
+template<typename T>
+class spsc_queue: boost::noncopyable {
+
+public:
+
+	spsc_queue(size_t capacity) {
+		size_t size = 1;
+		while (size < capacity)
+			size <<= 1;
+
+		items.resize(size);
+		mask = size - 1;
+		head = 0;
+		tail = 0;
+	}
+
+	inline size_t capacity() const {
+		return items.size();
+	}
+
+	inline size_t size() const {
+		return tail - head;
+	}
+
+	// Producer side.
+	inline bool push(const T & item) {
+		size_t t = tail;
+		if (t - head == items.size())
+			return false;
+
+		items[t & mask] = item;
+		// Release store publishes the item before the new tail.
+		tail = t + 1;
+		return true;
+	}
+
+	// Consumer side.
+	inline bool pop(T & item) {
+		size_t h = head;
+		if (h == tail)
+			return false;
+
+		item = items[h & mask];
+		head = h + 1;
+		return true;
+	}
+
+protected:
+
+	std::vector<T> items;
+	size_t mask;
+
+	// Written by the consumer and the producer only, each on its own cache
+	// line.
+	char pad0[64];
+	tbb::atomic<size_t> head;
+	char pad1[64];
+	tbb::atomic<size_t> tail;
+	char pad2[64];
+
+};
+
+#endif /* SPSC_QUEUE_H_ */
@@ -0,0 +1,183 @@
+#ifndef TELEMETRY_H_
+#define TELEMETRY_H_
+
+#include <tbb/atomic.h>
+#include <tbb/tick_count.h>
+#include <boost/noncopyable.hpp>
+#include <diagnostic_msgs/DiagnosticStatus.h>
+#include <ostream>
+#include <stdint.h>
+#include <string>
+
+struct tracking_stats;
+
+// Lock free histogram of durations with power of two microsecond buckets.
+// Any thread can add, readers see a consistent enough snapshot for
+// reporting.
+class latency_histogram: boost::noncopyable {
+
+public:
+
+	// Bucket i holds durations below 2^i us, the last one everything above.
+	static const int num_buckets = 24;
+
+	latency_histogram();
+
+	void add(size_t us);
+
+	inline void add(const tbb::tick_count & start) {
+		add((tbb::tick_count::now() - start).seconds() * 1e6);
+	}
+
+	inline size_t get_count() const {
+		return count;
+	}
+
+	// Milliseconds, percentiles are rounded up to the bucket bound.
+	double get_mean() const;
+	double get_max() const;
+	double get_percentile(double p) const;
+
+	void print(std::ostream & out, const std::string & name) const;
+	void to_msg(diagnostic_msgs::DiagnosticStatus & status,
+			const std::string & name) const;
+
+protected:
+
+	tbb::atomic<size_t> buckets[num_buckets];
+	tbb::atomic<size_t> count;
+	tbb::atomic<size_t> total_us;
+	tbb::atomic<size_t> max_us;
+
+};
+
+// Lock free histogram of values in [0, max_value) with equal buckets,
+// larger values go to the last one.
+class value_histogram: boost::noncopyable {
+
+public:
+
+	static const int num_buckets = 32;
+
+	value_histogram(double max_value);
+
+	void add(double value);
+
+	inline size_t get_count() const {
+		return count;
+	}
+
+	double get_mean() const;
+	double get_percentile(double p) const;
+
+	void print(std::ostream & out, const std::string & name) const;
+	void to_msg(diagnostic_msgs::DiagnosticStatus & status,
+			const std::string & name) const;
+
+protected:
+
+	double max_value;
+	tbb::atomic<size_t> buckets[num_buckets];
+	tbb::atomic<size_t> count;
+	// Sum in millionths of the value.
+	tbb::atomic<size_t> total;
+
+};
+
+// Pipeline stages of the localization node.
+enum telemetry_stage {
+	// Sharing the ROS images with OpenCV.
+	STAGE_BRIDGE,
+	STAGE_PYRAMID,
+	// Closest keyframe lookup, including restoring it when evicted.
+	STAGE_SEARCH,
+	STAGE_TRACK,
+	STAGE_KEYFRAME,
+	STAGE_PUBLISH,
+	// Frame stamp to the end of publishing.
+	STAGE_TOTAL,
+	NUM_TELEMETRY_STAGES
+};
+
+// Latency of every stage and tracking quality. Disabled telemetry only
+// costs a branch per measurement.
+class telemetry: boost::noncopyable {
+
+public:
+
+	static const int max_levels = 8;
+
+	telemetry();
+
+	inline bool is_enabled() const {
+		return enabled;
+	}
+
+	inline void set_enabled(bool enabled) {
+		this->enabled = enabled;
+	}
+
+	inline latency_histogram & get(telemetry_stage stage) {
+		return stages[stage];
+	}
+
+	inline void add(telemetry_stage stage, const tbb::tick_count & start) {
+		if (enabled)
+			stages[stage].add(start);
+	}
+
+	inline void add(telemetry_stage stage, size_t us) {
+		if (enabled)
+			stages[stage].add(us);
+	}
+
+	// Per level time, iterations, valid points and residual of one
+	// tracked frame.
+	void add(const tracking_stats & stats);
+
+	void print(std::ostream & out) const;
+	void to_msg(diagnostic_msgs::DiagnosticStatus & status) const;
+
+protected:
+
+	bool enabled;
+	latency_histogram stages[NUM_TELEMETRY_STAGES];
+	latency_histogram levels[max_levels];
+	value_histogram iterations;
+	value_histogram valid_ratio;
+	value_histogram residual;
+
+};
+
+// Adds the time from construction to destruction to a stage. When us is
+// given the time is also stored there, even with telemetry disabled.
+class scoped_timer: boost::noncopyable {
+
+public:
+
+	inline scoped_timer(telemetry & t, telemetry_stage stage,
+			uint32_t * us = NULL) :
+			t(t), stage(stage), us(us) {
+		if (t.is_enabled() || us)
+			start = tbb::tick_count::now();
+	}
+
+	inline ~scoped_timer() {
+		if (us) {
+			*us = (tbb::tick_count::now() - start).seconds() * 1e6;
+			t.add(stage, *us);
+		} else {
+			t.add(stage, start);
+		}
+	}
+
+protected:
+
+	telemetry & t;
+	telemetry_stage stage;
+	uint32_t * us;
+	tbb::tick_count start;
+
+};
+
+#endif /* TELEMETRY_H_ */
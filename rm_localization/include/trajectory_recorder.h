@@ -0,0 +1,113 @@
+#ifndef TRAJECTORY_RECORDER_H_
+#define TRAJECTORY_RECORDER_H_
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <boost/thread/thread.hpp>
+#include <boost/noncopyable.hpp>
+#include <tbb/atomic.h>
+#include <spsc_queue.h>
+#include <telemetry.h>
+
+// Trajectory file layout, native byte order. A header is followed by
+// num_records records, both record_size bytes long. The file is grown in
+// chunks, so it can be longer than the records it holds.
+struct trajectory_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t record_size;
+	uint64_t num_records;
+	// Records dropped because the queue was full.
+	uint64_t num_dropped;
+	uint8_t reserved[64];
+};
+
+struct trajectory_record {
+	static const int max_stages = 8;
+
+	enum {
+		FLAG_TRACKED = 1, FLAG_NEW_KEYFRAME = 2
+	};
+
+	// Frame stamp in seconds.
+	double stamp;
+	// Camera position in the odom frame, rotation as x y z w.
+	float translation[3];
+	float rotation[4];
+	// Closest keyframe the frame was tracked against, -1 for none.
+	int32_t keyframe_idx;
+	int32_t iterations;
+	float residual;
+	float valid_ratio;
+	uint32_t flags;
+	// Time spent in each telemetry_stage in microseconds.
+	uint32_t stage_us[max_stages];
+	uint32_t reserved[2];
+};
+
+// Writes trajectory records to a memory mapped file. Recording only copies
+// the record into a lock free queue, a background thread moves records to
+// the mapped file and maps the next chunk when one is full. Records are
+// dropped and counted when the writer falls behind.
+class trajectory_recorder: boost::noncopyable {
+
+public:
+
+	static const uint32_t version = 1;
+	static const size_t chunk_records = 1 << 16;
+
+	trajectory_recorder(const std::string & filename,
+			size_t queue_size = 1024);
+
+	// Writes the remaining queued records and truncates the file to them.
+	~trajectory_recorder();
+
+	inline bool is_open() const {
+		return header != NULL;
+	}
+
+	// Called from a single thread.
+	inline bool record(const trajectory_record & r) {
+		if (queue.push(r))
+			return true;
+
+		num_dropped++;
+		return false;
+	}
+
+	inline size_t get_num_written() const {
+		return num_written;
+	}
+
+	inline size_t get_num_dropped() const {
+		return num_dropped;
+	}
+
+protected:
+
+	void run();
+	bool write_queued();
+	bool map_chunk(size_t chunk);
+	void unmap_chunk();
+
+	spsc_queue<trajectory_record> queue;
+	boost::thread worker;
+
+	int fd;
+	// Header lives in the first chunk, which stays mapped.
+	trajectory_header * header;
+	uint8_t * first_chunk;
+	uint8_t * current_chunk;
+	size_t current_chunk_idx;
+
+	tbb::atomic<size_t> num_written;
+	tbb::atomic<size_t> num_dropped;
+
+};
+
+// Reads all records of a trajectory file, returns false if it is not one.
+bool read_trajectory(const std::string & filename,
+		std::vector<trajectory_record> & records);
+
+#endif /* TRAJECTORY_RECORDER_H_ */
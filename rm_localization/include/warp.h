@@ -9,57 +9,138 @@
 #define WARP_H_
 
 #include <tbb/blocked_range.h>
+#include <image_range.h>
+#include <pyramid_arena.h>
+#include <point_set.h>
+
+// Implementations of the warp loop. The vectorized ones process 4 (SSE4.1)
+// or 8 (AVX2) points at a time and produce the same output as the scalar one.
+enum warp_kernel {
+	WARP_KERNEL_SCALAR, WARP_KERNEL_SSE4, WARP_KERNEL_AVX2
+};
+
+struct parallel_warp;
+
+// Best kernel supported by the cpu we are running on.
+warp_kernel get_best_warp_kernel();
+bool is_warp_kernel_supported(warp_kernel kernel);
+
+void warp_sse4(const parallel_warp & w, int begin, int end,
+		float * intencity_out, float * depth_out);
+void warp_avx2(const parallel_warp & w, int begin, int end,
+		float * intencity_out, float * depth_out);
 
 struct parallel_warp {
 	const uint8_t * intencity;
 	const uint16_t * depth;
 	const Eigen::Matrix<float, 4, 4, Eigen::ColMajor> & transform;
-	const Eigen::Matrix<float, 4, Eigen::Dynamic, Eigen::ColMajor> & cloud;
+	// Either a dense cloud with one column per pixel or a compacted point
+	// set is warped, the other one is NULL.
+	const cloud_map * cloud;
+	const point_set * points;
 	const Eigen::Vector3f & intrinsics;
 	int cols;
 	int rows;
 	float * intencity_warped;
 	float * depth_warped;
+	warp_kernel kernel;
 
 	parallel_warp(const uint8_t * intencity, const uint16_t * depth,
 			const Eigen::Matrix<float, 4, 4, Eigen::ColMajor> & transform,
-			const Eigen::Matrix<float, 4, Eigen::Dynamic, Eigen::ColMajor> & cloud,
+			const cloud_map & cloud,
 			const Eigen::Vector3f & intrinsics, int cols, int rows,
 			float * intencity_warped, float * depth_warped) :
 			intencity(intencity), depth(depth), transform(transform), cloud(
-					cloud), intrinsics(intrinsics), cols(cols), rows(rows), intencity_warped(
-					intencity_warped), depth_warped(depth_warped) {
+					&cloud), points(NULL), intrinsics(intrinsics), cols(cols), rows(
+					rows), intencity_warped(intencity_warped), depth_warped(
+					depth_warped), kernel(get_best_warp_kernel()) {
+	}
+
+	// Warps a point set. Results go to index i of the set, use warp_range.
+	parallel_warp(const uint8_t * intencity, const uint16_t * depth,
+			const Eigen::Matrix<float, 4, 4, Eigen::ColMajor> & transform,
+			const point_set & points, const Eigen::Vector3f & intrinsics,
+			int cols, int rows) :
+			intencity(intencity), depth(depth), transform(transform), cloud(
+					NULL), points(&points), intrinsics(intrinsics), cols(cols), rows(
+					rows), intencity_warped(NULL), depth_warped(NULL), kernel(
+					get_best_warp_kernel()) {
+	}
+
+	inline Eigen::Vector4f get_point(int i) const {
+		if (points) {
+			return Eigen::Vector4f(points->x[i], points->y[i], points->z[i],
+					1.0f);
+		} else {
+			return cloud->col(i);
+		}
 	}
 
 	void operator()(const tbb::blocked_range<int>& range) const {
-		for (int i = range.begin(); i != range.end(); i++) {
+		warp_range(range.begin(), range.end(),
+				intencity_warped + range.begin(),
+				depth_warped + range.begin());
+	}
+
+	// Dense cloud only, each row segment of the tile is one warp_range.
+	void operator()(const image_range& range) const {
+		for (int v = range.rows().begin(); v != range.rows().end(); v++) {
+			int begin = v * cols + range.cols().begin();
+			int end = v * cols + range.cols().end();
+			warp_range(begin, end, intencity_warped + begin,
+					depth_warped + begin);
+		}
+	}
+
+	// Warps points [begin, end) and writes the result for point i to
+	// intencity_out[i - begin] and depth_out[i - begin].
+	void warp_range(int begin, int end, float * intencity_out,
+			float * depth_out) const {
+		switch (kernel) {
+		case WARP_KERNEL_AVX2:
+			warp_avx2(*this, begin, end, intencity_out, depth_out);
+			break;
+		case WARP_KERNEL_SSE4:
+			warp_sse4(*this, begin, end, intencity_out, depth_out);
+			break;
+		default:
+			warp_scalar(begin, end, intencity_out, depth_out);
+			break;
+		}
+	}
+
+	void warp_scalar(int begin, int end, float * intencity_out,
+			float * depth_out) const {
+		for (int i = begin; i != end; i++) {
 
-			Eigen::Vector4f p = cloud.col(i);
+			Eigen::Vector4f p = get_point(i);
 			if (p(3) > 0) {
 				p = transform * p;
 
 				float uw = p(0) * intrinsics[0] / p(2) + intrinsics[1];
 				float vw = p(1) * intrinsics[0] / p(2) + intrinsics[2];
 
-				if (uw >= 0 && uw < cols && vw >= 0 && vw < rows) {
+				// All four interpolation taps have to be inside the image,
+				// level buffers may be adopted without padding.
+				if (uw >= 0 && uw < cols - 1 && vw >= 0 && vw < rows - 1) {
 
 					float val = interpolate(uw, vw, p(2));
 					if (val > 0) {
-						intencity_warped[i] = val;
-						depth_warped[i] = p(2) * 1000;
+						intencity_out[i - begin] = val;
+						depth_out[i - begin] = p(2) * 1000;
 					} else {
-						intencity_warped[i] = 0;
-						depth_warped[i] = 0;
+						intencity_out[i - begin] = 0;
+						depth_out[i - begin] = 0;
 					}
 
 				} else {
-					intencity_warped[i] = 0;
-					depth_warped[i] = 0;
+					intencity_out[i - begin] = 0;
+					depth_out[i - begin] = 0;
 				}
 
 			} else {
-				intencity_warped[i] = 0;
-				depth_warped[i] = 0;
+				intencity_out[i - begin] = 0;
+				depth_out[i - begin] = 0;
 
 			}
 
@@ -76,7 +157,9 @@ struct parallel_warp {
 		float v0 = vw - v;
 		float u1 = 1 - u0;
 		float v1 = 1 - v0;
-		uint16_t z_p_eps = z * 1000 - 50;
+		// int32_t like the vector kernels, points closer than 5 cm give a
+		// negative threshold instead of wrapping around.
+		int32_t z_p_eps = z * 1000 - 50;
 
 		float val = 0;
 		float sum = 0;
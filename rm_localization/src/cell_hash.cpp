@@ -0,0 +1,61 @@
+#include <cell_hash.h>
+#include <algorithm>
+
+static const int cell_bits = 21;
+static const int cell_mask = (1 << cell_bits) - 1;
+
+cell_hash::cell_hash() :
+		num_indices(0) {
+}
+
+bool cell_hash::insert(int idx, const Eigen::Vector3i & cell) {
+
+	if (idx >= (int) keys.size())
+		keys.resize(idx + 1, -1);
+
+	int64_t key = get_key(cell);
+	if (key == keys[idx])
+		return false;
+
+	if (keys[idx] != -1)
+		remove(idx);
+
+	cells[key].push_back(idx);
+	keys[idx] = key;
+	num_indices++;
+
+	return true;
+}
+
+void cell_hash::remove(int idx) {
+
+	std::vector<int> & c = cells[keys[idx]];
+	c.erase(std::find(c.begin(), c.end(), idx));
+	if (c.empty())
+		cells.erase(keys[idx]);
+
+	keys[idx] = -1;
+	num_indices--;
+}
+
+void cell_hash::clear() {
+	cells.clear();
+	keys.clear();
+	num_indices = 0;
+}
+
+const std::vector<int> * cell_hash::find(const Eigen::Vector3i & cell) const {
+	map_type::const_iterator it = cells.find(get_key(cell));
+	return it == cells.end() ? NULL : &it->second;
+}
+
+int64_t cell_hash::get_key(const Eigen::Vector3i & cell) {
+	return int64_t(cell[0] & cell_mask)
+			| (int64_t(cell[1] & cell_mask) << cell_bits)
+			| (int64_t(cell[2] & cell_mask) << (2 * cell_bits));
+}
+
+Eigen::Vector3i cell_hash::get_cell(int64_t key) {
+	return Eigen::Vector3i(key & cell_mask, (key >> cell_bits) & cell_mask,
+			(key >> (2 * cell_bits)) & cell_mask);
+}
@@ -6,6 +6,26 @@
 frame::frame(const cv::Mat & yuv, const cv::Mat & depth,
 		const Sophus::SE3f & position, const Eigen::Vector3f & intrinsics,
 		int max_level) {
+	init(yuv, depth, position, intrinsics, max_level);
+}
+
+frame::frame(const cv::Mat & yuv, const cv::Mat & depth,
+		const boost::shared_ptr<const void> & yuv_owner,
+		const boost::shared_ptr<const void> & depth_owner,
+		const Sophus::SE3f & position, const Eigen::Vector3f & intrinsics,
+		int max_level) {
+
+	if (yuv.type() == CV_8UC1 && yuv.isContinuous())
+		this->intencity_owner = yuv_owner;
+	if (depth.type() == CV_16UC1 && depth.isContinuous())
+		this->depth_owner = depth_owner;
+
+	init(yuv, depth, position, intrinsics, max_level);
+}
+
+void frame::init(const cv::Mat & yuv, const cv::Mat & depth,
+		const Sophus::SE3f & position, const Eigen::Vector3f & intrinsics,
+		int max_level) {
 
 	assert(yuv.cols == depth.cols && yuv.rows == depth.rows);
 
@@ -16,35 +36,49 @@ frame::frame(const cv::Mat & yuv, const cv::Mat & depth,
 	rows = yuv.rows;
 	this->max_level = max_level;
 
-	intencity_pyr = new uint8_t *[max_level];
-	depth_pyr = new uint16_t *[max_level];
+	pyramid_arena & arena = pyramid_arena::get();
+
+	intencity_pyr = arena.acquire<uint8_t *>(max_level);
+	depth_pyr = arena.acquire<uint16_t *>(max_level);
+
+	build_pyramid(yuv, depth);
+
+}
+
+void frame::build_pyramid(const cv::Mat & yuv, const cv::Mat & depth) {
+
+	pyramid_arena & arena = pyramid_arena::get();
 
 	for (int level = 0; level < max_level; level++) {
-		intencity_pyr[level] = new uint8_t[(cols * rows) >> (2 * level)];
-		depth_pyr[level] = new uint16_t[(cols * rows) >> (2 * level)];
+		if (level > 0 || !intencity_owner)
+			intencity_pyr[level] = arena.acquire<uint8_t>(
+					(cols * rows) >> (2 * level));
+		if (level > 0 || !depth_owner)
+			depth_pyr[level] = arena.acquire<uint16_t>(
+					(cols * rows) >> (2 * level));
 	}
 
-	if (yuv.channels() == 3) {
+	if (intencity_owner) {
+		intencity_pyr[0] = yuv.data;
+	} else if (yuv.channels() == 3) {
 		cv::cvtColor(yuv, get_i(0), CV_RGB2GRAY);
 	} else if (yuv.channels() == 2) {
-		convert cvt(yuv.data, intencity_pyr[0]);
-		tbb::parallel_for(tbb::blocked_range<int>(0, cols * rows), cvt);
+		convert cvt(yuv.data, intencity_pyr[0], cols);
+		tbb::parallel_for(get_image_range(cols, rows), cvt);
 
 	} else if (yuv.channels() == 1) {
 		memcpy(intencity_pyr[0], yuv.data, cols * rows * sizeof(uint8_t));
 	}
-	memcpy(depth_pyr[0], depth.data, cols * rows * sizeof(uint16_t));
-
-	for (int level = 1; level < max_level; level++) {
-
-		subsample sub(intencity_pyr[level - 1], depth_pyr[level - 1],
-				cols >> level, rows >> level, intencity_pyr[level],
-				depth_pyr[level]);
-		tbb::parallel_for(
-				tbb::blocked_range<int>(0, (cols * rows) >> (2 * level)), sub);
 
+	if (depth_owner) {
+		depth_pyr[0] = (uint16_t *) depth.data;
+	} else {
+		memcpy(depth_pyr[0], depth.data, cols * rows * sizeof(uint16_t));
 	}
 
+	subsample_pyramid sub(intencity_pyr, depth_pyr, cols, rows, max_level);
+	tbb::parallel_for(tbb::blocked_range<int>(0, sub.get_num_bands()), sub);
+
 	/*
 	 cv::imshow("get_i(0)", get_i(0));
 	 cv::imshow("get_d(0)", get_d(0));
@@ -57,8 +91,31 @@ frame::frame(const cv::Mat & yuv, const cv::Mat & depth,
 
 }
 
-void frame::warp(
-		const Eigen::Matrix<float, 4, Eigen::Dynamic, Eigen::ColMajor> & cloud,
+void frame::release_pyramid() {
+
+	pyramid_arena & arena = pyramid_arena::get();
+
+	// Levels are NULL while the pyramid is released.
+	for (int level = 0; level < max_level; level++) {
+		if (intencity_pyr[level] == NULL)
+			continue;
+
+		if (level > 0 || !intencity_owner)
+			arena.release<uint8_t>(intencity_pyr[level],
+					(cols * rows) >> (2 * level));
+		if (level > 0 || !depth_owner)
+			arena.release<uint16_t>(depth_pyr[level],
+					(cols * rows) >> (2 * level));
+		intencity_pyr[level] = NULL;
+		depth_pyr[level] = NULL;
+	}
+
+	intencity_owner.reset();
+	depth_owner.reset();
+
+}
+
+void frame::warp(const cloud_map & cloud,
 		const Sophus::SE3f & relative_position, int level,
 		cv::Mat & intencity_warped, cv::Mat & depth_warped) {
 
@@ -74,18 +131,16 @@ void frame::warp(
 			intrinsics, c, r, (float *) intencity_warped.data,
 			(float *) depth_warped.data);
 
-	tbb::parallel_for(tbb::blocked_range<int>(0, c * r), w);
+	tbb::parallel_for(get_image_range(c, r), w);
 
 }
 
 frame::~frame() {
 
-	for (int level = 0; level < max_level; level++) {
-		delete[] intencity_pyr[level];
-		delete[] depth_pyr[level];
-	}
+	release_pyramid();
 
-	delete[] intencity_pyr;
-	delete[] depth_pyr;
+	pyramid_arena & arena = pyramid_arena::get();
+	arena.release<uint8_t *>(intencity_pyr, max_level);
+	arena.release<uint16_t *>(depth_pyr, max_level);
 
 }
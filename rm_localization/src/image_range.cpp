@@ -0,0 +1,21 @@
+#include <image_range.h>
+#include <algorithm>
+
+static int image_tile_rows = 8;
+static int image_tile_cols = 0;
+
+void set_image_tile_size(int tile_rows, int tile_cols) {
+	image_tile_rows = std::max(tile_rows, 1);
+	image_tile_cols = std::max(tile_cols, 0);
+}
+
+void get_image_tile_size(int & tile_rows, int & tile_cols) {
+	tile_rows = image_tile_rows;
+	tile_cols = image_tile_cols;
+}
+
+image_range get_image_range(int cols, int rows) {
+	int tile_cols = image_tile_cols == 0 ? cols : image_tile_cols;
+	return image_range(0, rows, image_tile_rows, 0, cols,
+			std::max(tile_cols, 1));
+}
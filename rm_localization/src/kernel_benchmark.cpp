@@ -0,0 +1,207 @@
+/*
+ * kernel_benchmark.cpp
+ *
+ * Times the per pixel kernels of frame and keyframe construction and of
+ * two pass tracking on synthetic VGA and QVGA images, for several thread
+ * counts and tile sizes. Warp is also timed over the linear pixel range
+ * for comparison, jacobian reduction only runs over it.
+ *
+ * Usage:
+ *   kernel_benchmark [--threads n]... [--tile rows cols] [--iterations n]
+ *
+ * Thread counts default to 1 2 4 8, the tile size to the one of
+ * image_range.h.
+ */
+
+#include <frame.h>
+#include <convert_depth_to_cloud.h>
+#include <reduce_jacobian.h>
+#include <tbb/task_scheduler_init.h>
+#include <tbb/parallel_reduce.h>
+#include <tbb/tick_count.h>
+#include <iostream>
+#include <cstdio>
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+
+struct benchmark_images {
+	int cols;
+	int rows;
+	Eigen::Vector3f intrinsics;
+
+	std::vector<uint8_t> yuv;
+	std::vector<uint8_t *> intencity;
+	std::vector<uint16_t *> depth;
+	std::vector<int16_t *> intencity_dx;
+	std::vector<int16_t *> intencity_dy;
+	float * cloud_data;
+	float * intencity_warped;
+	float * depth_warped;
+
+	benchmark_images(int cols, int rows, int num_levels) :
+			cols(cols), rows(rows), yuv(2 * cols * rows), intencity(
+					num_levels), depth(num_levels), intencity_dx(num_levels), intencity_dy(
+					num_levels) {
+
+		intrinsics << 525.0 * cols / 640, (cols - 1) / 2.0, (rows - 1) / 2.0;
+
+		pyramid_arena & arena = pyramid_arena::get();
+		for (int level = 0; level < num_levels; level++) {
+			int size = (cols >> level) * (rows >> level);
+			intencity[level] = arena.acquire<uint8_t>(size);
+			depth[level] = arena.acquire<uint16_t>(size);
+			intencity_dx[level] = arena.acquire<int16_t>(size);
+			intencity_dy[level] = arena.acquire<int16_t>(size);
+		}
+		cloud_data = arena.acquire<float>(4 * cols * rows);
+		intencity_warped = arena.acquire<float>(cols * rows);
+		depth_warped = arena.acquire<float>(cols * rows);
+
+		// Smooth texture on a slanted plane with a few holes.
+		srand(1);
+		for (int v = 0; v < rows; v++) {
+			for (int u = 0; u < cols; u++) {
+				int i = v * cols + u;
+				yuv[2 * i] = 128;
+				yuv[2 * i + 1] = 128 + 60 * std::sin(u * 0.05)
+						+ 60 * std::cos(v * 0.07);
+				depth[0][i] = rand() % 16 == 0 ? 0 : 1500 + 2 * v + u;
+			}
+		}
+	}
+
+	~benchmark_images() {
+		pyramid_arena & arena = pyramid_arena::get();
+		for (size_t level = 0; level < intencity.size(); level++) {
+			int size = (cols >> level) * (rows >> level);
+			arena.release<uint8_t>(intencity[level], size);
+			arena.release<uint16_t>(depth[level], size);
+			arena.release<int16_t>(intencity_dx[level], size);
+			arena.release<int16_t>(intencity_dy[level], size);
+		}
+		arena.release<float>(cloud_data, 4 * cols * rows);
+		arena.release<float>(intencity_warped, cols * rows);
+		arena.release<float>(depth_warped, cols * rows);
+	}
+};
+
+static double ms(const tbb::tick_count & start, int iterations) {
+	return (tbb::tick_count::now() - start).seconds() * 1000 / iterations;
+}
+
+static void run(int cols, int rows, int num_threads, int iterations) {
+
+	const int num_levels = 3;
+
+	tbb::task_scheduler_init init(num_threads);
+	benchmark_images b(cols, rows, num_levels);
+	cloud_map cloud(b.cloud_data, 4, cols * rows);
+
+	Eigen::Affine3f t(
+			Eigen::AngleAxisf(0.02, Eigen::Vector3f(1, 2, 3).normalized()));
+	t.translation() << 0.02, -0.01, 0.03;
+	Eigen::Matrix<float, 4, 4, Eigen::ColMajor> transform(t.matrix());
+
+	tbb::tick_count start;
+
+	start = tbb::tick_count::now();
+	for (int k = 0; k < iterations; k++) {
+		convert cvt(&b.yuv[0], b.intencity[0], cols);
+		tbb::parallel_for(get_image_range(cols, rows), cvt);
+	}
+	double convert_ms = ms(start, iterations);
+
+	start = tbb::tick_count::now();
+	for (int k = 0; k < iterations; k++) {
+		subsample_pyramid sub(&b.intencity[0], &b.depth[0], cols, rows,
+				num_levels);
+		tbb::parallel_for(tbb::blocked_range<int>(0, sub.get_num_bands()),
+				sub);
+		compute_gradients grad(&b.intencity[0], &b.intencity_dx[0],
+				&b.intencity_dy[0], cols, rows, num_levels);
+		tbb::parallel_for(tbb::blocked_range<int>(0, grad.get_num_bands()),
+				grad);
+	}
+	double pyramid_ms = ms(start, iterations);
+
+	start = tbb::tick_count::now();
+	for (int k = 0; k < iterations; k++) {
+		convert_depth_to_pointcloud sub(b.intencity[0], b.depth[0],
+				b.intrinsics, cols, rows, cloud);
+		tbb::parallel_for(get_image_range(cols, rows), sub);
+	}
+	double cloud_ms = ms(start, iterations);
+
+	parallel_warp w(b.intencity[0], b.depth[0], transform, cloud,
+			b.intrinsics, cols, rows, b.intencity_warped, b.depth_warped);
+
+	start = tbb::tick_count::now();
+	for (int k = 0; k < iterations; k++) {
+		tbb::parallel_for(get_image_range(cols, rows), w);
+	}
+	double warp_ms = ms(start, iterations);
+
+	start = tbb::tick_count::now();
+	for (int k = 0; k < iterations; k++) {
+		tbb::parallel_for(tbb::blocked_range<int>(0, cols * rows), w);
+	}
+	double warp_linear_ms = ms(start, iterations);
+
+	start = tbb::tick_count::now();
+	for (int k = 0; k < iterations; k++) {
+		reduce_jacobian rj(b.intencity[0], b.intencity_dx[0],
+				b.intencity_dy[0], b.intencity_warped, b.depth_warped,
+				b.intrinsics, cloud, cols, rows);
+		tbb::parallel_reduce(tbb::blocked_range<int>(0, cols * rows), rj);
+	}
+	double reduce_ms = ms(start, iterations);
+
+	printf("%4dx%-4d %7d %8.3f %8.3f %8.3f %8.3f %8.3f %8.3f\n", cols,
+			rows, num_threads, convert_ms, pyramid_ms, cloud_ms, warp_ms,
+			warp_linear_ms, reduce_ms);
+}
+
+int main(int argc, char **argv) {
+
+	std::vector<int> threads;
+	int iterations = 200;
+
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--threads" && i + 1 < argc) {
+			threads.push_back(atoi(argv[++i]));
+		} else if (arg == "--tile" && i + 2 < argc) {
+			set_image_tile_size(atoi(argv[i + 1]), atoi(argv[i + 2]));
+			i += 2;
+		} else if (arg == "--iterations" && i + 1 < argc) {
+			iterations = atoi(argv[++i]);
+		} else {
+			std::cerr << "Usage: " << argv[0]
+					<< " [--threads n]... [--tile rows cols] [--iterations n]"
+					<< std::endl;
+			return 1;
+		}
+	}
+
+	if (threads.empty()) {
+		threads.push_back(1);
+		threads.push_back(2);
+		threads.push_back(4);
+		threads.push_back(8);
+	}
+
+	int tile_rows, tile_cols;
+	get_image_tile_size(tile_rows, tile_cols);
+	printf("Tile %d rows x %d cols (0 is whole rows), times in ms per call\n",
+			tile_rows, tile_cols);
+	printf("%-9s %7s %8s %8s %8s %8s %8s %8s\n", "size", "threads",
+			"convert", "pyramid", "cloud", "warp", "warp_1d", "reduce");
+
+	for (size_t i = 0; i < threads.size(); i++) {
+		run(640, 480, threads[i], iterations);
+		run(320, 240, threads[i], iterations);
+	}
+
+	return 0;
+}
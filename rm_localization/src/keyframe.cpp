@@ -2,61 +2,304 @@
 #include <opencv2/imgproc/imgproc.hpp>
 #include <opencv2/highgui/highgui.hpp>
 #include <tbb/parallel_for.h>
+#include <tbb/tick_count.h>
+#include <algorithm>
 
 keyframe::keyframe(const cv::Mat & yuv, const cv::Mat & depth,
 		const Sophus::SE3f & position, const Eigen::Vector3f & intrinsics,
 		int max_level) :
 		frame(yuv, depth, position, intrinsics, max_level) {
 
-	intencity_pyr_dx = new int16_t *[max_level];
-	intencity_pyr_dy = new int16_t *[max_level];
+	mode = TRACKING_FUSED;
+	max_points = 0;
+	convergence_threshold = 0;
+	evicted = false;
+
+	pyramid_arena & arena = pyramid_arena::get();
+
+	intencity_pyr_dx = arena.acquire<int16_t *>(max_level);
+	intencity_pyr_dy = arena.acquire<int16_t *>(max_level);
+
+	build_gradients();
+	geom = build_geometry(intrinsics);
+
+	/*
+	 cv::imshow("intencity_pyr", intencity_pyr);
+	 cv::imshow("depth_pyr", depth_pyr);
+	 cv::imshow("intencity_pyr_dx", intencity_pyr_dx);
+	 cv::imshow("intencity_pyr_dy", intencity_pyr_dy);
+	 cv::waitKey();
+	 */
+
+}
+
+keyframe::geometry::~geometry() {
+
+	pyramid_arena & arena = pyramid_arena::get();
+
+	for (size_t level = 0; level < clouds.size(); level++) {
+		arena.release<float>(clouds[level].data(), clouds[level].size());
+	}
+
+	for (size_t level = 0; level < points.size(); level++) {
+		points[level].release();
+	}
+
+	release_jacobians();
+
+}
+
+void keyframe::geometry::release_jacobians() {
+
+	pyramid_arena & arena = pyramid_arena::get();
+
+	for (size_t level = 0; level < jacobians.size(); level++) {
+		arena.release<float>(jacobians[level].data(), jacobians[level].size());
+	}
+
+	jacobians.clear();
+
+}
+
+void keyframe::build_gradients() {
+
+	pyramid_arena & arena = pyramid_arena::get();
 
 	for (int level = 0; level < max_level; level++) {
-		intencity_pyr_dx[level] = new int16_t[cols * rows / (1 << 2 * level)];
-		intencity_pyr_dy[level] = new int16_t[cols * rows / (1 << 2 * level)];
+		intencity_pyr_dx[level] = arena.acquire<int16_t>(
+				cols * rows / (1 << 2 * level));
+		intencity_pyr_dy[level] = arena.acquire<int16_t>(
+				cols * rows / (1 << 2 * level));
 	}
 
-	clouds.resize(max_level);
+	compute_gradients grad(intencity_pyr, intencity_pyr_dx, intencity_pyr_dy,
+			cols, rows, max_level);
+	tbb::parallel_for(tbb::blocked_range<int>(0, grad.get_num_bands()), grad);
+
+}
+
+void keyframe::release_gradients() {
+
+	pyramid_arena & arena = pyramid_arena::get();
+
+	for (int level = 0; level < max_level; level++) {
+		arena.release<int16_t>(intencity_pyr_dx[level],
+				cols * rows / (1 << 2 * level));
+		arena.release<int16_t>(intencity_pyr_dy[level],
+				cols * rows / (1 << 2 * level));
+	}
+
+}
+
+keyframe::geometry::Ptr keyframe::build_geometry(
+		const Eigen::Vector3f & intrinsics) {
+
+	pyramid_arena & arena = pyramid_arena::get();
+
+	geometry::Ptr g(new geometry);
+	g->intrinsics = intrinsics;
+
+	g->clouds.reserve(max_level);
 	for (int level = 0; level < max_level; level++) {
 
 		int c = cols >> level;
 		int r = rows >> level;
 
-		Eigen::Vector3f intrinsics = get_intrinsics(level);
-		clouds[level].setZero(4, c * r);
+		Eigen::Vector3f level_intrinsics = intrinsics / (1 << level);
+		g->clouds.push_back(
+				cloud_map(arena.acquire<float>(4 * c * r), 4, c * r));
+		g->clouds[level].setZero();
 
 		convert_depth_to_pointcloud sub(intencity_pyr[level], depth_pyr[level],
-				intrinsics, c, r, clouds[level], intencity_pyr_dx[level],
-				intencity_pyr_dy[level]);
-		tbb::parallel_for(tbb::blocked_range<int>(0, c * r), sub);
+				level_intrinsics, c, r, g->clouds[level]);
+		tbb::parallel_for(get_image_range(c, r), sub);
 
 	}
 
-	/*
-	 cv::imshow("intencity_pyr", intencity_pyr);
-	 cv::imshow("depth_pyr", depth_pyr);
-	 cv::imshow("intencity_pyr_dx", intencity_pyr_dx);
-	 cv::imshow("intencity_pyr_dy", intencity_pyr_dy);
-	 cv::waitKey();
-	 */
+	g->points.resize(max_level);
+	build_point_sets(*g);
+	if (mode == TRACKING_INVERSE_COMPOSITIONAL)
+		compute_jacobians(*g);
+
+	return g;
+}
+
+keyframe::geometry::Ptr keyframe::get_geometry() const {
+	tbb::spin_mutex::scoped_lock lock(geometry_mutex);
+	return geom;
+}
 
+void keyframe::set_geometry(const geometry::Ptr & g) {
+	geometry::Ptr old;
+	{
+		tbb::spin_mutex::scoped_lock lock(geometry_mutex);
+		old = geom;
+		geom = g;
+	}
+	// The old geometry is released outside of the lock, or later by the
+	// last tracker using it.
 }
 
 keyframe::~keyframe() {
 
+	if (!evicted)
+		release_gradients();
+
+	pyramid_arena & arena = pyramid_arena::get();
+	arena.release<int16_t *>(intencity_pyr_dx, max_level);
+	arena.release<int16_t *>(intencity_pyr_dy, max_level);
+
+}
+
+void keyframe::evict() {
+	boost::mutex::scoped_lock lock(state_mutex);
+	evict_locked();
+}
+
+bool keyframe::try_evict() {
+	boost::mutex::scoped_try_lock lock(state_mutex);
+	if (!lock.owns_lock())
+		return false;
+
+	evict_locked();
+	return true;
+}
+
+void keyframe::evict_locked() {
+
+	if (evicted)
+		return;
+
+	evicted_intencity.assign(intencity_pyr[0], intencity_pyr[0] + cols * rows);
+	encode_image(get_d(0), rm_localization::Keyframe::CODEC_DEPTH_RLE,
+			evicted_depth);
+
+	set_geometry(geometry::Ptr());
+	release_gradients();
+	release_pyramid();
+
+	evicted = true;
+
+}
+
+void keyframe::restore() {
+
+	boost::mutex::scoped_lock lock(state_mutex);
+
+	if (!evicted)
+		return;
+
+	cv::Mat intencity(rows, cols, CV_8U, &evicted_intencity[0]);
+	cv::Mat depth = decode_image(evicted_depth,
+			rm_localization::Keyframe::CODEC_DEPTH_RLE);
+
+	build_pyramid(intencity, depth);
+	build_gradients();
+	set_geometry(build_geometry(intrinsics));
+
+	std::vector<uint8_t>().swap(evicted_intencity);
+	std::vector<uint8_t>().swap(evicted_depth);
+
+	evicted = false;
+
+}
+
+size_t keyframe::get_memory_usage() {
+
+	if (evicted)
+		return evicted_intencity.size() + evicted_depth.size();
+
+	geometry::Ptr g = get_geometry();
+
+	size_t bytes = 0;
+	for (int level = 0; level < max_level; level++) {
+		size_t n = (cols * rows) >> (2 * level);
+		// Intencity, depth, gradients and the cloud.
+		bytes += n
+				* (sizeof(uint8_t) + sizeof(uint16_t) + 2 * sizeof(int16_t)
+						+ 4 * sizeof(float));
+		// Point set and jacobians.
+		bytes += g->points[level].size
+				* (3 * sizeof(float) + sizeof(uint8_t) + 2 * sizeof(int16_t)
+						+ sizeof(int32_t));
+		if (!g->jacobians.empty())
+			bytes += g->jacobians[level].size() * sizeof(float);
+	}
+
+	return bytes;
+}
+
+void keyframe::set_max_points(int max_points) {
+
+	boost::mutex::scoped_lock lock(state_mutex);
+
+	if (this->max_points == max_points)
+		return;
+
+	this->max_points = max_points;
+
+	// Point sets are built on restore.
+	if (evicted)
+		return;
+
+	build_point_sets(*geom);
+	if (!geom->jacobians.empty())
+		compute_jacobians(*geom);
+}
+
+void keyframe::build_point_sets(geometry & g) {
 	for (int level = 0; level < max_level; level++) {
-		delete[] intencity_pyr_dx[level];
-		delete[] intencity_pyr_dy[level];
+		// Small budgets keep at least one point per level, 0 would keep all.
+		int level_max_points =
+				max_points > 0 ? std::max(1, max_points >> (2 * level)) : 0;
+		g.points[level].build(g.clouds[level], intencity_pyr[level],
+				intencity_pyr_dx[level], intencity_pyr_dy[level],
+				level_max_points);
 	}
+}
+
+void keyframe::set_tracking_mode(tracking_mode mode) {
+
+	boost::mutex::scoped_lock lock(state_mutex);
 
-	delete[] intencity_pyr_dx;
-	delete[] intencity_pyr_dy;
+	this->mode = mode;
 
+	if (evicted)
+		return;
+
+	if (mode == TRACKING_INVERSE_COMPOSITIONAL) {
+		if (geom->jacobians.empty())
+			compute_jacobians(*geom);
+	} else {
+		geom->release_jacobians();
+	}
 }
 
-bool keyframe::estimate_position(frame & f) {
+void keyframe::compute_jacobians(geometry & g) {
+
+	pyramid_arena & arena = pyramid_arena::get();
+
+	g.release_jacobians();
+
+	g.jacobians.reserve(max_level);
+
+	for (int level = 0; level < max_level; level++) {
+
+		int n = g.points[level].size;
+		g.jacobians.push_back(
+				jacobian_map(arena.acquire<float>(6 * n), 6, n));
+
+		parallel_jacobian pj(g.points[level], g.intrinsics,
+				g.jacobians[level]);
+		tbb::parallel_for(tbb::blocked_range<int>(0, n), pj);
+
+	}
+
+}
+
+bool keyframe::estimate_position(frame & f, tracking_stats * stats) {
 	Sophus::SE3f Mrc;
-	bool res = estimate_relative_position(f, Mrc);
+	bool res = estimate_relative_position(f, Mrc, stats);
 	if (res) {
 		f.position = position * Mrc;
 	}
@@ -64,52 +307,155 @@ bool keyframe::estimate_position(frame & f) {
 
 }
 
-bool keyframe::estimate_relative_position(frame & f, Sophus::SE3f & Mrc) {
+bool keyframe::estimate_relative_position(frame & f, Sophus::SE3f & Mrc,
+		tracking_stats * stats) {
+
+	if (stats) {
+		stats->iterations = 0;
+		stats->valid_ratio = 0;
+		stats->residual = 0;
+		stats->num_levels = 0;
+	}
 
-	int level_iterations[] = { 2, 4, 6 };
+	// Reference to the current geometry, update_intrinsics may replace it
+	// while tracking.
+	geometry::Ptr g = get_geometry();
+	if (!g)
+		return false;
 
 	Mrc = position.inverse() * f.position;
 
-	for (int level = 2; level >= 0; level--) {
-		for (int iteration = 0; iteration < level_iterations[level];
-				iteration++) {
+	// Only the two pass mode writes warped images.
+	size_t warped_size = mode == TRACKING_TWO_PASS ? cols * rows : 0;
+	arena_buffer<float> intencity_warped_data(warped_size), depth_warped_data(
+			warped_size);
 
-			cv::Mat intencity = get_i(level), depth = get_d(level),
-					intencity_dx = get_i_dx(level), intencity_dy = get_i_dy(
-							level);
+	// Coarser levels are cheaper and get more iterations.
+	int num_levels = std::min(max_level, f.max_level);
+
+	if (stats) {
+		stats->num_levels = std::min(num_levels,
+				(int) tracking_stats::max_levels);
+		std::fill(stats->level_us, stats->level_us + stats->num_levels, 0);
+	}
+	for (int level = num_levels - 1; level >= 0; level--) {
 
-			cv::Mat intencity_warped(intencity.rows, intencity.cols, CV_32F),
-					depth_warped(depth.rows, depth.cols, CV_32F);
+		tbb::tick_count level_start;
+		if (stats)
+			level_start = tbb::tick_count::now();
+
+		int num_iterations = 2 * (level + 1);
+		for (int iteration = 0; iteration < num_iterations; iteration++) {
 
 			int c = cols >> level;
 			int r = rows >> level;
 
-			f.warp(clouds[level], Mrc.inverse(), level,
-					intencity_warped, depth_warped);
+			Sophus::Matrix6f JtJ;
+			Sophus::Vector6f Jte;
+			int num_points;
+			float error_sum;
+			int num_residuals;
 
-			reduce_jacobian rj(intencity_pyr[level], intencity_pyr_dx[level],
-					intencity_pyr_dy[level], (float *) intencity_warped.data,
-					(float *) depth_warped.data, intrinsics, clouds[level], c,
-					r);
+			if (mode == TRACKING_TWO_PASS) {
 
-			tbb::parallel_reduce(
-					tbb::blocked_range<int>(0, intencity.cols * intencity.rows),
-					rj);
+				cv::Mat intencity_warped(r, c, CV_32F,
+						intencity_warped_data.get()), depth_warped(r, c,
+						CV_32F, depth_warped_data.get());
 
-			//rj(tbb::blocked_range<int>(0, intencity.cols * intencity.rows));
+				f.warp(g->clouds[level], Mrc.inverse(), level, intencity_warped,
+						depth_warped);
+
+				reduce_jacobian rj(intencity_pyr[level],
+						intencity_pyr_dx[level], intencity_pyr_dy[level],
+						(float *) intencity_warped.data,
+						(float *) depth_warped.data, g->intrinsics,
+						g->clouds[level], c, r);
+
+				tbb::parallel_reduce(tbb::blocked_range<int>(0, c * r), rj);
+
+				//rj(tbb::blocked_range<int>(0, intencity.cols * intencity.rows));
+
+				JtJ = rj.JtJ;
+				Jte = rj.Jte;
+				num_points = rj.num_points;
+				num_residuals = num_points;
+				error_sum = rj.error_sum;
+
+			} else {
+
+				Eigen::Matrix<float, 4, 4, Eigen::ColMajor> transform(
+						Mrc.inverse().matrix());
+				Eigen::Vector3f frame_intrinsics = f.get_intrinsics(level);
+
+				const point_set & ps = g->points[level];
+
+				parallel_warp w(f.intencity_pyr[level], f.depth_pyr[level],
+						transform, ps, frame_intrinsics, c, r);
+
+				if (mode == TRACKING_INVERSE_COMPOSITIONAL) {
+
+					reduce_warp_residual rj(w, ps, g->jacobians[level]);
+
+					tbb::parallel_reduce(tbb::blocked_range<int>(0, ps.size),
+							rj);
+
+					JtJ = rj.JtJ;
+					Jte = rj.Jte;
+					num_points = rj.num_points;
+					error_sum = rj.error_sum;
+
+				} else {
+
+					reduce_warp_jacobian rj(w, ps, g->intrinsics);
+
+					tbb::parallel_reduce(tbb::blocked_range<int>(0, ps.size),
+							rj);
+
+					JtJ = rj.JtJ;
+					Jte = rj.Jte;
+					num_points = rj.num_points;
+					error_sum = rj.error_sum;
+
+				}
+
+				num_residuals = num_points;
+
+				// Scale to the number of pixels that would have been valid
+				// if all points with depth were tracked.
+				if (ps.size > 0 && ps.size < ps.num_candidates) {
+					num_points = (double) num_points * ps.num_candidates
+							/ ps.size;
+				}
 
-			if (level == 0 && iteration == level_iterations[level]-1 && (float) rj.num_points / (c * r) < 0.1) {
-				return false;
 			}
 
-			//ROS_INFO("Mean error %f with %f\% valid points", std::sqrt(rj.error_sum)/rj.num_points, (float)rj.num_points / (c*r));
+			if (stats) {
+				stats->iterations++;
+				stats->valid_ratio = (float) num_points / (c * r);
+				stats->residual =
+						num_residuals > 0 ?
+								std::sqrt(error_sum / num_residuals) : 0;
+				if (level < tracking_stats::max_levels)
+					stats->level_us[level] = (tbb::tick_count::now()
+							- level_start).seconds() * 1e6;
+			}
+
+			Sophus::Vector6f update = -JtJ.ldlt().solve(Jte);
+			bool converged = update.array().abs().maxCoeff()
+					< convergence_threshold;
 
-			Sophus::Vector6f update = -rj.JtJ.ldlt().solve(rj.Jte);
+			if (level == 0 && (iteration == num_iterations - 1 || converged)
+					&& (float) num_points / (c * r) < 0.1) {
+				return false;
+			}
 
 			//std::cerr << "update " << std::endl << update << std::endl;
 
 			Mrc = Sophus::SE3f::exp(update) * Mrc;
 
+			if (converged)
+				break;
+
 			//std::cerr << "Transform " << std::endl << f.position.matrix()
 			//		<< std::endl;
 
@@ -127,39 +473,27 @@ bool keyframe::estimate_relative_position(frame & f, Sophus::SE3f & Mrc) {
 }
 
 void keyframe::update_intrinsics(const Eigen::Vector3f & intrinsics) {
-	this->intrinsics = intrinsics;
 
-	for (int level = 0; level < max_level; level++) {
+	boost::mutex::scoped_lock lock(state_mutex);
 
-		int c = cols >> level;
-		int r = rows >> level;
+	this->intrinsics = intrinsics;
 
-		Eigen::Vector3f intrinsics = get_intrinsics(level);
-		clouds[level].setZero(4, c * r);
+	// Geometry is built with the new intrinsics on restore.
+	if (evicted)
+		return;
 
-		convert_depth_to_pointcloud sub(intencity_pyr[level], depth_pyr[level],
-				intrinsics, c, r, clouds[level], intencity_pyr_dx[level],
-				intencity_pyr_dy[level]);
-		tbb::parallel_for(tbb::blocked_range<int>(0, c * r), sub);
-
-	}
+	set_geometry(build_geometry(intrinsics));
 
 }
 
 rm_localization::Keyframe::Ptr keyframe::to_msg(
-		const cv_bridge::CvImageConstPtr & yuv2, int idx) {
+		const cv_bridge::CvImageConstPtr & yuv2, int idx, bool with_images) {
 	rm_localization::Keyframe::Ptr k(new rm_localization::Keyframe);
 
-	cv::Mat rgb;
-	if (yuv2->image.channels() == 3) {
-		rgb = yuv2->image;
-	} else {
-		cv::cvtColor(yuv2->image, rgb, CV_YUV2RGB_UYVY);
+	if (with_images) {
+		encode_images(yuv2, *k);
 	}
 
-	cv::imencode(".png", rgb, k->rgb_png_data);
-	cv::imencode(".png", get_d(0), k->depth_png_data);
-
 	k->header.frame_id = yuv2->header.frame_id;
 	k->header.stamp = yuv2->header.stamp;
 
@@ -180,3 +514,27 @@ rm_localization::Keyframe::Ptr keyframe::to_msg(
 
 	return k;
 }
+
+void keyframe::encode_images(const cv_bridge::CvImageConstPtr & yuv2,
+		rm_localization::Keyframe & k, uint8_t rgb_codec,
+		uint8_t depth_codec) {
+
+	cv::Mat rgb;
+	if (yuv2->image.channels() == 3) {
+		rgb = yuv2->image;
+	} else {
+		cv::cvtColor(yuv2->image, rgb, CV_YUV2RGB_UYVY);
+	}
+
+	if (!encode_image(rgb, rgb_codec, k.rgb_png_data)) {
+		rgb_codec = rm_localization::Keyframe::CODEC_PNG;
+		encode_image(rgb, rgb_codec, k.rgb_png_data);
+	}
+	k.rgb_codec = rgb_codec;
+
+	if (!encode_image(get_d(0), depth_codec, k.depth_png_data)) {
+		depth_codec = rm_localization::Keyframe::CODEC_PNG;
+		encode_image(get_d(0), depth_codec, k.depth_png_data);
+	}
+	k.depth_codec = depth_codec;
+}
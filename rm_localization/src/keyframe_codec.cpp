@@ -0,0 +1,233 @@
+#include <keyframe_codec.h>
+#include <cstring>
+#include <climits>
+#include <opencv2/highgui/highgui.hpp>
+
+typedef rm_localization::Keyframe msg;
+
+// Raw and depth rle data starts with rows, cols and opencv type.
+static const size_t header_size = 3 * sizeof(int32_t);
+
+static void write_header(const cv::Mat & image, std::vector<uint8_t> & data) {
+	int32_t header[3] = { image.rows, image.cols, image.type() };
+	data.resize(header_size);
+	memcpy(&data[0], header, header_size);
+}
+
+static bool read_header(const std::vector<uint8_t> & data, int32_t & rows,
+		int32_t & cols, int32_t & type) {
+
+	if (data.size() < header_size)
+		return false;
+
+	int32_t header[3];
+	memcpy(header, &data[0], header_size);
+	rows = header[0];
+	cols = header[1];
+	type = header[2];
+
+	return rows > 0 && cols > 0 && int64_t(rows) * cols <= INT_MAX;
+}
+
+static inline void write_varint(uint32_t val, std::vector<uint8_t> & data) {
+	while (val >= 0x80) {
+		data.push_back((val & 0x7f) | 0x80);
+		val >>= 7;
+	}
+	data.push_back(val);
+}
+
+static inline bool read_varint(const uint8_t * & ptr, const uint8_t * end,
+		uint32_t & val) {
+
+	val = 0;
+	for (int shift = 0; shift < 35 && ptr != end; shift += 7) {
+		uint8_t b = *ptr++;
+		val |= uint32_t(b & 0x7f) << shift;
+		if (!(b & 0x80))
+			return true;
+	}
+
+	return false;
+}
+
+// Pixel i is in column u.
+static inline uint16_t predict(const uint16_t * depth, int i, int u,
+		int cols) {
+	if (u != 0)
+		return depth[i - 1];
+	else if (i != 0)
+		return depth[i - cols];
+	else
+		return 0;
+}
+
+static void encode_depth_rle(const cv::Mat & depth,
+		std::vector<uint8_t> & data) {
+
+	cv::Mat d = depth.isContinuous() ? depth : depth.clone();
+	const uint16_t * ptr = d.ptr<uint16_t>();
+	int size = d.rows * d.cols;
+
+	write_header(d, data);
+	data.reserve(header_size + size);
+
+	// Tokens with the lowest bit set are runs of exact predictions, the
+	// others hold the zigzag encoded prediction error.
+	uint32_t run = 0;
+	for (int i = 0, u = 0; i < size; i++, u = (u + 1 == d.cols) ? 0 : u + 1) {
+		int error = int(ptr[i]) - predict(ptr, i, u, d.cols);
+
+		if (error == 0) {
+			run++;
+			continue;
+		}
+
+		if (run > 0) {
+			write_varint((run << 1) | 1, data);
+			run = 0;
+		}
+
+		uint32_t zigzag = error > 0 ? 2 * error : -2 * error - 1;
+		write_varint(zigzag << 1, data);
+	}
+
+	if (run > 0) {
+		write_varint((run << 1) | 1, data);
+	}
+}
+
+static cv::Mat decode_depth_rle(const std::vector<uint8_t> & data) {
+
+	int32_t rows, cols, type;
+	if (!read_header(data, rows, cols, type) || type != CV_16UC1)
+		return cv::Mat();
+
+	cv::Mat depth(rows, cols, CV_16UC1);
+	uint16_t * ptr = depth.ptr<uint16_t>();
+	int size = rows * cols;
+
+	const uint8_t * in = &data[0] + header_size;
+	const uint8_t * end = &data[0] + data.size();
+
+	int i = 0, u = 0;
+	while (i < size) {
+		uint32_t token;
+		if (!read_varint(in, end, token))
+			return cv::Mat();
+
+		if (token & 1) {
+			uint32_t run = token >> 1;
+			if (run > uint32_t(size - i))
+				return cv::Mat();
+
+			for (uint32_t j = 0; j < run; j++) {
+				ptr[i] = predict(ptr, i, u, cols);
+				i++;
+				u = (u + 1 == cols) ? 0 : u + 1;
+			}
+
+		} else {
+			uint32_t zigzag = token >> 1;
+			int error = (zigzag & 1) ? -int((zigzag + 1) >> 1) : int(
+					zigzag >> 1);
+			ptr[i] = predict(ptr, i, u, cols) + error;
+			i++;
+			u = (u + 1 == cols) ? 0 : u + 1;
+		}
+	}
+
+	return depth;
+}
+
+static void encode_raw(const cv::Mat & image, std::vector<uint8_t> & data) {
+
+	cv::Mat img = image.isContinuous() ? image : image.clone();
+	size_t size = img.rows * img.cols * img.elemSize();
+
+	write_header(img, data);
+	data.resize(header_size + size);
+	memcpy(&data[header_size], img.data, size);
+}
+
+static cv::Mat decode_raw(const std::vector<uint8_t> & data) {
+
+	int32_t rows, cols, type;
+	if (!read_header(data, rows, cols, type))
+		return cv::Mat();
+
+	size_t size = size_t(rows) * cols * CV_ELEM_SIZE(type);
+	if (data.size() != header_size + size)
+		return cv::Mat();
+
+	cv::Mat image(rows, cols, type);
+	memcpy(image.data, &data[header_size], size);
+	return image;
+}
+
+bool encode_image(const cv::Mat & image, uint8_t codec,
+		std::vector<uint8_t> & data) {
+
+	data.clear();
+
+	switch (codec) {
+	case msg::CODEC_PNG:
+		return cv::imencode(".png", image, data);
+
+	case msg::CODEC_RAW:
+		encode_raw(image, data);
+		return true;
+
+	case msg::CODEC_JPEG: {
+		if (image.depth() != CV_8U)
+			return false;
+
+		std::vector<int> params;
+		params.push_back(CV_IMWRITE_JPEG_QUALITY);
+		params.push_back(95);
+		return cv::imencode(".jpg", image, data, params);
+	}
+
+	case msg::CODEC_DEPTH_RLE:
+		if (image.type() != CV_16UC1)
+			return false;
+
+		encode_depth_rle(image, data);
+		return true;
+
+	default:
+		return false;
+	}
+}
+
+cv::Mat decode_image(const std::vector<uint8_t> & data, uint8_t codec) {
+
+	if (data.empty())
+		return cv::Mat();
+
+	switch (codec) {
+	case msg::CODEC_PNG:
+	case msg::CODEC_JPEG:
+		return cv::imdecode(data, CV_LOAD_IMAGE_UNCHANGED);
+
+	case msg::CODEC_RAW:
+		return decode_raw(data);
+
+	case msg::CODEC_DEPTH_RLE:
+		return decode_depth_rle(data);
+
+	default:
+		return cv::Mat();
+	}
+}
+
+uint8_t get_codec(const std::string & name) {
+	if (name == "raw")
+		return msg::CODEC_RAW;
+	else if (name == "jpeg")
+		return msg::CODEC_JPEG;
+	else if (name == "depth_rle")
+		return msg::CODEC_DEPTH_RLE;
+	else
+		return msg::CODEC_PNG;
+}
@@ -0,0 +1,107 @@
+#include <keyframe_index.h>
+#include <limits>
+#include <algorithm>
+
+keyframe_index::keyframe_index(float cell_size) :
+		cell_size(cell_size) {
+	clear();
+}
+
+void keyframe_index::insert(int idx, const Sophus::SE3f & pos) {
+
+	if (idx >= (int) positions.size())
+		positions.resize(idx + 1);
+
+	positions[idx] = pos;
+
+	Eigen::Vector3i cell = get_cell(pos);
+	cells.insert(idx, cell);
+
+	min_cell = min_cell.array().min(cell.array());
+	max_cell = max_cell.array().max(cell.array());
+}
+
+void keyframe_index::update(int idx, const Sophus::SE3f & pos) {
+	insert(idx, pos);
+}
+
+void keyframe_index::clear() {
+	cells.clear();
+	positions.clear();
+	min_cell.setConstant(std::numeric_limits<int>::max());
+	max_cell.setConstant(std::numeric_limits<int>::min());
+}
+
+void keyframe_index::get_closest(const Sophus::SE3f & pos, int & res,
+		float & dist) const {
+
+	res = -1;
+	dist = std::numeric_limits<float>::max();
+
+	if (cells.size() == 0)
+		return;
+
+	Eigen::Vector3i q = get_cell(pos);
+
+	// Cubes that do not reach the bounding box are empty.
+	int r = 0;
+	for (int i = 0; i < 3; i++) {
+		r = std::max(r, std::max(min_cell[i] - q[i], q[i] - max_cell[i]));
+	}
+
+	for (;; r++) {
+
+		Eigen::Vector3i lo = (q.array() - r).max(min_cell.array());
+		Eigen::Vector3i hi = (q.array() + r).min(max_cell.array());
+
+		// Visit the surface of the cube with radius r.
+		for (int x = lo[0]; x <= hi[0]; x++) {
+			for (int y = lo[1]; y <= hi[1]; y++) {
+				if (std::abs(x - q[0]) == r || std::abs(y - q[1]) == r) {
+					for (int z = lo[2]; z <= hi[2]; z++) {
+						visit(Eigen::Vector3i(x, y, z), pos, res, dist);
+					}
+				} else {
+					if (q[2] - r >= min_cell[2])
+						visit(Eigen::Vector3i(x, y, q[2] - r), pos, res, dist);
+					if (q[2] + r <= max_cell[2])
+						visit(Eigen::Vector3i(x, y, q[2] + r), pos, res, dist);
+				}
+			}
+		}
+
+		bool covered = (q.array() - r <= min_cell.array()).all()
+				&& (q.array() + r >= max_cell.array()).all();
+
+		// Unvisited keyframes are more than r cells away, which is the
+		// translation part of keyframe_distance.
+		if (covered || dist <= r * cell_size / 0.3f)
+			break;
+	}
+
+}
+
+Eigen::Vector3i keyframe_index::get_cell(const Sophus::SE3f & pos) const {
+	Eigen::Vector3f t = pos.translation() / cell_size;
+	return Eigen::Vector3i(std::floor(t[0]), std::floor(t[1]),
+			std::floor(t[2]));
+}
+
+void keyframe_index::visit(const Eigen::Vector3i & cell,
+		const Sophus::SE3f & pos, int & res, float & dist) const {
+
+	const std::vector<int> * c = cells.find(cell);
+	if (!c)
+		return;
+
+	for (size_t i = 0; i < c->size(); i++) {
+		int idx = (*c)[i];
+		float current_dist = keyframe_distance(pos, positions[idx]);
+
+		// Ties go to the lower index, like the linear scan.
+		if (current_dist < dist || (current_dist == dist && idx < res)) {
+			res = idx;
+			dist = current_dist;
+		}
+	}
+}
@@ -0,0 +1,60 @@
+#include <keyframe_publisher.h>
+#include <boost/bind.hpp>
+
+keyframe_publisher::keyframe_publisher(const ros::Publisher & pub,
+		uint8_t rgb_codec, uint8_t depth_codec, size_t capacity) :
+		pub(pub), rgb_codec(rgb_codec), depth_codec(depth_codec) {
+
+	num_published = 0;
+
+	queue.set_capacity(capacity);
+	worker = boost::thread(boost::bind(&keyframe_publisher::run, this));
+}
+
+keyframe_publisher::~keyframe_publisher() {
+	// Empty item stops the worker after everything queued before it.
+	queue.push(item());
+	worker.join();
+}
+
+void keyframe_publisher::publish(const keyframe::Ptr & k,
+		const cv_bridge::CvImageConstPtr & yuv2,
+		const rm_localization::Keyframe::Ptr & msg) {
+
+	item i;
+	i.k = k;
+	i.yuv2 = yuv2;
+	i.msg = msg;
+
+	queue.push(i);
+}
+
+double keyframe_publisher::get_mean_encode_time() const {
+	return encode_latency.get_mean();
+}
+
+double keyframe_publisher::get_max_encode_time() const {
+	return encode_latency.get_max();
+}
+
+void keyframe_publisher::run() {
+
+	while (true) {
+
+		item i;
+		queue.pop(i);
+
+		if (!i.k)
+			break;
+
+		tbb::tick_count start = tbb::tick_count::now();
+		i.k->encode_images(i.yuv2, *i.msg, rgb_codec, depth_codec);
+		encode_latency.add(start);
+
+		pub.publish(i.msg);
+
+		num_published++;
+
+	}
+
+}
@@ -0,0 +1,67 @@
+#include <motion_prior.h>
+
+motion_prior::motion_prior(float measurement_noise) :
+		last_stamp(0), last_measurement_stamp(0), measurement_noise(
+				measurement_noise) {
+}
+
+void motion_prior::reset(const Sophus::SE3f & pose, double stamp) {
+	boost::mutex::scoped_lock lock(mutex);
+	ukf.reset(
+			new SE3UKFf(pose, SE3UKFf::Vector6::Zero(),
+					SE3UKFf::Matrix12::Identity() * 1e-3));
+	last_stamp = stamp;
+	last_measurement_stamp = stamp;
+}
+
+void motion_prior::clear() {
+	boost::mutex::scoped_lock lock(mutex);
+	ukf.reset();
+}
+
+Sophus::SE3f motion_prior::predict(double stamp) {
+	boost::mutex::scoped_lock lock(mutex);
+
+	double dt = stamp - last_stamp;
+	if (dt > 0) {
+		ukf->predict(dt);
+		last_stamp = stamp;
+	}
+
+	return ukf->get_pose();
+}
+
+void motion_prior::measure(const Sophus::SE3f & pose) {
+	boost::mutex::scoped_lock lock(mutex);
+	ukf->measure(pose,
+			SE3UKFf::Matrix6::Identity() * measurement_noise);
+	last_measurement_stamp = last_stamp;
+}
+
+void motion_prior::correct(const Sophus::SE3f & correction) {
+	boost::mutex::scoped_lock lock(mutex);
+	ukf->pose = correction * ukf->pose;
+}
+
+bool motion_prior::extrapolate(double stamp, Sophus::SE3f & pose,
+		double & measurement_stamp) const {
+
+	boost::shared_ptr<SE3UKFf> copy;
+	double dt;
+
+	{
+		boost::mutex::scoped_lock lock(mutex);
+		if (!ukf)
+			return false;
+
+		copy.reset(new SE3UKFf(*ukf));
+		dt = stamp - last_stamp;
+		measurement_stamp = last_measurement_stamp;
+	}
+
+	if (dt > 0)
+		copy->predict(dt);
+
+	pose = copy->get_pose();
+	return true;
+}
@@ -0,0 +1,13 @@
+#include <capture_server.h>
+
+int main(int argc, char** argv) {
+	ros::init(argc, argv, "localization");
+	ros::NodeHandle nh;
+	ros::NodeHandle nh_private("~");
+
+	CaptureServer cs(nh, nh_private);
+
+	ros::spin();
+
+	return 0;
+}
@@ -0,0 +1,22 @@
+#include <capture_server.h>
+#include <nodelet/nodelet.h>
+#include <pluginlib/class_list_macros.h>
+
+// Runs in the same manager as the camera nodelet, images then arrive as
+// shared pointers to the published messages without serialization.
+class LocalizationNodelet: public nodelet::Nodelet {
+public:
+	virtual void onInit() {
+		nh = getNodeHandle();
+		nh_private = getPrivateNodeHandle();
+		cs.reset(new CaptureServer(nh, nh_private));
+	}
+
+private:
+	ros::NodeHandle nh, nh_private;
+	boost::shared_ptr<CaptureServer> cs;
+
+};
+
+PLUGINLIB_DECLARE_CLASS(rm_localization, LocalizationNodelet,
+		LocalizationNodelet, nodelet::Nodelet)
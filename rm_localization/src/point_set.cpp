@@ -0,0 +1,115 @@
+#include <point_set.h>
+#include <algorithm>
+#include <cstdlib>
+#include <vector>
+
+point_set::point_set() :
+		size(0), num_candidates(0), x(NULL), y(NULL), z(NULL), intencity(NULL), intencity_dx(
+				NULL), intencity_dy(NULL), idx(NULL) {
+}
+
+void point_set::build(const cloud_map & cloud, const uint8_t * intencity,
+		const int16_t * intencity_dx, const int16_t * intencity_dy,
+		int max_points) {
+
+	release();
+
+	int n = cloud.cols();
+
+	num_candidates = 0;
+	for (int i = 0; i < n; i++) {
+		if (cloud(3, i) > 0)
+			num_candidates++;
+	}
+
+	// Points with gradient magnitude below the threshold are dropped. Ties
+	// at the threshold are resolved in pixel order.
+	int threshold = 0;
+	int num_at_threshold = num_candidates;
+
+	if (max_points > 0 && max_points < num_candidates) {
+
+		std::vector<int> magnitude;
+		magnitude.reserve(num_candidates);
+		for (int i = 0; i < n; i++) {
+			if (cloud(3, i) > 0)
+				magnitude.push_back(
+						std::abs(intencity_dx[i]) + std::abs(intencity_dy[i]));
+		}
+
+		std::nth_element(magnitude.begin(),
+				magnitude.begin() + (num_candidates - max_points),
+				magnitude.end());
+		threshold = magnitude[num_candidates - max_points];
+
+		int num_above = 0;
+		for (int i = 0; i < num_candidates; i++) {
+			if (magnitude[i] > threshold)
+				num_above++;
+		}
+		num_at_threshold = max_points - num_above;
+
+		size = max_points;
+	} else {
+		size = num_candidates;
+	}
+
+	pyramid_arena & arena = pyramid_arena::get();
+	this->x = arena.acquire<float>(size);
+	this->y = arena.acquire<float>(size);
+	this->z = arena.acquire<float>(size);
+	this->intencity = arena.acquire<uint8_t>(size);
+	this->intencity_dx = arena.acquire<int16_t>(size);
+	this->intencity_dy = arena.acquire<int16_t>(size);
+	this->idx = arena.acquire<int32_t>(size);
+
+	int j = 0;
+	for (int i = 0; i < n && j < size; i++) {
+
+		if (cloud(3, i) <= 0)
+			continue;
+
+		int m = std::abs(intencity_dx[i]) + std::abs(intencity_dy[i]);
+		if (m < threshold)
+			continue;
+		if (m == threshold) {
+			if (num_at_threshold == 0)
+				continue;
+			num_at_threshold--;
+		}
+
+		this->x[j] = cloud(0, i);
+		this->y[j] = cloud(1, i);
+		this->z[j] = cloud(2, i);
+		this->intencity[j] = intencity[i];
+		this->intencity_dx[j] = intencity_dx[i];
+		this->intencity_dy[j] = intencity_dy[i];
+		this->idx[j] = i;
+		j++;
+
+	}
+
+}
+
+void point_set::release() {
+
+	if (x == NULL)
+		return;
+
+	pyramid_arena & arena = pyramid_arena::get();
+	arena.release<float>(x, size);
+	arena.release<float>(y, size);
+	arena.release<float>(z, size);
+	arena.release<uint8_t>(intencity, size);
+	arena.release<int16_t>(intencity_dx, size);
+	arena.release<int16_t>(intencity_dy, size);
+	arena.release<int32_t>(idx, size);
+
+	x = y = z = NULL;
+	intencity = NULL;
+	intencity_dx = intencity_dy = NULL;
+	idx = NULL;
+	size = 0;
+	num_candidates = 0;
+
+}
@@ -0,0 +1,81 @@
+#include <pyramid_arena.h>
+#include <cstdlib>
+#include <new>
+
+pyramid_arena & pyramid_arena::get() {
+	static pyramid_arena arena;
+	return arena;
+}
+
+pyramid_arena::pyramid_arena() {
+	num_heap_allocations = 0;
+	num_acquired = 0;
+	num_in_use = 0;
+	cached_bytes = 0;
+}
+
+pyramid_arena::~pyramid_arena() {
+	trim();
+}
+
+size_t pyramid_arena::block_size(size_t size) {
+	return ((size + alignment - 1) / alignment + 1) * alignment;
+}
+
+void * pyramid_arena::acquire(size_t size) {
+
+	size_t bs = block_size(size);
+	void * ptr = NULL;
+
+	{
+		boost::mutex::scoped_lock lock(free_blocks_mutex);
+		std::vector<void *> & blocks = free_blocks[bs];
+		if (!blocks.empty()) {
+			ptr = blocks.back();
+			blocks.pop_back();
+			cached_bytes -= bs;
+		}
+	}
+
+	if (ptr == NULL) {
+		if (posix_memalign(&ptr, alignment, bs) != 0) {
+			throw std::bad_alloc();
+		}
+		num_heap_allocations++;
+	}
+
+	num_acquired++;
+	num_in_use++;
+
+	return ptr;
+}
+
+void pyramid_arena::release(void * ptr, size_t size) {
+
+	if (ptr == NULL)
+		return;
+
+	size_t bs = block_size(size);
+
+	boost::mutex::scoped_lock lock(free_blocks_mutex);
+	free_blocks[bs].push_back(ptr);
+	cached_bytes += bs;
+	num_in_use--;
+
+}
+
+void pyramid_arena::trim() {
+
+	boost::mutex::scoped_lock lock(free_blocks_mutex);
+
+	for (std::map<size_t, std::vector<void *> >::iterator it =
+			free_blocks.begin(); it != free_blocks.end(); it++) {
+		for (size_t i = 0; i < it->second.size(); i++) {
+			free(it->second[i]);
+		}
+	}
+
+	free_blocks.clear();
+	cached_bytes = 0;
+
+}
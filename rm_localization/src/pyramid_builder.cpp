@@ -0,0 +1,196 @@
+#include <pyramid_builder.h>
+#include <algorithm>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Second largest of four values without branches.
+static inline uint16_t median4(uint16_t a, uint16_t b, uint16_t c,
+		uint16_t d) {
+	uint16_t lo1 = std::min(a, b), hi1 = std::max(a, b);
+	uint16_t lo2 = std::min(c, d), hi2 = std::max(c, d);
+	return std::max(std::min(hi1, hi2), std::max(lo1, lo2));
+}
+
+// Integer division by 2 rounding towards zero, like the int16_t division it
+// replaces.
+static inline int16_t half(int x) {
+	return (x + (x < 0)) >> 1;
+}
+
+static void subsample_row(const uint8_t * prev_intencity,
+		const uint16_t * prev_depth, int prev_cols, int cols,
+		uint8_t * intencity, uint16_t * depth) {
+
+	const uint8_t * i0 = prev_intencity;
+	const uint8_t * i1 = prev_intencity + prev_cols;
+	const uint16_t * d0 = prev_depth;
+	const uint16_t * d1 = prev_depth + prev_cols;
+
+	int u = 0;
+
+#ifdef __SSE2__
+	const __m128i low_bytes = _mm_set1_epi16(0x00ff);
+	const __m128i sign = _mm_set1_epi16(0x8000);
+
+	for (; u + 8 <= cols; u += 8) {
+
+		// 16 source pixels of each row give 8 intencity values.
+		__m128i a = _mm_loadu_si128((const __m128i *) (i0 + 2 * u));
+		__m128i b = _mm_loadu_si128((const __m128i *) (i1 + 2 * u));
+
+		__m128i sum = _mm_add_epi16(_mm_and_si128(a, low_bytes),
+				_mm_srli_epi16(a, 8));
+		sum = _mm_add_epi16(sum, _mm_and_si128(b, low_bytes));
+		sum = _mm_add_epi16(sum, _mm_srli_epi16(b, 8));
+		sum = _mm_srli_epi16(sum, 2);
+
+		_mm_storel_epi64((__m128i *) (intencity + u),
+				_mm_packus_epi16(sum, sum));
+
+		// Depth is biased to signed so that the signed 16 bit min/max of
+		// SSE2 can be used. Even and odd columns are split by sign extending
+		// 32 bit lanes and packed back with signed saturation, which is
+		// exact for biased values.
+		__m128i e[2], o[2];
+		for (int k = 0; k < 2; k++) {
+			const uint16_t * row = k == 0 ? d0 : d1;
+			__m128i lo = _mm_xor_si128(
+					_mm_loadu_si128((const __m128i *) (row + 2 * u)), sign);
+			__m128i hi = _mm_xor_si128(
+					_mm_loadu_si128((const __m128i *) (row + 2 * u + 8)),
+					sign);
+
+			e[k] = _mm_packs_epi32(_mm_srai_epi32(_mm_slli_epi32(lo, 16), 16),
+					_mm_srai_epi32(_mm_slli_epi32(hi, 16), 16));
+			o[k] = _mm_packs_epi32(_mm_srai_epi32(lo, 16),
+					_mm_srai_epi32(hi, 16));
+		}
+
+		__m128i lo1 = _mm_min_epi16(e[0], o[0]);
+		__m128i hi1 = _mm_max_epi16(e[0], o[0]);
+		__m128i lo2 = _mm_min_epi16(e[1], o[1]);
+		__m128i hi2 = _mm_max_epi16(e[1], o[1]);
+		__m128i m = _mm_max_epi16(_mm_min_epi16(hi1, hi2),
+				_mm_max_epi16(lo1, lo2));
+
+		_mm_storeu_si128((__m128i *) (depth + u), _mm_xor_si128(m, sign));
+	}
+#endif
+
+	for (; u < cols; u++) {
+		int p = 2 * u;
+		intencity[u] = (i0[p] + i0[p + 1] + i1[p] + i1[p + 1]) / 4;
+		depth[u] = median4(d0[p], d1[p], d0[p + 1], d1[p + 1]);
+	}
+
+}
+
+void subsample_pyramid::operator()(
+		const tbb::blocked_range<int>& range) const {
+
+	int num_bands = get_num_bands();
+
+	for (int level = 1; level < num_levels; level++) {
+
+		int prev_cols = cols >> (level - 1);
+		int c = cols >> level;
+
+		int begin, end;
+		get_band_rows(range.begin(), range.end(), num_bands, rows >> level,
+				num_levels - 1 - level, begin, end);
+
+		for (int v = begin; v < end; v++) {
+			subsample_row(intencity[level - 1] + 2 * v * prev_cols,
+					depth[level - 1] + 2 * v * prev_cols, prev_cols, c,
+					intencity[level] + v * c, depth[level] + v * c);
+		}
+	}
+
+}
+
+// dy of a row from the rows above and below. At the image border one of
+// them is the row itself and the difference is one sided.
+static void gradient_dy_row(const uint8_t * above, const uint8_t * below,
+		bool central, int cols, int16_t * dy) {
+
+	int u = 0;
+
+#ifdef __SSE2__
+	const __m128i zero = _mm_setzero_si128();
+
+	for (; u + 8 <= cols; u += 8) {
+		__m128i a = _mm_unpacklo_epi8(
+				_mm_loadl_epi64((const __m128i *) (above + u)), zero);
+		__m128i b = _mm_unpacklo_epi8(
+				_mm_loadl_epi64((const __m128i *) (below + u)), zero);
+		__m128i d = _mm_sub_epi16(b, a);
+		if (central) {
+			d = _mm_srai_epi16(_mm_add_epi16(d, _mm_srli_epi16(d, 15)), 1);
+		}
+		_mm_storeu_si128((__m128i *) (dy + u), d);
+	}
+#endif
+
+	for (; u < cols; u++) {
+		int d = (int) below[u] - above[u];
+		dy[u] = central ? half(d) : d;
+	}
+
+}
+
+static void gradient_dx_row(const uint8_t * row, int cols, int16_t * dx) {
+
+	dx[0] = (int) row[1] - row[0];
+
+	int u = 1;
+
+#ifdef __SSE2__
+	const __m128i zero = _mm_setzero_si128();
+
+	for (; u + 9 <= cols; u += 8) {
+		__m128i a = _mm_unpacklo_epi8(
+				_mm_loadl_epi64((const __m128i *) (row + u - 1)), zero);
+		__m128i b = _mm_unpacklo_epi8(
+				_mm_loadl_epi64((const __m128i *) (row + u + 1)), zero);
+		__m128i d = _mm_sub_epi16(b, a);
+		d = _mm_srai_epi16(_mm_add_epi16(d, _mm_srli_epi16(d, 15)), 1);
+		_mm_storeu_si128((__m128i *) (dx + u), d);
+	}
+#endif
+
+	for (; u < cols - 1; u++) {
+		dx[u] = half((int) row[u + 1] - row[u - 1]);
+	}
+
+	dx[cols - 1] = (int) row[cols - 1] - row[cols - 2];
+
+}
+
+void compute_gradients::operator()(
+		const tbb::blocked_range<int>& range) const {
+
+	int num_bands = get_num_bands();
+
+	for (int level = 0; level < num_levels; level++) {
+
+		int c = cols >> level;
+		int r = rows >> level;
+		const uint8_t * img = intencity[level];
+
+		int begin, end;
+		get_band_rows(range.begin(), range.end(), num_bands, r,
+				num_levels - 1 - level, begin, end);
+
+		for (int v = begin; v < end; v++) {
+			gradient_dx_row(img + v * c, c, intencity_dx[level] + v * c);
+
+			const uint8_t * above = img + (v > 0 ? v - 1 : v) * c;
+			const uint8_t * below = img + (v < r - 1 ? v + 1 : v) * c;
+			gradient_dy_row(above, below, v > 0 && v < r - 1, c,
+					intencity_dy[level] + v * c);
+		}
+	}
+
+}
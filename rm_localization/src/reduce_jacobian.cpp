@@ -4,7 +4,7 @@ reduce_jacobian::reduce_jacobian(const uint8_t * intencity,
 		const int16_t * intencity_dx, const int16_t * intencity_dy,
 		const float * intencity_warped, const float * depth_warped,
 		const Eigen::Vector3f & intrinsics,
-		const Eigen::Matrix<float, 4, Eigen::Dynamic, Eigen::ColMajor> & cloud,
+		const cloud_map & cloud,
 		int cols, int rows) :
 		intencity(intencity), intencity_dx(intencity_dx), intencity_dy(
 				intencity_dy), intencity_warped(intencity_warped), depth_warped(
@@ -0,0 +1,70 @@
+#include <reduce_warp_jacobian.h>
+#include <algorithm>
+
+reduce_warp_jacobian::reduce_warp_jacobian(const parallel_warp & warp,
+		const point_set & points, const Eigen::Vector3f & intrinsics) :
+		warp(warp), points(points), intrinsics(intrinsics) {
+
+	JtJ.setZero();
+	Jte.setZero();
+	num_points = 0;
+	error_sum = 0;
+
+}
+
+reduce_warp_jacobian::reduce_warp_jacobian(reduce_warp_jacobian & rb,
+		tbb::split) :
+		warp(rb.warp), points(rb.points), intrinsics(rb.intrinsics) {
+	JtJ.setZero();
+	Jte.setZero();
+	num_points = 0;
+	error_sum = 0;
+}
+
+void reduce_warp_jacobian::operator()(const tbb::blocked_range<int>& range) {
+
+	float intencity_warped[tile_size];
+	float depth_warped[tile_size];
+
+	for (int begin = range.begin(); begin < range.end(); begin += tile_size) {
+
+		int end = std::min(begin + tile_size, range.end());
+		warp.warp_range(begin, end, intencity_warped, depth_warped);
+
+		for (int i = begin; i != end; i++) {
+
+			if (depth_warped[i - begin] != 0) {
+
+				Eigen::Vector4f p(points.x[i], points.y[i], points.z[i], 1.0f);
+
+				float error = (float) points.intencity[i]
+						- intencity_warped[i - begin];
+
+				Eigen::Matrix<float, 1, 2> Ji;
+				Eigen::Matrix<float, 2, 6> Jw;
+				Eigen::Matrix<float, 1, 6> J;
+				Ji[0] = points.intencity_dx[i] * intrinsics[0];
+				Ji[1] = points.intencity_dy[i] * intrinsics[0];
+
+				reduce_jacobian::compute_jacobian(p, Jw);
+
+				J = Ji * Jw;
+
+				JtJ += J.transpose() * J;
+				Jte += J.transpose() * error;
+
+				num_points++;
+				error_sum += error * error;
+
+			}
+		}
+	}
+
+}
+
+void reduce_warp_jacobian::join(reduce_warp_jacobian& rb) {
+	JtJ += rb.JtJ;
+	Jte += rb.Jte;
+	num_points += rb.num_points;
+	error_sum += rb.error_sum;
+}
@@ -0,0 +1,82 @@
+#include <reduce_warp_residual.h>
+#include <algorithm>
+
+parallel_jacobian::parallel_jacobian(const point_set & points,
+		const Eigen::Vector3f & intrinsics, jacobian_map & jacobians) :
+		points(points), intrinsics(intrinsics), jacobians(jacobians) {
+}
+
+void parallel_jacobian::operator()(
+		const tbb::blocked_range<int>& range) const {
+	for (int i = range.begin(); i != range.end(); i++) {
+
+		Eigen::Vector4f p(points.x[i], points.y[i], points.z[i], 1.0f);
+
+		Eigen::Matrix<float, 1, 2> Ji;
+		Eigen::Matrix<float, 2, 6> Jw;
+		Ji[0] = points.intencity_dx[i] * intrinsics[0];
+		Ji[1] = points.intencity_dy[i] * intrinsics[0];
+
+		reduce_jacobian::compute_jacobian(p, Jw);
+
+		jacobians.col(i) = (Ji * Jw).transpose();
+
+	}
+
+}
+
+reduce_warp_residual::reduce_warp_residual(const parallel_warp & warp,
+		const point_set & points, const jacobian_map & jacobians) :
+		warp(warp), points(points), jacobians(jacobians) {
+
+	JtJ.setZero();
+	Jte.setZero();
+	num_points = 0;
+	error_sum = 0;
+
+}
+
+reduce_warp_residual::reduce_warp_residual(reduce_warp_residual & rb,
+		tbb::split) :
+		warp(rb.warp), points(rb.points), jacobians(rb.jacobians) {
+	JtJ.setZero();
+	Jte.setZero();
+	num_points = 0;
+	error_sum = 0;
+}
+
+void reduce_warp_residual::operator()(const tbb::blocked_range<int>& range) {
+
+	float intencity_warped[tile_size];
+	float depth_warped[tile_size];
+
+	for (int begin = range.begin(); begin < range.end(); begin += tile_size) {
+
+		int end = std::min(begin + tile_size, range.end());
+		warp.warp_range(begin, end, intencity_warped, depth_warped);
+
+		for (int i = begin; i != end; i++) {
+
+			if (depth_warped[i - begin] != 0) {
+
+				float error = (float) points.intencity[i]
+						- intencity_warped[i - begin];
+
+				JtJ += jacobians.col(i) * jacobians.col(i).transpose();
+				Jte += jacobians.col(i) * error;
+
+				num_points++;
+				error_sum += error * error;
+
+			}
+		}
+	}
+
+}
+
+void reduce_warp_residual::join(reduce_warp_residual& rb) {
+	JtJ += rb.JtJ;
+	Jte += rb.Jte;
+	num_points += rb.num_points;
+	error_sum += rb.error_sum;
+}
@@ -0,0 +1,199 @@
+#include <telemetry.h>
+#include <keyframe.h>
+#include <diagnostic_msgs/KeyValue.h>
+#include <boost/lexical_cast.hpp>
+#include <algorithm>
+#include <cstdio>
+
+static void add_value(diagnostic_msgs::DiagnosticStatus & status,
+		const std::string & key, double value) {
+	diagnostic_msgs::KeyValue kv;
+	kv.key = key;
+	kv.value = boost::lexical_cast<std::string>(value);
+	status.values.push_back(kv);
+}
+
+// Index of the bucket holding fraction p of counts.
+static int find_percentile(const tbb::atomic<size_t> * buckets,
+		int num_buckets, size_t count, double p) {
+	size_t target = std::max<size_t>(1, p * count + 0.5);
+	size_t sum = 0;
+	for (int i = 0; i < num_buckets; i++) {
+		sum += buckets[i];
+		if (sum >= target)
+			return i;
+	}
+	return num_buckets - 1;
+}
+
+latency_histogram::latency_histogram() {
+	for (int i = 0; i < num_buckets; i++)
+		buckets[i] = 0;
+	count = 0;
+	total_us = 0;
+	max_us = 0;
+}
+
+void latency_histogram::add(size_t us) {
+
+	int bucket = 0;
+	while (bucket < num_buckets - 1 && (size_t(1) << bucket) <= us)
+		bucket++;
+
+	buckets[bucket]++;
+	total_us += us;
+	count++;
+
+	size_t max = max_us;
+	while (us > max) {
+		size_t prev = max_us.compare_and_swap(us, max);
+		if (prev == max)
+			break;
+		max = prev;
+	}
+}
+
+double latency_histogram::get_mean() const {
+	size_t n = count;
+	return n > 0 ? total_us / (1000.0 * n) : 0.0;
+}
+
+double latency_histogram::get_max() const {
+	return max_us / 1000.0;
+}
+
+double latency_histogram::get_percentile(double p) const {
+	size_t n = count;
+	if (n == 0)
+		return 0.0;
+
+	int bucket = find_percentile(buckets, num_buckets, n, p);
+	return std::min<size_t>(size_t(1) << bucket, max_us) / 1000.0;
+}
+
+void latency_histogram::print(std::ostream & out,
+		const std::string & name) const {
+	char line[128];
+	snprintf(line, sizeof(line),
+			"%-10s %8zu %9.3f %9.3f %9.3f %9.3f ms", name.c_str(),
+			get_count(), get_mean(), get_percentile(0.5),
+			get_percentile(0.99), get_max());
+	out << line << std::endl;
+}
+
+void latency_histogram::to_msg(diagnostic_msgs::DiagnosticStatus & status,
+		const std::string & name) const {
+	add_value(status, name + " count", get_count());
+	add_value(status, name + " mean ms", get_mean());
+	add_value(status, name + " p50 ms", get_percentile(0.5));
+	add_value(status, name + " p99 ms", get_percentile(0.99));
+	add_value(status, name + " max ms", get_max());
+}
+
+value_histogram::value_histogram(double max_value) :
+		max_value(max_value) {
+	for (int i = 0; i < num_buckets; i++)
+		buckets[i] = 0;
+	count = 0;
+	total = 0;
+}
+
+void value_histogram::add(double value) {
+	value = std::max(value, 0.0);
+
+	int bucket = std::min<int>(value / max_value * num_buckets,
+			num_buckets - 1);
+
+	buckets[bucket]++;
+	total += size_t(value * 1e6);
+	count++;
+}
+
+double value_histogram::get_mean() const {
+	size_t n = count;
+	return n > 0 ? total / (1e6 * n) : 0.0;
+}
+
+double value_histogram::get_percentile(double p) const {
+	size_t n = count;
+	if (n == 0)
+		return 0.0;
+
+	int bucket = find_percentile(buckets, num_buckets, n, p);
+	return (bucket + 1) * max_value / num_buckets;
+}
+
+void value_histogram::print(std::ostream & out,
+		const std::string & name) const {
+	char line[128];
+	snprintf(line, sizeof(line), "%-10s %8zu %9.3f %9.3f %9.3f",
+			name.c_str(), get_count(), get_mean(), get_percentile(0.5),
+			get_percentile(0.99));
+	out << line << std::endl;
+}
+
+void value_histogram::to_msg(diagnostic_msgs::DiagnosticStatus & status,
+		const std::string & name) const {
+	add_value(status, name + " mean", get_mean());
+	add_value(status, name + " p50", get_percentile(0.5));
+	add_value(status, name + " p99", get_percentile(0.99));
+}
+
+static const char * stage_names[NUM_TELEMETRY_STAGES] = { "bridge",
+		"pyramid", "search", "track", "keyframe", "publish", "total" };
+
+telemetry::telemetry() :
+		enabled(false), iterations(32), valid_ratio(1), residual(64) {
+}
+
+void telemetry::add(const tracking_stats & stats) {
+
+	if (!enabled)
+		return;
+
+	for (int level = 0; level < std::min(stats.num_levels, max_levels);
+			level++) {
+		levels[level].add(stats.level_us[level]);
+	}
+
+	iterations.add(stats.iterations);
+	valid_ratio.add(stats.valid_ratio);
+	residual.add(stats.residual);
+}
+
+void telemetry::print(std::ostream & out) const {
+
+	char header[128];
+	snprintf(header, sizeof(header), "%-10s %8s %9s %9s %9s %9s", "stage",
+			"count", "mean", "p50", "p99", "max");
+	out << header << std::endl;
+
+	for (int i = 0; i < NUM_TELEMETRY_STAGES; i++)
+		stages[i].print(out, stage_names[i]);
+
+	for (int level = 0; level < max_levels; level++) {
+		if (levels[level].get_count() > 0)
+			levels[level].print(out,
+					"level " + boost::lexical_cast<std::string>(level));
+	}
+
+	iterations.print(out, "iterations");
+	valid_ratio.print(out, "valid");
+	residual.print(out, "residual");
+}
+
+void telemetry::to_msg(diagnostic_msgs::DiagnosticStatus & status) const {
+
+	for (int i = 0; i < NUM_TELEMETRY_STAGES; i++)
+		stages[i].to_msg(status, stage_names[i]);
+
+	for (int level = 0; level < max_levels; level++) {
+		if (levels[level].get_count() > 0)
+			levels[level].to_msg(status,
+					"track level " + boost::lexical_cast<std::string>(level));
+	}
+
+	iterations.to_msg(status, "iterations");
+	valid_ratio.to_msg(status, "valid ratio");
+	residual.to_msg(status, "residual");
+}
@@ -0,0 +1,158 @@
+#include <trajectory_recorder.h>
+#include <boost/bind.hpp>
+#include <fstream>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+static const char trajectory_magic[8] = "RMTRAJ";
+
+// Records never straddle chunks and chunks are page aligned.
+typedef char header_size_check[
+		sizeof(trajectory_header) == sizeof(trajectory_record) ? 1 : -1];
+typedef char record_size_check[sizeof(trajectory_record) == 96 ? 1 : -1];
+typedef char stages_check[
+		NUM_TELEMETRY_STAGES <= trajectory_record::max_stages ? 1 : -1];
+
+static const size_t chunk_bytes = trajectory_recorder::chunk_records
+		* sizeof(trajectory_record);
+
+trajectory_recorder::trajectory_recorder(const std::string & filename,
+		size_t queue_size) :
+		queue(queue_size), header(NULL), first_chunk(NULL), current_chunk(
+				NULL), current_chunk_idx(0) {
+
+	num_written = 0;
+	num_dropped = 0;
+
+	fd = open(filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0)
+		return;
+
+	if (!map_chunk(0)) {
+		close(fd);
+		fd = -1;
+		return;
+	}
+
+	header = (trajectory_header *) first_chunk;
+	memcpy(header->magic, trajectory_magic, sizeof(header->magic));
+	header->version = version;
+	header->record_size = sizeof(trajectory_record);
+	header->num_records = 0;
+	header->num_dropped = 0;
+
+	worker = boost::thread(boost::bind(&trajectory_recorder::run, this));
+}
+
+trajectory_recorder::~trajectory_recorder() {
+
+	if (!is_open())
+		return;
+
+	worker.interrupt();
+	worker.join();
+
+	// Worker is gone, this thread is the consumer now.
+	write_queued();
+
+	unmap_chunk();
+	munmap(first_chunk, chunk_bytes);
+
+	// On failure the file keeps the zeroed tail of the last chunk, readers
+	// go by the number of records in the header.
+	int res = ftruncate(fd, (num_written + 1) * sizeof(trajectory_record));
+	(void) res;
+	close(fd);
+}
+
+void trajectory_recorder::run() {
+
+	try {
+		while (true) {
+			write_queued();
+			boost::this_thread::sleep(boost::posix_time::milliseconds(10));
+		}
+	} catch (boost::thread_interrupted &) {
+	}
+
+}
+
+bool trajectory_recorder::write_queued() {
+
+	trajectory_record r;
+	bool ok = true;
+
+	while (queue.pop(r)) {
+
+		// Slot 0 holds the header.
+		size_t slot = num_written + 1;
+		size_t chunk = slot / chunk_records;
+
+		if (chunk != current_chunk_idx && !map_chunk(chunk)) {
+			num_dropped++;
+			ok = false;
+			continue;
+		}
+
+		memcpy(current_chunk + (slot % chunk_records) * sizeof(r), &r,
+				sizeof(r));
+		num_written++;
+	}
+
+	header->num_records = num_written;
+	header->num_dropped = num_dropped;
+
+	return ok;
+}
+
+bool trajectory_recorder::map_chunk(size_t chunk) {
+
+	if (ftruncate(fd, (chunk + 1) * chunk_bytes) != 0)
+		return false;
+
+	void * data = mmap(NULL, chunk_bytes, PROT_READ | PROT_WRITE, MAP_SHARED,
+			fd, chunk * chunk_bytes);
+	if (data == MAP_FAILED)
+		return false;
+
+	unmap_chunk();
+
+	current_chunk = (uint8_t *) data;
+	current_chunk_idx = chunk;
+	if (chunk == 0)
+		first_chunk = current_chunk;
+
+	return true;
+}
+
+void trajectory_recorder::unmap_chunk() {
+	if (current_chunk && current_chunk != first_chunk)
+		munmap(current_chunk, chunk_bytes);
+	current_chunk = NULL;
+}
+
+bool read_trajectory(const std::string & filename,
+		std::vector<trajectory_record> & records) {
+
+	std::ifstream f(filename.c_str(), std::ios::binary);
+
+	trajectory_header h;
+	if (!f.read((char *) &h, sizeof(h)))
+		return false;
+
+	if (memcmp(h.magic, trajectory_magic, sizeof(h.magic)) != 0
+			|| h.record_size != sizeof(trajectory_record))
+		return false;
+
+	records.resize(h.num_records);
+	if (h.num_records > 0
+			&& !f.read((char *) &records[0],
+					h.num_records * sizeof(trajectory_record))) {
+		records.clear();
+		return false;
+	}
+
+	return true;
+}
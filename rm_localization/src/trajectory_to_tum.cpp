@@ -0,0 +1,80 @@
+/*
+ * trajectory_to_tum.cpp
+ *
+ * Converts a trajectory recorded by the localization node to the TUM RGB-D
+ * benchmark text format, one "timestamp tx ty tz qx qy qz qw" line per
+ * frame. With --stats the closest keyframe, iterations, residual, valid
+ * ratio and stage times in microseconds are appended to every line.
+ *
+ * Usage:
+ *   trajectory_to_tum [--stats] trajectory.bin [trajectory.txt]
+ */
+
+#include <trajectory_recorder.h>
+#include <iostream>
+#include <cstdio>
+
+int main(int argc, char **argv) {
+
+	bool stats = false;
+	std::string input, output;
+
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--stats") {
+			stats = true;
+		} else if (input.empty()) {
+			input = arg;
+		} else if (output.empty()) {
+			output = arg;
+		} else {
+			input.clear();
+			break;
+		}
+	}
+
+	if (input.empty()) {
+		std::cerr << "Usage: " << argv[0]
+				<< " [--stats] trajectory.bin [trajectory.txt]" << std::endl;
+		return 1;
+	}
+
+	std::vector<trajectory_record> records;
+	if (!read_trajectory(input, records)) {
+		std::cerr << "Could not read trajectory " << input << std::endl;
+		return 1;
+	}
+
+	FILE * out = output.empty() ? stdout : fopen(output.c_str(), "w");
+	if (!out) {
+		std::cerr << "Could not open " << output << std::endl;
+		return 1;
+	}
+
+	fprintf(out, "# timestamp tx ty tz qx qy qz qw%s\n",
+			stats ? " keyframe iterations residual valid stage_us..." : "");
+
+	for (size_t i = 0; i < records.size(); i++) {
+		const trajectory_record & r = records[i];
+
+		fprintf(out, "%.6f %f %f %f %f %f %f %f", r.stamp, r.translation[0],
+				r.translation[1], r.translation[2], r.rotation[0],
+				r.rotation[1], r.rotation[2], r.rotation[3]);
+
+		if (stats) {
+			fprintf(out, " %d %d %f %f", r.keyframe_idx, r.iterations,
+					r.residual, r.valid_ratio);
+			for (int j = 0; j < NUM_TELEMETRY_STAGES; j++)
+				fprintf(out, " %u", r.stage_us[j]);
+		}
+
+		fprintf(out, "\n");
+	}
+
+	if (out != stdout)
+		fclose(out);
+
+	std::cerr << "Converted " << records.size() << " poses" << std::endl;
+
+	return 0;
+}
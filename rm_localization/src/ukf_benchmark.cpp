@@ -0,0 +1,102 @@
+/*
+ * ukf_benchmark.cpp
+ *
+ * Times SE3UKF predict and measure for float and double on a simulated
+ * constant velocity camera with noisy pose measurements, as done by
+ * motion_prior. Reports mean, 99th percentile and worst case latency.
+ *
+ * Usage:
+ *   ukf_benchmark [--iterations n] [--rate hz]
+ */
+
+#include <se3ukf.hpp>
+#include <tbb/tick_count.h>
+#include <iostream>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <algorithm>
+
+static void print_latency(const char * name, const char * type,
+		std::vector<double> & us) {
+	std::sort(us.begin(), us.end());
+	double sum = 0;
+	for (size_t i = 0; i < us.size(); i++)
+		sum += us[i];
+	printf("%-8s %-7s %10.2f %10.2f %10.2f\n", name, type, sum / us.size(),
+			us[us.size() * 99 / 100], us.back());
+}
+
+template<typename Scalar>
+static void run(const char * type, int iterations, Scalar dt) {
+
+	typedef SE3UKF<Scalar> UKF;
+
+	srand(1);
+
+	typename UKF::Vector6 true_velocity;
+	true_velocity << 0.3, -0.1, 0.05, 0.02, 0.2, -0.05;
+
+	typename UKF::SE3Type true_pose;
+	UKF ukf(true_pose, UKF::Vector6::Zero(),
+			UKF::Matrix12::Identity() * Scalar(1e-3));
+	typename UKF::Matrix6 measurement_noise = UKF::Matrix6::Identity()
+			* Scalar(1e-4);
+
+	std::vector<double> predict_us(iterations), measure_us(iterations);
+	int mean_iterations = 0;
+
+	for (int i = 0; i < iterations; i++) {
+		true_pose *= UKF::SE3Type::exp(true_velocity * dt);
+
+		typename UKF::Vector6 noise;
+		for (int j = 0; j < 6; j++)
+			noise[j] = Scalar(1e-3) * (rand() / (Scalar) RAND_MAX - 0.5);
+
+		tbb::tick_count start = tbb::tick_count::now();
+		ukf.predict(dt);
+		predict_us[i] = (tbb::tick_count::now() - start).seconds() * 1e6;
+		mean_iterations = std::max(mean_iterations, ukf.mean_iterations);
+
+		start = tbb::tick_count::now();
+		ukf.measure(true_pose * UKF::SE3Type::exp(noise), measurement_noise);
+		measure_us[i] = (tbb::tick_count::now() - start).seconds() * 1e6;
+		mean_iterations = std::max(mean_iterations, ukf.mean_iterations);
+	}
+
+	print_latency("predict", type, predict_us);
+	print_latency("measure", type, measure_us);
+
+	ukf.print_diagnostics();
+	std::cout << "Velocity error "
+			<< (ukf.get_velocity() - true_velocity).transpose()
+			<< ", at most " << mean_iterations << " mean iterations"
+			<< std::endl;
+}
+
+int main(int argc, char **argv) {
+
+	int iterations = 10000;
+	double rate = 30;
+
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--iterations" && i + 1 < argc) {
+			iterations = atoi(argv[++i]);
+		} else if (arg == "--rate" && i + 1 < argc) {
+			rate = atof(argv[++i]);
+		} else {
+			std::cerr << "Usage: " << argv[0]
+					<< " [--iterations n] [--rate hz]" << std::endl;
+			return 1;
+		}
+	}
+
+	printf("%-8s %-7s %10s %10s %10s\n", "call", "type", "mean_us",
+			"p99_us", "max_us");
+
+	run<float>("float", iterations, 1 / rate);
+	run<double>("double", iterations, 1 / rate);
+
+	return 0;
+}
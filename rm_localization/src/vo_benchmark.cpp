@@ -0,0 +1,451 @@
+/*
+ * vo_benchmark.cpp
+ *
+ * Replays an RGB-D sequence from disk through the same tracking steps as
+ * the localization node, without a ROS graph, and reports per stage
+ * latency, tracking statistics and drift against ground truth.
+ *
+ * Usage:
+ *   vo_benchmark map <map_dir> [options]
+ *       Directory written by keyframe_map::save, positions.txt is used as
+ *       ground truth.
+ *   vo_benchmark tum <associations.txt> [groundtruth.txt] [options]
+ *       TUM RGB-D benchmark sequence, file names in associations.txt are
+ *       relative to its directory.
+ *
+ * Options:
+ *   --intrinsics <f> <cx> <cy>  (tum only, default 525 319.5 239.5)
+ *   --tracking_mode <two_pass|fused|inverse_compositional>
+ *   --max_tracking_points <n>
+ *   --pyramid_levels <n>  (default 3)
+ *   --tile <rows> <cols>  (tile size of the per pixel kernels)
+ *   --motion_prior  (seed tracking with a constant velocity prediction)
+ *   --convergence_threshold <t>  (skip iterations once updates are small)
+ */
+
+#include <keyframe.h>
+#include <keyframe_index.h>
+#include <motion_prior.h>
+#include <opencv2/highgui/highgui.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <tbb/tick_count.h>
+#include <Eigen/StdVector>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+
+struct sequence_frame {
+	double stamp;
+	std::string rgb_file;
+	std::string depth_file;
+	bool has_ground_truth;
+	Sophus::SE3f ground_truth;
+};
+
+typedef std::vector<sequence_frame, Eigen::aligned_allocator<sequence_frame> > sequence;
+
+static std::string get_dir(const std::string & file) {
+	size_t pos = file.find_last_of('/');
+	return pos == std::string::npos ? "." : file.substr(0, pos);
+}
+
+// Reads the layout written by keyframe_map::save.
+static bool load_map(const std::string & dir, sequence & frames,
+		Eigen::Vector3f & intrinsics) {
+
+	std::ifstream f((dir + "/positions.txt").c_str(), std::ios_base::binary);
+	if (!f)
+		return false;
+
+	for (int i = 0;; i++) {
+		Eigen::Quaternionf q;
+		Eigen::Vector3f t, frame_intrinsics;
+
+		f.read((char *) q.coeffs().data(), sizeof(float) * 4);
+		f.read((char *) t.data(), sizeof(float) * 3);
+		f.read((char *) frame_intrinsics.data(), sizeof(float) * 3);
+		if (!f)
+			break;
+
+		std::stringstream idx;
+		idx << i;
+
+		sequence_frame sf;
+		// Maps do not store stamps, assume 30 fps.
+		sf.stamp = i / 30.0;
+		sf.rgb_file = dir + "/rgb/" + idx.str() + ".png";
+		sf.depth_file = dir + "/depth/" + idx.str() + ".png";
+		sf.has_ground_truth = true;
+		sf.ground_truth = Sophus::SE3f(q, t);
+		frames.push_back(sf);
+
+		if (i == 0)
+			intrinsics = frame_intrinsics;
+	}
+
+	return true;
+}
+
+static bool load_tum(const std::string & associations,
+		const std::string & ground_truth, sequence & frames) {
+
+	std::ifstream f(associations.c_str());
+	if (!f)
+		return false;
+
+	std::string dir = get_dir(associations);
+	std::string line;
+	while (std::getline(f, line)) {
+		if (line.empty() || line[0] == '#')
+			continue;
+
+		std::stringstream ss(line);
+		double depth_stamp;
+		std::string rgb_file, depth_file;
+
+		sequence_frame sf;
+		if (!(ss >> sf.stamp >> rgb_file >> depth_stamp >> depth_file))
+			continue;
+
+		sf.rgb_file = dir + "/" + rgb_file;
+		sf.depth_file = dir + "/" + depth_file;
+		sf.has_ground_truth = false;
+		frames.push_back(sf);
+	}
+
+	if (ground_truth.empty())
+		return true;
+
+	std::ifstream g(ground_truth.c_str());
+	if (!g)
+		return false;
+
+	std::vector<double> stamps;
+	std::vector<Sophus::SE3f, Eigen::aligned_allocator<Sophus::SE3f> > poses;
+	while (std::getline(g, line)) {
+		if (line.empty() || line[0] == '#')
+			continue;
+
+		std::stringstream ss(line);
+		double stamp;
+		Eigen::Vector3f t;
+		Eigen::Quaternionf q;
+		if (!(ss >> stamp >> t[0] >> t[1] >> t[2] >> q.x() >> q.y() >> q.z()
+				>> q.w()))
+			continue;
+
+		stamps.push_back(stamp);
+		poses.push_back(Sophus::SE3f(q.normalized(), t));
+	}
+
+	// Closest ground truth pose within 20ms.
+	for (size_t i = 0; i < frames.size(); i++) {
+		size_t j = std::lower_bound(stamps.begin(), stamps.end(),
+				frames[i].stamp) - stamps.begin();
+
+		if (j > 0
+				&& (j == stamps.size()
+						|| frames[i].stamp - stamps[j - 1]
+								< stamps[j] - frames[i].stamp))
+			j--;
+
+		if (j < stamps.size() && std::abs(stamps[j] - frames[i].stamp) < 0.02) {
+			frames[i].has_ground_truth = true;
+			frames[i].ground_truth = poses[j];
+		}
+	}
+
+	return true;
+}
+
+static void print_latency(const char * name, std::vector<double> times) {
+
+	if (times.empty())
+		return;
+
+	std::sort(times.begin(), times.end());
+
+	double sum = 0;
+	for (size_t i = 0; i < times.size(); i++)
+		sum += times[i];
+
+	size_t n = times.size();
+	printf("%-10s %6zu calls  mean %7.2f  p50 %7.2f  p90 %7.2f  p99 %7.2f  "
+			"max %7.2f ms\n", name, n, sum / n, times[n / 2],
+			times[n * 9 / 10], times[n * 99 / 100], times[n - 1]);
+}
+
+static void print_usage(const char * name) {
+	std::cerr << "Usage: " << name
+			<< " map <map_dir> | tum <associations.txt> [groundtruth.txt]"
+			<< " [--intrinsics f cx cy] [--tracking_mode mode]"
+			<< " [--max_tracking_points n] [--pyramid_levels n]"
+			<< " [--tile rows cols] [--motion_prior]"
+			<< " [--convergence_threshold t]" << std::endl;
+}
+
+static double ms(const tbb::tick_count & start, const tbb::tick_count & end) {
+	return (end - start).seconds() * 1000;
+}
+
+int main(int argc, char **argv) {
+
+	if (argc < 3) {
+		print_usage(argv[0]);
+		return 1;
+	}
+
+	std::string type = argv[1];
+	std::string path = argv[2];
+	std::string ground_truth;
+
+	Eigen::Vector3f intrinsics(525.0, 319.5, 239.5);
+	tracking_mode mode = TRACKING_FUSED;
+	int max_points = 0;
+	int levels = 3;
+	bool use_motion_prior = false;
+	float convergence_threshold = 0;
+
+	for (int i = 3; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--intrinsics" && i + 3 < argc) {
+			intrinsics << atof(argv[i + 1]), atof(argv[i + 2]), atof(
+					argv[i + 3]);
+			i += 3;
+		} else if (arg == "--tracking_mode" && i + 1 < argc) {
+			std::string m = argv[++i];
+			if (m == "two_pass") {
+				mode = TRACKING_TWO_PASS;
+			} else if (m == "fused") {
+				mode = TRACKING_FUSED;
+			} else if (m == "inverse_compositional") {
+				mode = TRACKING_INVERSE_COMPOSITIONAL;
+			} else {
+				std::cerr << "Unknown tracking mode " << m << std::endl;
+				print_usage(argv[0]);
+				return 1;
+			}
+		} else if (arg == "--max_tracking_points" && i + 1 < argc) {
+			max_points = atoi(argv[++i]);
+		} else if (arg == "--pyramid_levels" && i + 1 < argc) {
+			levels = atoi(argv[++i]);
+		} else if (arg == "--tile" && i + 2 < argc) {
+			set_image_tile_size(atoi(argv[i + 1]), atoi(argv[i + 2]));
+			i += 2;
+		} else if (arg == "--motion_prior") {
+			use_motion_prior = true;
+		} else if (arg == "--convergence_threshold" && i + 1 < argc) {
+			convergence_threshold = atof(argv[++i]);
+		} else if (arg.compare(0, 2, "--") != 0 && ground_truth.empty()) {
+			ground_truth = arg;
+		} else {
+			// Unknown options or options missing their values.
+			std::cerr << "Unexpected argument " << arg << std::endl;
+			print_usage(argv[0]);
+			return 1;
+		}
+	}
+
+	sequence frames;
+	float depth_scale = 1;
+	bool loaded = false;
+
+	if (type == "map") {
+		loaded = load_map(path, frames, intrinsics);
+	} else if (type == "tum") {
+		// TUM depth images store 5000 units per meter.
+		depth_scale = 0.2;
+		loaded = load_tum(path, ground_truth, frames);
+	}
+
+	if (!loaded || frames.empty()) {
+		std::cerr << "Could not load sequence " << path << std::endl;
+		return 1;
+	}
+
+	std::vector<double> frame_times, keyframe_times, estimate_times,
+			total_times;
+	std::vector<int> iterations;
+	std::vector<float> valid_ratios;
+	int num_failed = 0;
+
+	std::vector<keyframe::Ptr> keyframes;
+	keyframe_index keyframes_index;
+
+	Sophus::SE3f camera_position;
+	if (frames[0].has_ground_truth)
+		camera_position = frames[0].ground_truth;
+
+	motion_prior camera_motion;
+
+	std::vector<Sophus::SE3f, Eigen::aligned_allocator<Sophus::SE3f> > trajectory;
+	trajectory.reserve(frames.size());
+
+	for (size_t i = 0; i < frames.size(); i++) {
+
+		cv::Mat rgb = cv::imread(frames[i].rgb_file, CV_LOAD_IMAGE_UNCHANGED);
+		cv::Mat depth = cv::imread(frames[i].depth_file,
+				CV_LOAD_IMAGE_UNCHANGED);
+
+		if (rgb.empty() || depth.empty()) {
+			std::cerr << "Could not read " << frames[i].rgb_file << " or "
+					<< frames[i].depth_file << std::endl;
+			return 1;
+		}
+
+		// TUM images are read as BGR, frames expect RGB like the camera
+		// topics. Maps are saved from RGB images and read back unchanged.
+		if (type == "tum" && rgb.channels() == 3) {
+			cv::cvtColor(rgb, rgb, CV_BGR2RGB);
+		}
+
+		if (depth_scale != 1) {
+			depth.convertTo(depth, CV_16U, depth_scale);
+		}
+
+		tracking_stats stats;
+		bool tracked = true;
+
+		tbb::tick_count start = tbb::tick_count::now();
+
+		if (keyframes.empty()) {
+
+			keyframe::Ptr k(
+					new keyframe(rgb, depth, camera_position, intrinsics,
+							levels));
+			k->set_max_points(max_points);
+			k->set_tracking_mode(mode);
+			k->set_convergence_threshold(convergence_threshold);
+			keyframe_times.push_back(ms(start, tbb::tick_count::now()));
+
+			keyframes_index.insert(keyframes.size(), k->get_pos());
+			keyframes.push_back(k);
+
+			if (use_motion_prior)
+				camera_motion.reset(camera_position, frames[i].stamp);
+
+		} else {
+
+			if (camera_motion.is_initialized())
+				camera_position = camera_motion.predict(frames[i].stamp);
+
+			int closest_keyframe_idx;
+			float distance;
+			keyframes_index.get_closest(camera_position, closest_keyframe_idx,
+					distance);
+			keyframe::Ptr closest_keyframe = keyframes[closest_keyframe_idx];
+
+			if (distance > 1) {
+
+				tbb::tick_count t0 = tbb::tick_count::now();
+				keyframe::Ptr k(
+						new keyframe(rgb, depth, camera_position, intrinsics,
+								levels));
+				k->set_max_points(max_points);
+				k->set_tracking_mode(mode);
+				k->set_convergence_threshold(convergence_threshold);
+				tbb::tick_count t1 = tbb::tick_count::now();
+				tracked = closest_keyframe->estimate_position(*k, &stats);
+				tbb::tick_count t2 = tbb::tick_count::now();
+
+				keyframe_times.push_back(ms(t0, t1));
+				estimate_times.push_back(ms(t1, t2));
+
+				camera_position = k->get_pos();
+				keyframes_index.insert(keyframes.size(), k->get_pos());
+				keyframes.push_back(k);
+
+			} else {
+
+				tbb::tick_count t0 = tbb::tick_count::now();
+				frame f(rgb, depth, camera_position, intrinsics, levels);
+				tbb::tick_count t1 = tbb::tick_count::now();
+				tracked = closest_keyframe->estimate_position(f, &stats);
+				tbb::tick_count t2 = tbb::tick_count::now();
+
+				frame_times.push_back(ms(t0, t1));
+				estimate_times.push_back(ms(t1, t2));
+
+				camera_position = f.get_pos();
+			}
+
+			if (tracked && camera_motion.is_initialized())
+				camera_motion.measure(camera_position);
+
+			iterations.push_back(stats.iterations);
+			valid_ratios.push_back(stats.valid_ratio);
+			if (!tracked)
+				num_failed++;
+		}
+
+		total_times.push_back(ms(start, tbb::tick_count::now()));
+		trajectory.push_back(camera_position);
+	}
+
+	double total_time = 0;
+	for (size_t i = 0; i < total_times.size(); i++)
+		total_time += total_times[i];
+
+	printf("%zu frames, %zu keyframes, %.1f fps\n", frames.size(),
+			keyframes.size(), 1000 * frames.size() / total_time);
+
+	print_latency("frame", frame_times);
+	print_latency("keyframe", keyframe_times);
+	print_latency("estimate", estimate_times);
+	print_latency("total", total_times);
+
+	if (!iterations.empty()) {
+		double mean_iterations = 0, mean_valid_ratio = 0;
+		for (size_t i = 0; i < iterations.size(); i++) {
+			mean_iterations += iterations[i];
+			mean_valid_ratio += valid_ratios[i];
+		}
+
+		printf("iterations %.1f  valid points %.1f%%  failed %d\n",
+				mean_iterations / iterations.size(),
+				100 * mean_valid_ratio / valid_ratios.size(), num_failed);
+	}
+
+	// Trajectory is aligned to the ground truth at the first frame that
+	// has one.
+	int first = -1;
+	for (size_t i = 0; i < frames.size() && first < 0; i++) {
+		if (frames[i].has_ground_truth)
+			first = i;
+	}
+
+	if (first >= 0) {
+		Sophus::SE3f align = frames[first].ground_truth
+				* trajectory[first].inverse();
+
+		double error_sum = 0, error_max = 0, error_last = 0, length = 0;
+		int num_errors = 0;
+		Eigen::Vector3f prev = frames[first].ground_truth.translation();
+
+		for (size_t i = first; i < frames.size(); i++) {
+			if (!frames[i].has_ground_truth)
+				continue;
+
+			Eigen::Vector3f gt = frames[i].ground_truth.translation();
+			double error =
+					((align * trajectory[i]).translation() - gt).norm();
+
+			length += (gt - prev).norm();
+			prev = gt;
+
+			error_sum += error;
+			error_max = std::max(error_max, error);
+			error_last = error;
+			num_errors++;
+		}
+
+		printf("translation error mean %.3f  max %.3f  final %.3f m  "
+				"drift %.2f%% of %.2f m\n", error_sum / num_errors, error_max,
+				error_last, length > 0 ? 100 * error_last / length : 0.0,
+				length);
+	}
+
+	return 0;
+}
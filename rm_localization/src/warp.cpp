@@ -0,0 +1,344 @@
+#include <Eigen/Core>
+#include <warp.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define WARP_X86
+#include <immintrin.h>
+#endif
+
+#ifdef WARP_X86
+
+warp_kernel get_best_warp_kernel() {
+	static const warp_kernel best =
+			__builtin_cpu_supports("avx2") ? WARP_KERNEL_AVX2 :
+			__builtin_cpu_supports("sse4.1") ?
+					WARP_KERNEL_SSE4 : WARP_KERNEL_SCALAR;
+	return best;
+}
+
+bool is_warp_kernel_supported(warp_kernel kernel) {
+	switch (kernel) {
+	case WARP_KERNEL_AVX2:
+		return __builtin_cpu_supports("avx2");
+	case WARP_KERNEL_SSE4:
+		return __builtin_cpu_supports("sse4.1");
+	default:
+		return true;
+	}
+}
+
+// Both kernels follow parallel_warp::warp_scalar operation by operation
+// (no fused multiply-add, true division), so valid points get the same
+// values. Taps that fail the occlusion test are masked to zero instead of
+// being skipped, which does not change the sums.
+
+__attribute__((target("sse4.1")))
+void warp_sse4(const parallel_warp & w, int begin, int end,
+		float * intencity_out, float * depth_out) {
+
+	const float * cloud = w.cloud ? w.cloud->data() : NULL;
+	const Eigen::Matrix<float, 4, 4, Eigen::ColMajor> & t = w.transform;
+
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 thousand = _mm_set1_ps(1000.0f);
+	const __m128 fifty = _mm_set1_ps(50.0f);
+	const __m128 f = _mm_set1_ps(w.intrinsics[0]);
+	const __m128 cx = _mm_set1_ps(w.intrinsics[1]);
+	const __m128 cy = _mm_set1_ps(w.intrinsics[2]);
+	const __m128 max_u = _mm_set1_ps(w.cols - 1);
+	const __m128 max_v = _mm_set1_ps(w.rows - 1);
+	const __m128i cols_i = _mm_set1_epi32(w.cols);
+
+	__m128 tc[4][3];
+	for (int j = 0; j < 4; j++) {
+		for (int k = 0; k < 3; k++) {
+			tc[j][k] = _mm_set1_ps(t(k, j));
+		}
+	}
+
+	int i = begin;
+	for (; i + 4 <= end; i += 4) {
+
+		__m128 x, y, z, h;
+		if (w.points) {
+			x = _mm_loadu_ps(w.points->x + i);
+			y = _mm_loadu_ps(w.points->y + i);
+			z = _mm_loadu_ps(w.points->z + i);
+			h = one;
+		} else {
+			x = _mm_loadu_ps(cloud + 4 * i);
+			y = _mm_loadu_ps(cloud + 4 * i + 4);
+			z = _mm_loadu_ps(cloud + 4 * i + 8);
+			h = _mm_loadu_ps(cloud + 4 * i + 12);
+			_MM_TRANSPOSE4_PS(x, y, z, h);
+		}
+
+		__m128 p[3];
+		for (int k = 0; k < 3; k++) {
+			p[k] = _mm_mul_ps(tc[0][k], x);
+			p[k] = _mm_add_ps(p[k], _mm_mul_ps(tc[1][k], y));
+			p[k] = _mm_add_ps(p[k], _mm_mul_ps(tc[2][k], z));
+			p[k] = _mm_add_ps(p[k], _mm_mul_ps(tc[3][k], h));
+		}
+
+		__m128 uw = _mm_add_ps(_mm_div_ps(_mm_mul_ps(p[0], f), p[2]), cx);
+		__m128 vw = _mm_add_ps(_mm_div_ps(_mm_mul_ps(p[1], f), p[2]), cy);
+
+		__m128 valid = _mm_cmpgt_ps(h, zero);
+		valid = _mm_and_ps(valid, _mm_cmpge_ps(uw, zero));
+		valid = _mm_and_ps(valid, _mm_cmplt_ps(uw, max_u));
+		valid = _mm_and_ps(valid, _mm_cmpge_ps(vw, zero));
+		valid = _mm_and_ps(valid, _mm_cmplt_ps(vw, max_v));
+
+		int valid_mask = _mm_movemask_ps(valid);
+		if (valid_mask == 0) {
+			_mm_storeu_ps(intencity_out + i - begin, zero);
+			_mm_storeu_ps(depth_out + i - begin, zero);
+			continue;
+		}
+
+		__m128i u = _mm_cvttps_epi32(uw);
+		__m128i v = _mm_cvttps_epi32(vw);
+		__m128 u0 = _mm_sub_ps(uw, _mm_cvtepi32_ps(u));
+		__m128 v0 = _mm_sub_ps(vw, _mm_cvtepi32_ps(v));
+		__m128 u1 = _mm_sub_ps(one, u0);
+		__m128 v1 = _mm_sub_ps(one, v0);
+
+		__m128i z_p_eps = _mm_cvttps_epi32(
+				_mm_sub_ps(_mm_mul_ps(p[2], thousand), fifty));
+
+		int32_t idx[4] __attribute__((aligned(16)));
+		_mm_store_si128((__m128i *) idx,
+				_mm_add_epi32(_mm_mullo_epi32(v, cols_i), u));
+
+		int32_t i00[4] = { 0 }, i01[4] = { 0 }, i10[4] = { 0 }, i11[4] = { 0 };
+		int32_t d00[4] = { 0 }, d01[4] = { 0 }, d10[4] = { 0 }, d11[4] = { 0 };
+
+		for (int k = 0; k < 4; k++) {
+			if (valid_mask & (1 << k)) {
+				size_t p00 = idx[k];
+				size_t p01 = p00 + w.cols;
+				i00[k] = w.intencity[p00];
+				i01[k] = w.intencity[p01];
+				i10[k] = w.intencity[p00 + 1];
+				i11[k] = w.intencity[p01 + 1];
+				d00[k] = w.depth[p00];
+				d01[k] = w.depth[p01];
+				d10[k] = w.depth[p00 + 1];
+				d11[k] = w.depth[p01 + 1];
+			}
+		}
+
+		__m128 val = zero, sum = zero;
+
+#define WARP_SSE4_TAP(I, D, WU, WV) \
+		{ \
+			__m128i d = _mm_loadu_si128((const __m128i *) D); \
+			__m128 m = _mm_castsi128_ps( \
+					_mm_andnot_si128(_mm_cmpeq_epi32(d, _mm_setzero_si128()), \
+							_mm_cmpgt_epi32(d, z_p_eps))); \
+			__m128 wt = _mm_mul_ps(WU, WV); \
+			val = _mm_add_ps(val, _mm_and_ps(m, _mm_mul_ps(wt, \
+					_mm_cvtepi32_ps(_mm_loadu_si128((const __m128i *) I))))); \
+			sum = _mm_add_ps(sum, _mm_and_ps(m, wt)); \
+		}
+
+		WARP_SSE4_TAP(i00, d00, u0, v0);
+		WARP_SSE4_TAP(i01, d01, u0, v1);
+		WARP_SSE4_TAP(i10, d10, u1, v0);
+		WARP_SSE4_TAP(i11, d11, u1, v1);
+
+#undef WARP_SSE4_TAP
+
+		__m128 res = _mm_div_ps(val, sum);
+		__m128 ok = _mm_and_ps(valid, _mm_cmpgt_ps(res, zero));
+
+		_mm_storeu_ps(intencity_out + i - begin, _mm_and_ps(ok, res));
+		_mm_storeu_ps(depth_out + i - begin,
+				_mm_and_ps(ok, _mm_mul_ps(p[2], thousand)));
+
+	}
+
+	w.warp_scalar(i, end, intencity_out + i - begin,
+			depth_out + i - begin);
+
+}
+
+__attribute__((target("avx2")))
+void warp_avx2(const parallel_warp & w, int begin, int end,
+		float * intencity_out, float * depth_out) {
+
+	const float * cloud = w.cloud ? w.cloud->data() : NULL;
+	const Eigen::Matrix<float, 4, 4, Eigen::ColMajor> & t = w.transform;
+
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256 one = _mm256_set1_ps(1.0f);
+	const __m256 thousand = _mm256_set1_ps(1000.0f);
+	const __m256 fifty = _mm256_set1_ps(50.0f);
+	const __m256 f = _mm256_set1_ps(w.intrinsics[0]);
+	const __m256 cx = _mm256_set1_ps(w.intrinsics[1]);
+	const __m256 cy = _mm256_set1_ps(w.intrinsics[2]);
+	const __m256 max_u = _mm256_set1_ps(w.cols - 1);
+	const __m256 max_v = _mm256_set1_ps(w.rows - 1);
+	const __m256i cols_i = _mm256_set1_epi32(w.cols);
+	const __m256i one_i = _mm256_set1_epi32(1);
+	const __m256i byte_mask = _mm256_set1_epi32(0xff);
+	const __m256i short_mask = _mm256_set1_epi32(0xffff);
+	const __m256i zero_i = _mm256_setzero_si256();
+	// Gathers load 4 bytes, taps past this index would read beyond the end
+	// of an unpadded level.
+	const __m256i last_gather_i = _mm256_set1_epi32(w.cols * w.rows - 4);
+
+	__m256 tc[4][3];
+	for (int j = 0; j < 4; j++) {
+		for (int k = 0; k < 3; k++) {
+			tc[j][k] = _mm256_set1_ps(t(k, j));
+		}
+	}
+
+	const int * intencity = (const int *) w.intencity;
+	const int * depth = (const int *) w.depth;
+
+	int i = begin;
+	for (; i + 8 <= end; i += 8) {
+
+		__m256 x, y, z, h;
+		if (w.points) {
+			x = _mm256_loadu_ps(w.points->x + i);
+			y = _mm256_loadu_ps(w.points->y + i);
+			z = _mm256_loadu_ps(w.points->z + i);
+			h = one;
+		} else {
+			// Points i..i+3 go to the low lane and i+4..i+7 to the high
+			// one, then each lane is transposed as a 4x4 block.
+			__m256 r0 = _mm256_loadu_ps(cloud + 4 * i);
+			__m256 r1 = _mm256_loadu_ps(cloud + 4 * i + 8);
+			__m256 r2 = _mm256_loadu_ps(cloud + 4 * i + 16);
+			__m256 r3 = _mm256_loadu_ps(cloud + 4 * i + 24);
+
+			__m256 t0 = _mm256_permute2f128_ps(r0, r2, 0x20);
+			__m256 t1 = _mm256_permute2f128_ps(r0, r2, 0x31);
+			__m256 t2 = _mm256_permute2f128_ps(r1, r3, 0x20);
+			__m256 t3 = _mm256_permute2f128_ps(r1, r3, 0x31);
+
+			__m256 a = _mm256_unpacklo_ps(t0, t1);
+			__m256 b = _mm256_unpacklo_ps(t2, t3);
+			__m256 c = _mm256_unpackhi_ps(t0, t1);
+			__m256 d = _mm256_unpackhi_ps(t2, t3);
+
+			x = _mm256_shuffle_ps(a, b, _MM_SHUFFLE(1, 0, 1, 0));
+			y = _mm256_shuffle_ps(a, b, _MM_SHUFFLE(3, 2, 3, 2));
+			z = _mm256_shuffle_ps(c, d, _MM_SHUFFLE(1, 0, 1, 0));
+			h = _mm256_shuffle_ps(c, d, _MM_SHUFFLE(3, 2, 3, 2));
+		}
+
+		__m256 p[3];
+		for (int k = 0; k < 3; k++) {
+			p[k] = _mm256_mul_ps(tc[0][k], x);
+			p[k] = _mm256_add_ps(p[k], _mm256_mul_ps(tc[1][k], y));
+			p[k] = _mm256_add_ps(p[k], _mm256_mul_ps(tc[2][k], z));
+			p[k] = _mm256_add_ps(p[k], _mm256_mul_ps(tc[3][k], h));
+		}
+
+		__m256 uw = _mm256_add_ps(
+				_mm256_div_ps(_mm256_mul_ps(p[0], f), p[2]), cx);
+		__m256 vw = _mm256_add_ps(
+				_mm256_div_ps(_mm256_mul_ps(p[1], f), p[2]), cy);
+
+		__m256 valid = _mm256_cmp_ps(h, zero, _CMP_GT_OQ);
+		valid = _mm256_and_ps(valid, _mm256_cmp_ps(uw, zero, _CMP_GE_OQ));
+		valid = _mm256_and_ps(valid, _mm256_cmp_ps(uw, max_u, _CMP_LT_OQ));
+		valid = _mm256_and_ps(valid, _mm256_cmp_ps(vw, zero, _CMP_GE_OQ));
+		valid = _mm256_and_ps(valid, _mm256_cmp_ps(vw, max_v, _CMP_LT_OQ));
+
+		if (_mm256_movemask_ps(valid) == 0) {
+			_mm256_storeu_ps(intencity_out + i - begin, zero);
+			_mm256_storeu_ps(depth_out + i - begin, zero);
+			continue;
+		}
+
+		__m256i u = _mm256_cvttps_epi32(uw);
+		__m256i v = _mm256_cvttps_epi32(vw);
+		__m256 u0 = _mm256_sub_ps(uw, _mm256_cvtepi32_ps(u));
+		__m256 v0 = _mm256_sub_ps(vw, _mm256_cvtepi32_ps(v));
+		__m256 u1 = _mm256_sub_ps(one, u0);
+		__m256 v1 = _mm256_sub_ps(one, v0);
+
+		__m256i z_p_eps = _mm256_cvttps_epi32(
+				_mm256_sub_ps(_mm256_mul_ps(p[2], thousand), fifty));
+
+		__m256i valid_i = _mm256_castps_si256(valid);
+		__m256i p00 = _mm256_add_epi32(_mm256_mullo_epi32(v, cols_i), u);
+		__m256i p01 = _mm256_add_epi32(p00, cols_i);
+		__m256i p10 = _mm256_add_epi32(p00, one_i);
+		__m256i p11 = _mm256_add_epi32(p01, one_i);
+
+		// p11 is the largest tap. The few points next to the last pixels
+		// of the image go through the scalar loads.
+		if (!_mm256_testz_si256(valid_i,
+				_mm256_cmpgt_epi32(p11, last_gather_i))) {
+			w.warp_scalar(i, i + 8, intencity_out + i - begin,
+					depth_out + i - begin);
+			continue;
+		}
+
+		__m256 val = zero, sum = zero;
+
+#define WARP_AVX2_TAP(P, WU, WV) \
+		{ \
+			__m256i d = _mm256_and_si256(short_mask, \
+					_mm256_mask_i32gather_epi32(zero_i, depth, P, valid_i, 2)); \
+			__m256i in = _mm256_and_si256(byte_mask, \
+					_mm256_mask_i32gather_epi32(zero_i, intencity, P, valid_i, 1)); \
+			__m256 m = _mm256_castsi256_ps( \
+					_mm256_andnot_si256(_mm256_cmpeq_epi32(d, zero_i), \
+							_mm256_cmpgt_epi32(d, z_p_eps))); \
+			__m256 wt = _mm256_mul_ps(WU, WV); \
+			val = _mm256_add_ps(val, _mm256_and_ps(m, \
+					_mm256_mul_ps(wt, _mm256_cvtepi32_ps(in)))); \
+			sum = _mm256_add_ps(sum, _mm256_and_ps(m, wt)); \
+		}
+
+		WARP_AVX2_TAP(p00, u0, v0);
+		WARP_AVX2_TAP(p01, u0, v1);
+		WARP_AVX2_TAP(p10, u1, v0);
+		WARP_AVX2_TAP(p11, u1, v1);
+
+#undef WARP_AVX2_TAP
+
+		__m256 res = _mm256_div_ps(val, sum);
+		__m256 ok = _mm256_and_ps(valid, _mm256_cmp_ps(res, zero, _CMP_GT_OQ));
+
+		_mm256_storeu_ps(intencity_out + i - begin, _mm256_and_ps(ok, res));
+		_mm256_storeu_ps(depth_out + i - begin,
+				_mm256_and_ps(ok, _mm256_mul_ps(p[2], thousand)));
+
+	}
+
+	w.warp_scalar(i, end, intencity_out + i - begin,
+			depth_out + i - begin);
+
+}
+
+#else
+
+warp_kernel get_best_warp_kernel() {
+	return WARP_KERNEL_SCALAR;
+}
+
+bool is_warp_kernel_supported(warp_kernel kernel) {
+	return kernel == WARP_KERNEL_SCALAR;
+}
+
+void warp_sse4(const parallel_warp & w, int begin, int end,
+		float * intencity_out, float * depth_out) {
+	w.warp_scalar(begin, end, intencity_out, depth_out);
+}
+
+void warp_avx2(const parallel_warp & w, int begin, int end,
+		float * intencity_out, float * depth_out) {
+	w.warp_scalar(begin, end, intencity_out, depth_out);
+}
+
+#endif
@@ -0,0 +1,72 @@
+#include <keyframe_codec.h>
+#include <gtest/gtest.h>
+#include <cstdlib>
+
+typedef rm_localization::Keyframe msg;
+
+static cv::Mat make_depth(int rows, int cols) {
+
+	srand(42);
+
+	// Smooth surface with holes and a depth discontinuity.
+	cv::Mat depth(rows, cols, CV_16UC1);
+	for (int v = 0; v < rows; v++) {
+		for (int u = 0; u < cols; u++) {
+			uint16_t d = 1000 + 2 * v + (u > cols / 2 ? 1500 : 0) + rand() % 3;
+			if (rand() % 10 == 0 || (u < 20 && v < 20))
+				d = 0;
+			depth.at<uint16_t>(v, u) = d;
+		}
+	}
+
+	return depth;
+}
+
+TEST(KeyframeCodecTest, depthRleTest) {
+
+	cv::Mat depth = make_depth(120, 160);
+
+	std::vector<uint8_t> data;
+	ASSERT_TRUE(encode_image(depth, msg::CODEC_DEPTH_RLE, data));
+	EXPECT_LT(data.size(), depth.rows * depth.cols * sizeof(uint16_t));
+
+	cv::Mat res = decode_image(data, msg::CODEC_DEPTH_RLE);
+	ASSERT_FALSE(res.empty());
+	ASSERT_EQ(depth.rows, res.rows);
+	ASSERT_EQ(depth.cols, res.cols);
+	ASSERT_EQ(CV_16UC1, res.type());
+
+	for (int v = 0; v < depth.rows; v++) {
+		for (int u = 0; u < depth.cols; u++) {
+			ASSERT_EQ(depth.at<uint16_t>(v, u), res.at<uint16_t>(v, u))
+					<< "at " << u << " " << v;
+		}
+	}
+
+	// Truncated data must not decode.
+	data.resize(data.size() / 2);
+	EXPECT_TRUE(decode_image(data, msg::CODEC_DEPTH_RLE).empty());
+
+}
+
+TEST(KeyframeCodecTest, rawTest) {
+
+	cv::Mat rgb(120, 160, CV_8UC3);
+	cv::randu(rgb, cv::Scalar(0), cv::Scalar(255));
+
+	std::vector<uint8_t> data;
+	ASSERT_TRUE(encode_image(rgb, msg::CODEC_RAW, data));
+
+	cv::Mat res = decode_image(data, msg::CODEC_RAW);
+	ASSERT_FALSE(res.empty());
+	ASSERT_EQ(CV_8UC3, res.type());
+	EXPECT_EQ(0, memcmp(rgb.data, res.data, 120 * 160 * 3));
+
+	EXPECT_FALSE(encode_image(rgb, msg::CODEC_DEPTH_RLE, data));
+
+}
+
+int main(int argc, char **argv) {
+	testing::InitGoogleTest(&argc, argv);
+	return RUN_ALL_TESTS();
+}
@@ -0,0 +1,83 @@
+#include <keyframe_index.h>
+#include <gtest/gtest.h>
+#include <cstdlib>
+
+static float frand(float min, float max) {
+	return min + (max - min) * rand() / RAND_MAX;
+}
+
+static Sophus::SE3f random_pose(float size) {
+	Eigen::Quaternionf q(frand(-1, 1), frand(-1, 1), frand(-1, 1),
+			frand(-1, 1));
+	q.normalize();
+	return Sophus::SE3f(q,
+			Eigen::Vector3f(frand(-size, size), frand(-size, size),
+					frand(-size / 10, size / 10)));
+}
+
+static void get_closest_linear(
+		const std::vector<Sophus::SE3f,
+				Eigen::aligned_allocator<Sophus::SE3f> > & poses,
+		const Sophus::SE3f & pos, int & res, float & dist) {
+
+	res = -1;
+	dist = std::numeric_limits<float>::max();
+
+	for (size_t i = 0; i < poses.size(); i++) {
+		float current_dist = keyframe_distance(pos, poses[i]);
+		if (current_dist < dist) {
+			res = i;
+			dist = current_dist;
+		}
+	}
+}
+
+TEST(KeyframeIndexTest, closestTest) {
+
+	srand(42);
+
+	keyframe_index index;
+	std::vector<Sophus::SE3f, Eigen::aligned_allocator<Sophus::SE3f> > poses;
+
+	int res;
+	float dist;
+	index.get_closest(Sophus::SE3f(), res, dist);
+	EXPECT_EQ(-1, res);
+
+	for (int i = 0; i < 500; i++) {
+		poses.push_back(random_pose(10));
+		index.insert(i, poses.back());
+	}
+
+	// Pose updates as done by update_map.
+	for (int i = 0; i < 100; i++) {
+		int idx = rand() % poses.size();
+		poses[idx] = random_pose(10);
+		index.update(idx, poses[idx]);
+	}
+
+	EXPECT_EQ(poses.size(), index.size());
+
+	for (int i = 0; i < 200; i++) {
+		// Queries inside and far outside of the map.
+		Sophus::SE3f pos = random_pose(i % 10 == 0 ? 50 : 10);
+
+		int res_linear;
+		float dist_linear;
+		get_closest_linear(poses, pos, res_linear, dist_linear);
+		index.get_closest(pos, res, dist);
+
+		EXPECT_EQ(res_linear, res);
+		EXPECT_FLOAT_EQ(dist_linear, dist);
+	}
+
+	index.clear();
+	index.get_closest(Sophus::SE3f(), res, dist);
+	EXPECT_EQ(-1, res);
+
+}
+
+int main(int argc, char **argv) {
+	testing::InitGoogleTest(&argc, argv);
+	return RUN_ALL_TESTS();
+}
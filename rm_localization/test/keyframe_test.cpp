@@ -0,0 +1,164 @@
+#include <keyframe.h>
+#include <pyramid_arena.h>
+#include <gtest/gtest.h>
+
+TEST(KeyframeTest, evictTest) {
+
+	pyramid_arena & arena = pyramid_arena::get();
+
+	cv::Mat gray(480, 640, CV_8U), depth(480, 640, CV_16U);
+	cv::randu(gray, cv::Scalar(0), cv::Scalar(255));
+	cv::randu(depth, cv::Scalar(500), cv::Scalar(4000));
+
+	Eigen::Vector3f intrinsics;
+	intrinsics << 525.0, 319.5, 239.5;
+
+	keyframe k(gray, depth, Sophus::SE3f(), intrinsics);
+	k.set_tracking_mode(TRACKING_INVERSE_COMPOSITIONAL);
+
+	// Copies of the smallest level, it depends on every level above.
+	std::vector<uint8_t> i2(k.get_i(2).data, k.get_i(2).data + 160 * 120);
+	std::vector<int16_t> dx2((int16_t *) k.get_i_dx(2).data,
+			(int16_t *) k.get_i_dx(2).data + 160 * 120);
+	std::vector<uint16_t> d2((uint16_t *) k.get_d(2).data,
+			(uint16_t *) k.get_d(2).data + 160 * 120);
+
+	size_t num_in_use = arena.get_num_in_use();
+	size_t memory_usage = k.get_memory_usage();
+
+	k.evict();
+	EXPECT_TRUE(k.is_evicted());
+	EXPECT_LT(arena.get_num_in_use(), num_in_use);
+	EXPECT_LT(k.get_memory_usage() * 4, memory_usage);
+
+	k.restore();
+	EXPECT_FALSE(k.is_evicted());
+	EXPECT_EQ(num_in_use, arena.get_num_in_use());
+	EXPECT_EQ(memory_usage, k.get_memory_usage());
+
+	EXPECT_EQ(0, memcmp(&i2[0], k.get_i(2).data, i2.size()));
+	EXPECT_EQ(0, memcmp(&dx2[0], k.get_i_dx(2).data, dx2.size() * 2));
+	EXPECT_EQ(0, memcmp(&d2[0], k.get_d(2).data, d2.size() * 2));
+
+	frame f(gray, depth, Sophus::SE3f(), intrinsics);
+	EXPECT_TRUE(k.estimate_position(f));
+
+}
+
+TEST(KeyframeTest, adoptTest) {
+
+	pyramid_arena & arena = pyramid_arena::get();
+
+	boost::shared_ptr<cv::Mat> gray(new cv::Mat(480, 640, CV_8U)), depth(
+			new cv::Mat(480, 640, CV_16U));
+	cv::randu(*gray, cv::Scalar(0), cv::Scalar(255));
+	cv::randu(*depth, cv::Scalar(500), cv::Scalar(4000));
+
+	Eigen::Vector3f intrinsics;
+	intrinsics << 525.0, 319.5, 239.5;
+
+	frame copied(*gray, *depth, Sophus::SE3f(), intrinsics);
+
+	size_t num_in_use = arena.get_num_in_use();
+
+	{
+		frame adopted(*gray, *depth, gray, depth, Sophus::SE3f(), intrinsics);
+
+		// Level 0 of both images is shared, not taken from the arena.
+		EXPECT_EQ(gray->data, adopted.get_i(0).data);
+		EXPECT_EQ(depth->data, adopted.get_d(0).data);
+		EXPECT_EQ(2, gray.use_count());
+		EXPECT_EQ(num_in_use + 2 * 2 + 2, arena.get_num_in_use());
+
+		for (int level = 1; level < 3; level++) {
+			int size = (640 >> level) * (480 >> level);
+			EXPECT_EQ(0,
+					memcmp(copied.get_i(level).data,
+							adopted.get_i(level).data, size));
+			EXPECT_EQ(0,
+					memcmp(copied.get_d(level).data,
+							adopted.get_d(level).data, 2 * size));
+		}
+	}
+
+	EXPECT_EQ(1, gray.use_count());
+	EXPECT_EQ(num_in_use, arena.get_num_in_use());
+
+	// Images that need conversion are copied and the owner is not kept.
+	cv::Mat yuv(480, 640, CV_8UC2, cv::Scalar(128, 64));
+	boost::shared_ptr<cv::Mat> yuv_owner(new cv::Mat(yuv));
+	frame converted(yuv, *depth, yuv_owner, depth, Sophus::SE3f(),
+			intrinsics);
+	EXPECT_EQ(1, yuv_owner.use_count());
+	EXPECT_EQ(64, converted.get_i(0).at<uint8_t>(0, 0));
+
+}
+
+TEST(KeyframeTest, maxPointsTest) {
+
+	cv::Mat gray(480, 640, CV_8U), depth(480, 640, CV_16U);
+	cv::randu(gray, cv::Scalar(0), cv::Scalar(255));
+	cv::randu(depth, cv::Scalar(500), cv::Scalar(4000));
+
+	Eigen::Vector3f intrinsics;
+	intrinsics << 525.0, 319.5, 239.5;
+
+	keyframe k(gray, depth, Sophus::SE3f(), intrinsics);
+	size_t all_points = k.get_memory_usage();
+
+	k.set_max_points(64);
+	size_t budget_64 = k.get_memory_usage();
+
+	// 4 points give 0 at level 2, which must not mean all points.
+	k.set_max_points(4);
+	size_t budget_4 = k.get_memory_usage();
+
+	EXPECT_LT(budget_64, all_points);
+	EXPECT_LT(budget_4, budget_64);
+
+}
+
+TEST(KeyframeTest, updateIntrinsicsTest) {
+
+	pyramid_arena & arena = pyramid_arena::get();
+
+	cv::Mat gray(480, 640, CV_8U), depth(480, 640, CV_16U);
+	cv::randu(gray, cv::Scalar(0), cv::Scalar(255));
+	cv::randu(depth, cv::Scalar(500), cv::Scalar(4000));
+
+	Eigen::Vector3f intrinsics, new_intrinsics;
+	intrinsics << 525.0, 319.5, 239.5;
+	new_intrinsics << 530.0, 320.5, 240.5;
+
+	keyframe k(gray, depth, Sophus::SE3f(), intrinsics);
+	k.set_tracking_mode(TRACKING_INVERSE_COMPOSITIONAL);
+
+	size_t num_in_use = arena.get_num_in_use();
+	size_t memory_usage = k.get_memory_usage();
+
+	// The replaced geometry goes back to the arena.
+	k.update_intrinsics(new_intrinsics);
+	EXPECT_EQ(new_intrinsics, k.get_intrinsics());
+	EXPECT_EQ(num_in_use, arena.get_num_in_use());
+	EXPECT_EQ(memory_usage, k.get_memory_usage());
+
+	{
+		frame f(gray, depth, Sophus::SE3f(), new_intrinsics);
+		EXPECT_TRUE(k.estimate_position(f));
+	}
+
+	// Evicted keyframes take the intrinsics on restore.
+	EXPECT_TRUE(k.try_evict());
+	k.update_intrinsics(intrinsics);
+	k.restore();
+	EXPECT_EQ(num_in_use, arena.get_num_in_use());
+
+	frame f2(gray, depth, Sophus::SE3f(), intrinsics);
+	EXPECT_TRUE(k.estimate_position(f2));
+
+}
+
+int main(int argc, char **argv) {
+	testing::InitGoogleTest(&argc, argv);
+	return RUN_ALL_TESTS();
+}
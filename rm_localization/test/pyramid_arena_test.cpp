@@ -0,0 +1,78 @@
+#include <keyframe.h>
+#include <pyramid_arena.h>
+#include <gtest/gtest.h>
+
+TEST(PyramidArenaTest, alignmentTest) {
+
+	pyramid_arena & arena = pyramid_arena::get();
+
+	size_t sizes[] = { 1, 63, 64, 65, 320 * 240, 640 * 480 * 2 };
+
+	for (int i = 0; i < 6; i++) {
+		uint8_t * ptr = arena.acquire<uint8_t>(sizes[i]);
+		EXPECT_EQ(0u, ((size_t) ptr) % pyramid_arena::alignment);
+
+		// Padding after the last element must be writable.
+		memset(ptr, 0, sizes[i] + pyramid_arena::alignment);
+		arena.release<uint8_t>(ptr, sizes[i]);
+	}
+
+}
+
+TEST(PyramidArenaTest, recycleTest) {
+
+	pyramid_arena & arena = pyramid_arena::get();
+
+	uint16_t * ptr1 = arena.acquire<uint16_t>(640 * 480);
+	arena.release<uint16_t>(ptr1, 640 * 480);
+
+	size_t num_heap_allocations = arena.get_num_heap_allocations();
+
+	uint16_t * ptr2 = arena.acquire<uint16_t>(640 * 480);
+	EXPECT_EQ(ptr1, ptr2);
+	EXPECT_EQ(num_heap_allocations, arena.get_num_heap_allocations());
+	arena.release<uint16_t>(ptr2, 640 * 480);
+
+}
+
+TEST(PyramidArenaTest, soakTest) {
+
+	pyramid_arena & arena = pyramid_arena::get();
+
+	cv::Mat gray(480, 640, CV_8U), depth(480, 640, CV_16U);
+	cv::randu(gray, cv::Scalar(0), cv::Scalar(255));
+	cv::randu(depth, cv::Scalar(500), cv::Scalar(4000));
+
+	Eigen::Vector3f intrinsics;
+	intrinsics << 525.0, 319.5, 239.5;
+
+	keyframe k(gray, depth, Sophus::SE3f(), intrinsics);
+
+	{
+		frame f(gray, depth, Sophus::SE3f(), intrinsics);
+		k.estimate_position(f);
+	}
+
+	size_t num_heap_allocations = arena.get_num_heap_allocations();
+	size_t num_in_use = arena.get_num_in_use();
+
+	for (int i = 0; i < 20; i++) {
+		frame f(gray, depth, Sophus::SE3f(), intrinsics);
+		k.estimate_position(f);
+	}
+
+	EXPECT_EQ(num_heap_allocations, arena.get_num_heap_allocations());
+	EXPECT_EQ(num_in_use, arena.get_num_in_use());
+
+	// Fused tracking takes no warped image buffers.
+	frame f(gray, depth, Sophus::SE3f(), intrinsics);
+	size_t num_acquired = arena.get_num_acquired();
+	k.estimate_position(f);
+	EXPECT_EQ(num_acquired, arena.get_num_acquired());
+
+}
+
+int main(int argc, char **argv) {
+	testing::InitGoogleTest(&argc, argv);
+	return RUN_ALL_TESTS();
+}
@@ -0,0 +1,128 @@
+#include <pyramid_builder.h>
+#include <gtest/gtest.h>
+#include <tbb/parallel_for.h>
+#include <algorithm>
+#include <cstdlib>
+#include <vector>
+
+// Odd sizes so that the last band and the scalar tails are used.
+static const int cols = 157;
+static const int rows = 93;
+static const int num_levels = 4;
+
+struct pyramid {
+	std::vector<std::vector<uint8_t> > i;
+	std::vector<std::vector<uint16_t> > d;
+	std::vector<std::vector<int16_t> > dx, dy;
+
+	pyramid() :
+			i(num_levels), d(num_levels), dx(num_levels), dy(num_levels) {
+		for (int level = 0; level < num_levels; level++) {
+			int size = (cols >> level) * (rows >> level);
+			i[level].resize(size);
+			d[level].resize(size);
+			dx[level].resize(size);
+			dy[level].resize(size);
+		}
+	}
+};
+
+// Sort based median and gradients of the per level implementation.
+static void build_reference(pyramid & p) {
+
+	for (int level = 1; level < num_levels; level++) {
+		int pc = cols >> (level - 1);
+		int c = cols >> level;
+		int r = rows >> level;
+
+		for (int v = 0; v < r; v++) {
+			for (int u = 0; u < c; u++) {
+				int i = 2 * v * pc + 2 * u;
+				uint16_t values[4] = { p.d[level - 1][i], p.d[level - 1][i + 1],
+						p.d[level - 1][i + pc], p.d[level - 1][i + pc + 1] };
+				std::sort(values, values + 4);
+
+				p.i[level][v * c + u] = ((int) p.i[level - 1][i]
+						+ p.i[level - 1][i + 1] + p.i[level - 1][i + pc]
+						+ p.i[level - 1][i + pc + 1]) / 4;
+				p.d[level][v * c + u] = values[2];
+			}
+		}
+	}
+
+	for (int level = 0; level < num_levels; level++) {
+		int c = cols >> level;
+		int r = rows >> level;
+		const uint8_t * intencity = &p.i[level][0];
+
+		for (int i = 0; i < c * r; i++) {
+			int u = i % c;
+			int v = i / c;
+
+			int16_t dx, dy;
+			if (u == 0) {
+				dx = (int16_t) intencity[i + 1] - intencity[i];
+			} else if (u == c - 1) {
+				dx = (int16_t) intencity[i] - intencity[i - 1];
+			} else {
+				dx = ((int16_t) intencity[i + 1] - intencity[i - 1]) / 2;
+			}
+
+			if (v == 0) {
+				dy = (int16_t) intencity[i + c] - intencity[i];
+			} else if (v == r - 1) {
+				dy = (int16_t) intencity[i] - intencity[i - c];
+			} else {
+				dy = ((int16_t) intencity[i + c] - intencity[i - c]) / 2;
+			}
+
+			p.dx[level][i] = dx;
+			p.dy[level][i] = dy;
+		}
+	}
+}
+
+TEST(PyramidBuilderTest, matchesReference) {
+
+	pyramid ref, res;
+
+	srand(7);
+	for (int i = 0; i < cols * rows; i++) {
+		ref.i[0][i] = res.i[0][i] = rand() % 256;
+		// Whole range, including values with the top bit set.
+		ref.d[0][i] = res.d[0][i] = rand() % 4 == 0 ? 0 : rand() % 65536;
+	}
+
+	build_reference(ref);
+
+	std::vector<uint8_t *> i_ptr(num_levels);
+	std::vector<uint16_t *> d_ptr(num_levels);
+	std::vector<int16_t *> dx_ptr(num_levels), dy_ptr(num_levels);
+	for (int level = 0; level < num_levels; level++) {
+		i_ptr[level] = &res.i[level][0];
+		d_ptr[level] = &res.d[level][0];
+		dx_ptr[level] = &res.dx[level][0];
+		dy_ptr[level] = &res.dy[level][0];
+	}
+
+	subsample_pyramid sub(&i_ptr[0], &d_ptr[0], cols, rows, num_levels);
+	tbb::parallel_for(tbb::blocked_range<int>(0, sub.get_num_bands(), 1), sub);
+
+	compute_gradients grad(&i_ptr[0], &dx_ptr[0], &dy_ptr[0], cols, rows,
+			num_levels);
+	tbb::parallel_for(tbb::blocked_range<int>(0, grad.get_num_bands(), 1),
+			grad);
+
+	for (int level = 0; level < num_levels; level++) {
+		EXPECT_TRUE(ref.i[level] == res.i[level]) << "level " << level;
+		EXPECT_TRUE(ref.d[level] == res.d[level]) << "level " << level;
+		EXPECT_TRUE(ref.dx[level] == res.dx[level]) << "level " << level;
+		EXPECT_TRUE(ref.dy[level] == res.dy[level]) << "level " << level;
+	}
+
+}
+
+int main(int argc, char **argv) {
+	testing::InitGoogleTest(&argc, argv);
+	return RUN_ALL_TESTS();
+}
@@ -83,6 +83,33 @@ TEST(SigmaPointsTest, doubleTest) {
 			Sophus::SophusConstants<double>::epsilon());
 }
 
+TEST(SigmaPointsTest, batchedExpLogTest) {
+
+	SE3UKFd::Matrix6_25 a, a2;
+	a.setRandom();
+	a.col(1).setZero();
+	a.col(2).tail<3>() *= 1e-12;
+
+	SE3UKFd::Matrix4_25 q;
+	SE3UKFd::Matrix3_25 t;
+	SE3UKFd::exp(a, q, t);
+	SE3UKFd::log(q, t, a2);
+
+	for (int i = 0; i < 25; i++) {
+		Sophus::SE3d p = Sophus::SE3d::exp(a.col(i));
+
+		EXPECT_LE(
+				(p.unit_quaternion().coeffs() - q.col(i)).array().abs().maxCoeff(),
+				1e-12);
+		EXPECT_LE( (p.translation() - t.col(i)).array().abs().maxCoeff(),
+				1e-12);
+		EXPECT_LE( (Sophus::SE3d::log(p) - a2.col(i)).array().abs().maxCoeff(),
+				1e-12);
+	}
+
+	EXPECT_LE( (a - a2).array().abs().maxCoeff(), 1e-12);
+}
+
 TEST(VelocityEstimationTest, floatTest) {
 
 	Sophus::SE3f true_pose, pose;
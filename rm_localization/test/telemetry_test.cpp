@@ -0,0 +1,87 @@
+#include <telemetry.h>
+#include <keyframe.h>
+#include <tbb/parallel_for.h>
+#include <tbb/blocked_range.h>
+#include <gtest/gtest.h>
+#include <sstream>
+
+struct add_latencies {
+	latency_histogram * h;
+
+	void operator()(const tbb::blocked_range<int> & r) const {
+		for (int i = r.begin(); i != r.end(); i++)
+			h->add(i % 1000);
+	}
+};
+
+TEST(TelemetryTest, latencyHistogramTest) {
+
+	latency_histogram h;
+	EXPECT_EQ(0.0, h.get_mean());
+	EXPECT_EQ(0.0, h.get_percentile(0.5));
+
+	add_latencies a;
+	a.h = &h;
+	tbb::parallel_for(tbb::blocked_range<int>(0, 100000, 100), a);
+
+	EXPECT_EQ(100000u, h.get_count());
+	EXPECT_NEAR(0.4995, h.get_mean(), 1e-6);
+	EXPECT_EQ(0.999, h.get_max());
+
+	// Rounded up to the power of two bucket bound, capped by the maximum.
+	EXPECT_EQ(0.512, h.get_percentile(0.5));
+	EXPECT_EQ(0.999, h.get_percentile(0.99));
+
+}
+
+TEST(TelemetryTest, valueHistogramTest) {
+
+	value_histogram h(1);
+	for (int i = 0; i < 100; i++)
+		h.add(i / 100.0);
+	h.add(2);
+
+	EXPECT_EQ(101u, h.get_count());
+	EXPECT_NEAR((49.5 + 2) / 101, h.get_mean(), 1e-6);
+	EXPECT_NEAR(0.5, h.get_percentile(0.5), 1.0 / value_histogram::num_buckets);
+	EXPECT_EQ(1.0, h.get_percentile(1));
+
+}
+
+TEST(TelemetryTest, disabledTest) {
+
+	telemetry t;
+
+	tracking_stats stats;
+	stats.iterations = 10;
+	stats.valid_ratio = 0.8;
+	stats.residual = 12;
+	stats.num_levels = 3;
+	stats.level_us[0] = 1000;
+	stats.level_us[1] = 500;
+	stats.level_us[2] = 200;
+
+	{
+		scoped_timer timer(t, STAGE_TRACK);
+	}
+	t.add(stats);
+	EXPECT_EQ(0u, t.get(STAGE_TRACK).get_count());
+
+	t.set_enabled(true);
+	{
+		scoped_timer timer(t, STAGE_TRACK);
+	}
+	t.add(stats);
+	EXPECT_EQ(1u, t.get(STAGE_TRACK).get_count());
+
+	std::stringstream ss;
+	t.print(ss);
+	EXPECT_NE(std::string::npos, ss.str().find("level 2"));
+	EXPECT_EQ(std::string::npos, ss.str().find("level 3"));
+
+}
+
+int main(int argc, char **argv) {
+	testing::InitGoogleTest(&argc, argv);
+	return RUN_ALL_TESTS();
+}
@@ -0,0 +1,73 @@
+#include <trajectory_recorder.h>
+#include <gtest/gtest.h>
+#include <unistd.h>
+
+TEST(TrajectoryRecorderTest, spscQueueTest) {
+
+	spsc_queue<int> q(3);
+	EXPECT_EQ(4u, q.capacity());
+
+	for (int i = 0; i < 4; i++)
+		EXPECT_TRUE(q.push(i));
+	EXPECT_FALSE(q.push(4));
+
+	int item;
+	for (int i = 0; i < 4; i++) {
+		EXPECT_TRUE(q.pop(item));
+		EXPECT_EQ(i, item);
+	}
+	EXPECT_FALSE(q.pop(item));
+
+	// Wraps around.
+	EXPECT_TRUE(q.push(5));
+	EXPECT_TRUE(q.pop(item));
+	EXPECT_EQ(5, item);
+
+}
+
+TEST(TrajectoryRecorderTest, writeReadTest) {
+
+	char filename[] = "/tmp/trajectory_recorder_testXXXXXX";
+	close(mkstemp(filename));
+
+	// More records than one chunk holds.
+	size_t num_records = trajectory_recorder::chunk_records + 100;
+
+	{
+		trajectory_recorder recorder(filename, 4096);
+		ASSERT_TRUE(recorder.is_open());
+
+		for (size_t i = 0; i < num_records; i++) {
+			trajectory_record r = trajectory_record();
+			r.stamp = i * 0.033;
+			r.translation[0] = i;
+			r.rotation[3] = 1;
+			r.keyframe_idx = i / 100;
+			r.stage_us[STAGE_TOTAL] = i;
+
+			while (!recorder.record(r))
+				usleep(1000);
+		}
+	}
+
+	std::vector<trajectory_record> records;
+	ASSERT_TRUE(read_trajectory(filename, records));
+	ASSERT_EQ(num_records, records.size());
+
+	for (size_t i = 0; i < num_records; i++) {
+		EXPECT_EQ(i * 0.033, records[i].stamp);
+		EXPECT_EQ(float(i), records[i].translation[0]);
+		EXPECT_EQ(1, records[i].rotation[3]);
+		EXPECT_EQ(int(i / 100), records[i].keyframe_idx);
+		EXPECT_EQ(i, records[i].stage_us[STAGE_TOTAL]);
+	}
+
+	unlink(filename);
+
+	EXPECT_FALSE(read_trajectory(filename, records));
+}
+
+int main(int argc, char **argv) {
+	testing::InitGoogleTest(&argc, argv);
+	return RUN_ALL_TESTS();
+}
@@ -0,0 +1,352 @@
+#include <Eigen/Geometry>
+#include <warp.h>
+#include <reduce_warp_jacobian.h>
+#include <reduce_warp_residual.h>
+#include <gtest/gtest.h>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// Copy of an image that ends right before an inaccessible page, like a
+// tightly sized message buffer. Reading past the last pixel faults.
+template<typename T>
+struct guarded_image {
+
+	guarded_image(const T * src, size_t num_elements) {
+		size_t page = sysconf(_SC_PAGESIZE);
+		size_t size = num_elements * sizeof(T);
+		map_size = (size + page - 1) / page * page + page;
+		map = (uint8_t *) mmap(NULL, map_size, PROT_READ | PROT_WRITE,
+				MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		mprotect(map + map_size - page, page, PROT_NONE);
+		data = (T *) (map + map_size - page - size);
+		memcpy(data, src, size);
+	}
+
+	~guarded_image() {
+		munmap(map, map_size);
+	}
+
+	uint8_t * map;
+	size_t map_size;
+	T * data;
+
+};
+
+class WarpTest: public ::testing::Test {
+
+protected:
+
+	static const int cols = 160;
+	static const int rows = 120;
+
+	virtual void SetUp() {
+
+		srand(42);
+
+		intrinsics << 131.25, 79.875, 59.875;
+
+		pyramid_arena & arena = pyramid_arena::get();
+		intencity = arena.acquire<uint8_t>(cols * rows);
+		depth = arena.acquire<uint16_t>(cols * rows);
+		cloud_data = arena.acquire<float>(4 * cols * rows);
+		intencity_dx = arena.acquire<int16_t>(cols * rows);
+		intencity_dy = arena.acquire<int16_t>(cols * rows);
+
+		for (int i = 0; i < cols * rows; i++) {
+			intencity[i] = rand() % 256;
+			depth[i] = (rand() % 4 == 0) ? 0 : 500 + rand() % 3500;
+			intencity_dx[i] = rand() % 256 - 128;
+			intencity_dy[i] = rand() % 256 - 128;
+		}
+
+		build_cloud();
+
+		Eigen::Affine3f t(
+				Eigen::AngleAxisf(0.05, Eigen::Vector3f(1, 2, 3).normalized()));
+		t.translation() << 0.03, -0.02, 0.05;
+		transform = t.matrix();
+
+	}
+
+	virtual void TearDown() {
+		pyramid_arena & arena = pyramid_arena::get();
+		arena.release<uint8_t>(intencity, cols * rows);
+		arena.release<uint16_t>(depth, cols * rows);
+		arena.release<float>(cloud_data, 4 * cols * rows);
+		arena.release<int16_t>(intencity_dx, cols * rows);
+		arena.release<int16_t>(intencity_dy, cols * rows);
+	}
+
+	void build_cloud() {
+		cloud_map cloud(cloud_data, 4, cols * rows);
+		for (int i = 0; i < cols * rows; i++) {
+			int u = i % cols;
+			int v = i / cols;
+			float z = depth[i] / 1000.0;
+			if (z > 0) {
+				cloud.col(i) << (u - intrinsics[1]) * z / intrinsics[0], (v
+						- intrinsics[2]) * z / intrinsics[0], z, 1.0f;
+			} else {
+				cloud.col(i).setZero();
+			}
+		}
+	}
+
+	void run(warp_kernel kernel, std::vector<float> & intencity_warped,
+			std::vector<float> & depth_warped) {
+
+		intencity_warped.assign(cols * rows, -1);
+		depth_warped.assign(cols * rows, -1);
+
+		cloud_map cloud(cloud_data, 4, cols * rows);
+		parallel_warp w(intencity, depth, transform, cloud, intrinsics, cols,
+				rows, &intencity_warped[0], &depth_warped[0]);
+		w.kernel = kernel;
+
+		// Odd range bounds exercise the scalar tail of vector kernels.
+		w(tbb::blocked_range<int>(0, 13));
+		w(tbb::blocked_range<int>(13, cols * rows));
+	}
+
+	void compare(warp_kernel kernel) {
+
+		if (!is_warp_kernel_supported(kernel))
+			return;
+
+		std::vector<float> i_ref, d_ref, i_res, d_res;
+		run(WARP_KERNEL_SCALAR, i_ref, d_ref);
+		run(kernel, i_res, d_res);
+
+		int num_valid = 0;
+		for (int i = 0; i < cols * rows; i++) {
+			EXPECT_NEAR(i_ref[i], i_res[i], 1e-3) << "at " << i;
+			EXPECT_NEAR(d_ref[i], d_res[i], 1e-3) << "at " << i;
+			if (d_ref[i] > 0)
+				num_valid++;
+		}
+
+		EXPECT_GT(num_valid, cols * rows / 2);
+	}
+
+	Eigen::Vector3f intrinsics;
+	Eigen::Matrix<float, 4, 4, Eigen::ColMajor> transform;
+	uint8_t * intencity;
+	uint16_t * depth;
+	int16_t * intencity_dx;
+	int16_t * intencity_dy;
+	float * cloud_data;
+
+};
+
+TEST_F(WarpTest, sse4Test) {
+	compare(WARP_KERNEL_SSE4);
+}
+
+TEST_F(WarpTest, avx2Test) {
+	compare(WARP_KERNEL_AVX2);
+}
+
+TEST_F(WarpTest, nearDepthTest) {
+
+	// Closer than 5 cm the occlusion threshold is negative, all kernels
+	// have to accept every pixel with depth.
+	for (int i = 0; i < cols * rows; i++) {
+		if (depth[i] != 0)
+			depth[i] = 10 + rand() % 35;
+	}
+	build_cloud();
+	transform.setIdentity();
+
+	compare(WARP_KERNEL_SSE4);
+	compare(WARP_KERNEL_AVX2);
+}
+
+TEST_F(WarpTest, imageBoundsTest) {
+
+	// Shifts points by a fraction of a pixel towards the last row and
+	// column.
+	transform.setIdentity();
+	transform(0, 3) = 0.002;
+	transform(1, 3) = 0.002;
+
+	guarded_image<uint8_t> intencity_guarded(intencity, cols * rows);
+	guarded_image<uint16_t> depth_guarded(depth, cols * rows);
+
+	uint8_t * intencity_arena = intencity;
+	uint16_t * depth_arena = depth;
+	intencity = intencity_guarded.data;
+	depth = depth_guarded.data;
+
+	compare(WARP_KERNEL_SSE4);
+	compare(WARP_KERNEL_AVX2);
+
+	intencity = intencity_arena;
+	depth = depth_arena;
+}
+
+TEST_F(WarpTest, pointSetTest) {
+
+	cloud_map cloud(cloud_data, 4, cols * rows);
+
+	point_set ps;
+	ps.build(cloud, intencity, intencity_dx, intencity_dy);
+
+	std::vector<float> i_ref, d_ref;
+	run(WARP_KERNEL_SCALAR, i_ref, d_ref);
+
+	for (int k = 0; k < 3; k++) {
+
+		warp_kernel kernel = (warp_kernel) k;
+		if (!is_warp_kernel_supported(kernel))
+			continue;
+
+		std::vector<float> i_res(ps.size), d_res(ps.size);
+		parallel_warp w(intencity, depth, transform, ps, intrinsics, cols,
+				rows);
+		w.kernel = kernel;
+		w.warp_range(0, ps.size, &i_res[0], &d_res[0]);
+
+		for (int j = 0; j < ps.size; j++) {
+			EXPECT_NEAR(i_ref[ps.idx[j]], i_res[j], 1e-3) << "at " << j;
+			EXPECT_NEAR(d_ref[ps.idx[j]], d_res[j], 1e-3) << "at " << j;
+		}
+	}
+
+	EXPECT_EQ(ps.num_candidates, ps.size);
+
+	point_set sparse;
+	sparse.build(cloud, intencity, intencity_dx, intencity_dy, 1000);
+	EXPECT_EQ(1000, sparse.size);
+	EXPECT_EQ(ps.num_candidates, sparse.num_candidates);
+
+	int min_selected = 1 << 16;
+	for (int j = 0; j < sparse.size; j++) {
+		min_selected = std::min(min_selected,
+				std::abs(sparse.intencity_dx[j])
+						+ std::abs(sparse.intencity_dy[j]));
+		if (j > 0) {
+			EXPECT_LT(sparse.idx[j - 1], sparse.idx[j]);
+		}
+	}
+
+	int num_above = 0;
+	for (int j = 0; j < ps.size; j++) {
+		if (std::abs(ps.intencity_dx[j]) + std::abs(ps.intencity_dy[j])
+				> min_selected)
+			num_above++;
+	}
+	EXPECT_LE(num_above, 1000);
+
+	ps.release();
+	sparse.release();
+
+}
+
+TEST_F(WarpTest, fusedReduceTest) {
+
+	std::vector<float> intencity_warped, depth_warped;
+	run(get_best_warp_kernel(), intencity_warped, depth_warped);
+
+	cloud_map cloud(cloud_data, 4, cols * rows);
+
+	reduce_jacobian rj(intencity, intencity_dx, intencity_dy,
+			&intencity_warped[0], &depth_warped[0], intrinsics, cloud, cols,
+			rows);
+	rj(tbb::blocked_range<int>(0, cols * rows));
+
+	point_set ps;
+	ps.build(cloud, intencity, intencity_dx, intencity_dy);
+
+	parallel_warp w(intencity, depth, transform, ps, intrinsics, cols, rows);
+	reduce_warp_jacobian rwj(w, ps, intrinsics);
+	tbb::parallel_reduce(tbb::blocked_range<int>(0, ps.size), rwj);
+
+	EXPECT_EQ(rj.num_points, rwj.num_points);
+	EXPECT_NEAR(rj.error_sum, rwj.error_sum, 1e-4 * rj.error_sum);
+	EXPECT_LE((rj.JtJ - rwj.JtJ).array().abs().maxCoeff(),
+			1e-4 * rj.JtJ.array().abs().maxCoeff());
+	EXPECT_LE((rj.Jte - rwj.Jte).array().abs().maxCoeff(),
+			1e-4 * rj.Jte.array().abs().maxCoeff());
+
+	ps.release();
+
+}
+
+TEST_F(WarpTest, tiledRangeTest) {
+
+	std::vector<float> i_ref, d_ref;
+	run(get_best_warp_kernel(), i_ref, d_ref);
+
+	int tile_rows, tile_cols;
+	get_image_tile_size(tile_rows, tile_cols);
+
+	// Tiles that do not divide the image and split rows.
+	set_image_tile_size(3, 37);
+
+	cloud_map cloud(cloud_data, 4, cols * rows);
+	std::vector<float> i_res(cols * rows, -1), d_res(cols * rows, -1);
+	parallel_warp w(intencity, depth, transform, cloud, intrinsics, cols,
+			rows, &i_res[0], &d_res[0]);
+	tbb::parallel_for(get_image_range(cols, rows), w);
+
+	EXPECT_TRUE(i_ref == i_res);
+	EXPECT_TRUE(d_ref == d_res);
+
+	set_image_tile_size(tile_rows, tile_cols);
+
+}
+
+TEST_F(WarpTest, inverseCompositionalTest) {
+
+	pyramid_arena & arena = pyramid_arena::get();
+	cloud_map cloud(cloud_data, 4, cols * rows);
+
+	point_set ps;
+	ps.build(cloud, intencity, intencity_dx, intencity_dy);
+
+	jacobian_map jacobians(arena.acquire<float>(6 * ps.size), 6, ps.size);
+
+	parallel_jacobian pj(ps, intrinsics, jacobians);
+	tbb::parallel_for(tbb::blocked_range<int>(0, ps.size), pj);
+
+	// With every point marked as warped the full reduction gives the
+	// hessian of the precomputed jacobians.
+	std::vector<float> ones(cols * rows, 1);
+	reduce_jacobian rj(intencity, intencity_dx, intencity_dy, &ones[0],
+			&ones[0], intrinsics, cloud, cols, rows);
+	rj(tbb::blocked_range<int>(0, cols * rows));
+
+	Sophus::Matrix6f JtJ = jacobians * jacobians.transpose();
+
+	EXPECT_EQ(rj.num_points, ps.size);
+	EXPECT_LE((rj.JtJ - JtJ).array().abs().maxCoeff(),
+			1e-4 * rj.JtJ.array().abs().maxCoeff());
+
+	parallel_warp w(intencity, depth, transform, ps, intrinsics, cols, rows);
+
+	reduce_warp_jacobian rwj(w, ps, intrinsics);
+	tbb::parallel_reduce(tbb::blocked_range<int>(0, ps.size), rwj);
+
+	reduce_warp_residual rwr(w, ps, jacobians);
+	tbb::parallel_reduce(tbb::blocked_range<int>(0, ps.size), rwr);
+
+	EXPECT_EQ(rwj.num_points, rwr.num_points);
+	EXPECT_LT(rwr.num_points, ps.size);
+	EXPECT_LE((rwj.JtJ - rwr.JtJ).array().abs().maxCoeff(),
+			1e-4 * rwj.JtJ.array().abs().maxCoeff());
+	EXPECT_LE((rwj.Jte - rwr.Jte).array().abs().maxCoeff(),
+			1e-4 * rwj.Jte.array().abs().maxCoeff());
+
+	arena.release<float>(jacobians.data(), jacobians.size());
+	ps.release();
+
+}
+
+int main(int argc, char **argv) {
+	testing::InitGoogleTest(&argc, argv);
+	return RUN_ALL_TESTS();
+}
@@ -0,0 +1,68 @@
+#ifndef BINARY_FEATURES_H_
+#define BINARY_FEATURES_H_
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/features2d/features2d.hpp>
+#include <vector>
+#include <string>
+#include <stdint.h>
+
+// Features used to match keyframes. SURF gives 128 float descriptors
+// matched with FLANN, ORB gives 32 byte binary descriptors matched with
+// hamming_matcher, which is several times cheaper to detect and match.
+enum feature_type {
+	FEATURE_SURF, FEATURE_ORB
+};
+
+// Parses "surf" or "orb", returns false for anything else.
+bool parse_feature_type(const std::string & name, feature_type & type);
+
+// Keeps the strongest max_keypoints keypoints spread over a grid of
+// grid_rows x grid_cols cells of an image of size. Each cell keeps its
+// share first and what is left over goes to the strongest of the rest, so
+// textured parts of the image do not take all keypoints.
+void retain_best_in_grid(std::vector<cv::KeyPoint> & keypoints,
+		const cv::Size & size, int max_keypoints, int grid_rows = 4,
+		int grid_cols = 4);
+
+// Keypoints kept per keyframe.
+static const int max_keypoints = 400;
+
+// Detects keypoints of type in gray where depth is known and describes at
+// most max_keypoints of them, ORB ones spread over a grid. The extractor
+// drops keypoints too close to the border, ORB ones often, so keypoints
+// holds the described ones. Saved keyframe features store features_version,
+// it has to change with these settings.
+void detect_features(feature_type type, const cv::Mat & gray,
+		const cv::Mat & depth, std::vector<cv::KeyPoint> & keypoints,
+		cv::Mat & descriptors);
+
+// Brute force matcher for binary descriptors, one CV_8U row per keypoint.
+// Distances are popcounts of the xor of two rows, 16 bytes at a time with
+// SSSE3 or NEON. The best match of a query row is kept if its distance is
+// below ratio times the second best one and, with cross_check, if the
+// query row is also the best match of the train row.
+class hamming_matcher {
+
+public:
+
+	hamming_matcher(float ratio = 0.8f, bool cross_check = true);
+
+	void match(const cv::Mat & query, const cv::Mat & train,
+			std::vector<cv::DMatch> & matches) const;
+
+	static int distance(const uint8_t * a, const uint8_t * b, int size);
+
+protected:
+
+	float ratio;
+	bool cross_check;
+
+};
+
+// Matches descriptors of the same type, binary ones with hamming_matcher
+// and float ones with FLANN. Descriptors of different types do not match.
+void match_descriptors(const cv::Mat & query, const cv::Mat & train,
+		std::vector<cv::DMatch> & matches);
+
+#endif /* BINARY_FEATURES_H_ */
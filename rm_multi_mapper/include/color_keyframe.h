@@ -3,12 +3,14 @@
 
 #include <keyframe.h>
 #include <boost/shared_ptr.hpp>
+#include <tbb/spin_mutex.h>
 #include <opencv2/core/core.hpp>
 #include <sophus/se3.hpp>
 #include <pcl_ros/point_cloud.h>
 #include <pcl/point_types.h>
 
 #include <rm_localization/Keyframe.h>
+#include <binary_features.h>
 
 class color_keyframe: public keyframe {
 
@@ -16,6 +18,19 @@ public:
 
 	typedef boost::shared_ptr<color_keyframe> Ptr;
 
+	// Keypoints with valid depth, their points in the camera frame and
+	// descriptors, used to match keyframes. The points are computed with
+	// intrinsics and rebuilt when the intrinsics of the keyframe change.
+	struct features {
+		typedef boost::shared_ptr<const features> ConstPtr;
+
+		feature_type type;
+		std::vector<cv::KeyPoint> keypoints;
+		pcl::PointCloud<pcl::PointXYZ> keypoints3d;
+		cv::Mat descriptors;
+		Eigen::Vector3f intrinsics;
+	};
+
 	color_keyframe(const cv::Mat & rgb, const cv::Mat & gray,
 			const cv::Mat & depth, const Sophus::SE3f & position,
 			const Eigen::Vector3f & intrinsics, int max_level = 3);
@@ -33,21 +48,43 @@ public:
 		return rgb;
 	}
 
-	inline Eigen::Matrix<float, 4, Eigen::Dynamic, Eigen::ColMajor> & get_cloud(
-			int level) {
-		return clouds[level];
-	}
-
 	inline Eigen::Vector3f get_centroid() {
 		return position * centroid;
 	}
 
 	static Ptr from_msg(const rm_localization::Keyframe::ConstPtr & k);
 
+	// Computed on first use without holding a lock, so TBB tasks never wait
+	// on each other. Concurrent callers may compute them at the same time,
+	// the first result published is kept.
+	features::ConstPtr get_features();
+
+	// Features of another type are computed again on next use.
+	void set_feature_type(feature_type type);
+
+	inline feature_type get_feature_type() {
+		return features_type;
+	}
+
+	// Computes the features if needed. load_features returns false if there
+	// is no file or it was written with another feature type or other
+	// detector settings, they are then computed on first use.
+	void save_features(const std::string & filename);
+	bool load_features(const std::string & filename);
+
 protected:
+
+	void compute_features(features & f);
+	void compute_keypoints3d(features & f);
+
 	cv::Mat rgb;
 	Eigen::Vector3f centroid;
 
+	// Guards features_type and cached_features, never held while computing.
+	tbb::spin_mutex features_mutex;
+	feature_type features_type;
+	features::ConstPtr cached_features;
+
 };
 
 #endif /* COLOR_KEYFRAME_H_ */
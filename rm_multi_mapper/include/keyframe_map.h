@@ -10,17 +10,30 @@
 
 #include <tbb/concurrent_vector.h>
 #include <tbb/parallel_reduce.h>
+#include <tbb/task_group.h>
 
 #include <rm_localization/Keyframe.h>
 #include <reduce_measurement_g2o.h>
 //#include <reduce_measurement_g2o_dist.h>
+#include <overlap_index.h>
+#include <panorama_solver.h>
+#include <boost/shared_ptr.hpp>
+#include <map>
 
 class keyframe_map {
 public:
 
 	keyframe_map();
+	~keyframe_map();
 
 	void add_frame(const rm_localization::Keyframe::ConstPtr & k);
+
+	// Features of the frames and of frames added later, SURF by default.
+	// Both maps of find_transform have to use the same type.
+	void set_feature_type(feature_type type);
+
+	// Largest update of one iteration, negative if the normal equations
+	// could not be solved and the frames were left as they were.
 	float optimize_panorama(int level);
 	float optimize_slam(int skip_n = 1);
 	void align_z_axis();
@@ -39,8 +52,26 @@ public:
 
 	void add_keypoints();
 
+	// Pairs (i, j) with i < j of frames whose rotations differ by less than
+	// max_angle and centers by less than max_distance, see overlap_index.
+	void get_overlapping_pairs(float max_angle, float max_distance,
+			tbb::concurrent_vector<std::pair<int, int> > & pairs);
+
 	tbb::concurrent_vector<color_keyframe::Ptr> frames;
 	tbb::concurrent_vector<int> idx;
+
+protected:
+
+	// One index per thresholds, kept between optimizer iterations so only
+	// frames that moved to another cell are rehashed.
+	std::map<std::pair<float, float>, boost::shared_ptr<overlap_index> > overlap_indices;
+
+	// Keeps the symbolic factorization between panorama iterations.
+	panorama_solver panorama;
+
+	// Features of added frames that are still being computed.
+	tbb::task_group feature_tasks;
+	feature_type features_type;
 };
 
 #endif /* KEYFRAME_MAP_H_ */
@@ -0,0 +1,56 @@
+#ifndef OVERLAP_INDEX_H_
+#define OVERLAP_INDEX_H_
+
+#include <vector>
+#include <utility>
+#include <Eigen/StdVector>
+#include <sophus/se3.hpp>
+#include <cell_hash.h>
+
+// Keyframe poses hashed into voxels by camera center, to find the pairs
+// that may overlap without comparing every pair. Two keyframes overlap when
+// their rotations differ by less than max_angle and their centers by less
+// than max_distance, so overlapping keyframes are in neighbouring voxels.
+// Their viewing directions are also closer than the chord of max_angle,
+// which is checked before the rotation angle. max_distance <= 0 disables
+// the distance test, for panoramas taken from one point, and the viewing
+// directions are hashed instead.
+class overlap_index {
+
+public:
+
+	overlap_index(float max_angle, float max_distance = 0);
+
+	// Keyframe indices are the ones of the keyframe vector. Keyframes that
+	// stay in their cell only update the stored pose.
+	void update(int idx, const Sophus::SE3f & pos);
+	void clear();
+
+	inline size_t size() const {
+		return positions.size();
+	}
+
+	// Overlapping pairs (i, j) with i < j, sorted.
+	void get_pairs(std::vector<std::pair<int, int> > & pairs) const;
+
+	bool overlap(int i, int j) const;
+
+protected:
+
+	Eigen::Vector3i get_cell(const Sophus::SE3f & pos) const;
+
+	float max_angle;
+	float max_distance;
+	// Largest distance of the viewing directions of overlapping keyframes.
+	float max_chord;
+	// Cells are max_distance wide, or max_chord wide when the distance is
+	// not tested.
+	float cell_size;
+
+	cell_hash cells;
+	std::vector<Sophus::SE3f, Eigen::aligned_allocator<Sophus::SE3f> > positions;
+	std::vector<Eigen::Vector3f> directions;
+
+};
+
+#endif /* OVERLAP_INDEX_H_ */
@@ -0,0 +1,52 @@
+#ifndef PANORAMA_SOLVER_H_
+#define PANORAMA_SOLVER_H_
+
+#include <reduce_jacobian_rgb.h>
+#include <Eigen/Dense>
+#include <Eigen/Sparse>
+#include <Eigen/CholmodSupport>
+#include <vector>
+
+// Solves the arrowhead normal equations of reduce_jacobian_rgb. The sparse
+// rotation part R is factorized and the intrinsics k are solved from the
+// Schur complement
+//
+//   (K - C^T R^-1 C) dk = bk - C^T R^-1 br,   R dr = br - C dk
+//
+// where C couples rotations with the intrinsics. The symbolic factorization
+// of R is kept while the overlapping pairs stay the same, which they mostly
+// do between iterations. Frames that overlap with nothing or only with
+// frames not connected to the fixed ones leave R singular, its diagonal is
+// damped so that it stays positive definite.
+class panorama_solver {
+
+public:
+
+	panorama_solver();
+
+	// Solution of JtJ x = Jte with the rotation of the first skip_n frames
+	// held fixed, zero in update. Returns false if R can not be factorized.
+	bool solve(const reduce_jacobian_rgb & rj, int skip_n,
+			Eigen::VectorXf & update);
+
+	inline int get_num_analyzed() const {
+		return num_analyzed;
+	}
+
+	// Fraction of the mean diagonal entry of R added to its diagonal.
+	static const double damping;
+
+protected:
+
+	typedef Eigen::CholmodSupernodalLLT<Eigen::SparseMatrix<double> > sparse_solver;
+
+	sparse_solver solver;
+
+	// Sorted blocks of the last analyzed R and its frame count.
+	std::vector<int64_t> pattern;
+	int pattern_size;
+	int num_analyzed;
+
+};
+
+#endif /* PANORAMA_SOLVER_H_ */
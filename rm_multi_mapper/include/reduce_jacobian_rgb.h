@@ -11,10 +11,23 @@
 #include <color_keyframe.h>
 #include <tbb/concurrent_vector.h>
 #include <tbb/parallel_reduce.h>
+#include <boost/unordered_map.hpp>
 
+// Normal equations of the panorama, rotations of all frames followed by the
+// intrinsics shared by them. Rotations are only coupled through overlapping
+// pairs, so that part is kept as the nonzero 3x3 blocks of its upper
+// triangle, while every rotation is coupled with the intrinsics. Copies made
+// by parallel_reduce only allocate memory linear in the number of frames.
 struct reduce_jacobian_rgb {
 
-	Eigen::MatrixXf JtJ;
+	// Block (i, j) with i <= j is stored under key i * size + j.
+	typedef boost::unordered_map<int64_t, Eigen::Matrix3f> block_map;
+
+	block_map JtJ;
+	// Rotation and intrinsics blocks, column i * 3 for frame i.
+	Eigen::Matrix<float, 3, Eigen::Dynamic> JtJ_intrinsics_rotations;
+	Eigen::Matrix3f JtJ_intrinsics;
+	// Rotations followed by the intrinsics.
 	Eigen::VectorXf Jte;
 	int size;
 	int subsample_level;
@@ -31,6 +44,8 @@ struct reduce_jacobian_rgb {
 			Eigen::Matrix<float, 9, 3> & Ji, Eigen::Matrix<float, 9, 3> & Jj,
 			Eigen::Matrix<float, 9, 3> & Jk);
 
+	void add_block(int i, int j, const Eigen::Matrix3f & b);
+
 	void operator()(
 			const tbb::blocked_range<
 					tbb::concurrent_vector<std::pair<int, int> >::iterator>& r);
@@ -19,9 +19,20 @@
 #include <pcl/registration/icp.h>
 #include <pcl/registration/transformation_estimation_point_to_plane.h>
 
+#include <boost/unordered_map.hpp>
+#include <Eigen/Sparse>
+
+// Normal equations of the pose graph. JtJ is kept as the nonzero 6x6 blocks
+// of its upper triangle, so memory grows with the number of measurements.
+// Every reducer copy accumulates its own blocks, join adds them up.
 struct reduce_jacobian_slam_3d {
 
-	Eigen::MatrixXf JtJ;
+	// Block (i, j) with i <= j is stored under key i * size + j.
+	typedef boost::unordered_map<int64_t, Sophus::Matrix6f,
+			boost::hash<int64_t>, std::equal_to<int64_t>,
+			Eigen::aligned_allocator<std::pair<const int64_t, Sophus::Matrix6f> > > block_map;
+
+	block_map JtJ;
 	Eigen::VectorXf Jte;
 	int size;
 
@@ -39,6 +50,19 @@ struct reduce_jacobian_slam_3d {
 	void compute_frame_jacobian(const Eigen::Matrix4f & Mwi,
 			const Eigen::Matrix4f & Miw, Eigen::Matrix<float, 6, 6> & Ji);
 
+	void add_block(int i, int j, const Sophus::Matrix6f & b);
+
+	// Fraction of the mean diagonal entry of JtJ added to its diagonal.
+	static const double damping;
+
+	// Sparse JtJ and Jte of frames from skip_n on, the first skip_n frames
+	// are held fixed. Frames without measurements or in a component of the
+	// graph that is not connected to the fixed frames leave JtJ singular,
+	// the diagonal is damped so that it stays positive definite. Their
+	// update along the unconstrained directions is zero.
+	void get_system(int skip_n, Eigen::SparseMatrix<double> & A,
+			Eigen::VectorXd & b) const;
+
 	void add_icp_measurement(int i, int j);
 	void add_rgbd_measurement(int i, int j);
 	void add_floor_measurement(int i);
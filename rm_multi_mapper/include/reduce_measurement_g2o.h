@@ -59,26 +59,12 @@ struct reduce_measurement_g2o {
 
 	void join(reduce_measurement_g2o& rb);
 
-	cv::Ptr<cv::FeatureDetector> fd;
-	cv::Ptr<cv::DescriptorExtractor> de;
-	cv::Ptr<cv::DescriptorMatcher> dm;
-
-	void init_feature_detector();
-
 	bool estimate_transform_ransac(const pcl::PointCloud<pcl::PointXYZ> & src,
 			const pcl::PointCloud<pcl::PointXYZ> & dst,
 			const std::vector<cv::DMatch> matches, int num_iter,
 			float distance2_threshold, int min_num_inliers,
 			Eigen::Affine3f & trans, std::vector<bool> & inliers);
 
-	void compute_features(const cv::Mat & rgb, const cv::Mat & depth,
-			const Eigen::Vector3f & intrinsics,
-			cv::Ptr<cv::FeatureDetector> & fd,
-			cv::Ptr<cv::DescriptorExtractor> & de,
-			std::vector<cv::KeyPoint> & filtered_keypoints,
-			pcl::PointCloud<pcl::PointXYZ> & keypoints3d,
-			cv::Mat & descriptors);
-
 	bool find_transform(const color_keyframe::Ptr & fi,
 			const color_keyframe::Ptr & fj, Sophus::SE3f & t);
 
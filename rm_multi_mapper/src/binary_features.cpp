@@ -0,0 +1,254 @@
+#include <binary_features.h>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <opencv2/nonfree/features2d.hpp>
+#include <algorithm>
+#include <limits>
+#include <cstring>
+
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#elif defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+bool parse_feature_type(const std::string & name, feature_type & type) {
+	if (name == "surf") {
+		type = FEATURE_SURF;
+	} else if (name == "orb") {
+		type = FEATURE_ORB;
+	} else {
+		return false;
+	}
+	return true;
+}
+
+static bool stronger(const cv::KeyPoint & a, const cv::KeyPoint & b) {
+	return a.response > b.response;
+}
+
+void retain_best_in_grid(std::vector<cv::KeyPoint> & keypoints,
+		const cv::Size & size, int max_keypoints, int grid_rows,
+		int grid_cols) {
+
+	if ((int) keypoints.size() <= max_keypoints)
+		return;
+
+	int num_cells = grid_rows * grid_cols;
+	std::vector<std::vector<cv::KeyPoint> > cells(num_cells);
+
+	for (size_t i = 0; i < keypoints.size(); i++) {
+		int r = std::min<int>(keypoints[i].pt.y * grid_rows / size.height,
+				grid_rows - 1);
+		int c = std::min<int>(keypoints[i].pt.x * grid_cols / size.width,
+				grid_cols - 1);
+		cells[std::max(r, 0) * grid_cols + std::max(c, 0)].push_back(
+				keypoints[i]);
+	}
+
+	int per_cell = max_keypoints / num_cells;
+
+	std::vector<cv::KeyPoint> retained, rest;
+	retained.reserve(max_keypoints);
+
+	for (int i = 0; i < num_cells; i++) {
+		std::vector<cv::KeyPoint> & cell = cells[i];
+		std::sort(cell.begin(), cell.end(), stronger);
+
+		size_t n = std::min<size_t>(cell.size(), per_cell);
+		retained.insert(retained.end(), cell.begin(), cell.begin() + n);
+		rest.insert(rest.end(), cell.begin() + n, cell.end());
+	}
+
+	size_t n = std::min<size_t>(rest.size(), max_keypoints - retained.size());
+	std::partial_sort(rest.begin(), rest.begin() + n, rest.end(), stronger);
+	retained.insert(retained.end(), rest.begin(), rest.begin() + n);
+
+	keypoints.swap(retained);
+}
+
+static void retain_with_depth(const cv::Mat & depth,
+		const std::vector<cv::KeyPoint> & keypoints,
+		std::vector<cv::KeyPoint> & filtered_keypoints) {
+	filtered_keypoints.clear();
+	for (size_t i = 0; i < keypoints.size(); i++) {
+		if (depth.at<unsigned short>(keypoints[i].pt) != 0)
+			filtered_keypoints.push_back(keypoints[i]);
+	}
+}
+
+void detect_features(feature_type type, const cv::Mat & gray,
+		const cv::Mat & depth, std::vector<cv::KeyPoint> & keypoints,
+		cv::Mat & descriptors) {
+
+	cv::Mat mask(depth.size(), CV_8UC1);
+	depth.convertTo(mask, CV_8U);
+
+	std::vector<cv::KeyPoint> detected;
+
+	if (type == FEATURE_ORB) {
+
+		// ORB smooths the image itself. More keypoints than kept are
+		// detected so that weakly textured cells get some.
+		cv::ORB orb(4 * max_keypoints);
+
+		orb.detect(gray, detected, mask);
+		retain_best_in_grid(detected, gray.size(), max_keypoints);
+		retain_with_depth(depth, detected, keypoints);
+
+		orb.compute(gray, keypoints, descriptors);
+
+	} else {
+
+		// Detectors keep their thresholds as state, one per call.
+		cv::SurfFeatureDetector fd(400, 8, 2, true, true);
+		cv::SurfDescriptorExtractor de(400, 8, 2, true, true);
+
+		cv::Mat blurred;
+		cv::GaussianBlur(gray, blurred, cv::Size(3, 3), 3);
+
+		fd.detect(blurred, detected, mask);
+
+		for (int i = 0; i < 5 && detected.size() < 300; i++) {
+			fd.hessianThreshold /= 2;
+			detected.clear();
+			fd.detect(blurred, detected, mask);
+		}
+
+		if (detected.size() > (size_t) max_keypoints)
+			detected.resize(max_keypoints);
+
+		retain_with_depth(depth, detected, keypoints);
+
+		de.compute(blurred, keypoints, descriptors);
+	}
+}
+
+hamming_matcher::hamming_matcher(float ratio, bool cross_check) :
+		ratio(ratio), cross_check(cross_check) {
+}
+
+int hamming_matcher::distance(const uint8_t * a, const uint8_t * b,
+		int size) {
+
+	int i = 0, res = 0;
+
+#if defined(__SSSE3__)
+	// Bits of each nibble are counted with a table lookup, the byte counts
+	// are summed by sad against zero.
+	const __m128i table = _mm_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3,
+			2, 3, 3, 4);
+	const __m128i low_nibbles = _mm_set1_epi8(0x0f);
+	__m128i sum = _mm_setzero_si128();
+
+	for (; i + 16 <= size; i += 16) {
+		__m128i x = _mm_xor_si128(_mm_loadu_si128((const __m128i *) (a + i)),
+				_mm_loadu_si128((const __m128i *) (b + i)));
+		__m128i lo = _mm_and_si128(x, low_nibbles);
+		__m128i hi = _mm_and_si128(_mm_srli_epi16(x, 4), low_nibbles);
+		__m128i count = _mm_add_epi8(_mm_shuffle_epi8(table, lo),
+				_mm_shuffle_epi8(table, hi));
+		sum = _mm_add_epi64(sum, _mm_sad_epu8(count, _mm_setzero_si128()));
+	}
+
+	res = _mm_cvtsi128_si32(sum) + _mm_cvtsi128_si32(_mm_srli_si128(sum, 8));
+#elif defined(__ARM_NEON__)
+	uint64x2_t sum = vdupq_n_u64(0);
+
+	for (; i + 16 <= size; i += 16) {
+		uint8x16_t count = vcntq_u8(veorq_u8(vld1q_u8(a + i), vld1q_u8(b + i)));
+		sum = vaddq_u64(sum, vpaddlq_u32(vpaddlq_u16(vpaddlq_u8(count))));
+	}
+
+	res = vgetq_lane_u64(sum, 0) + vgetq_lane_u64(sum, 1);
+#endif
+
+	for (; i + 8 <= size; i += 8) {
+		uint64_t x, y;
+		std::memcpy(&x, a + i, 8);
+		std::memcpy(&y, b + i, 8);
+		res += __builtin_popcountll(x ^ y);
+	}
+
+	for (; i < size; i++) {
+		res += __builtin_popcount(a[i] ^ b[i]);
+	}
+
+	return res;
+}
+
+void hamming_matcher::match(const cv::Mat & query, const cv::Mat & train,
+		std::vector<cv::DMatch> & matches) const {
+
+	matches.clear();
+
+	if (query.empty() || train.empty())
+		return;
+
+	CV_Assert(
+			query.type() == CV_8U && train.type() == CV_8U && query.cols == train.cols);
+
+	int size = query.cols;
+
+	// Best query row of every train row, for the cross check.
+	std::vector<int> train_best(train.rows, std::numeric_limits<int>::max());
+	std::vector<int> train_best_idx(train.rows, -1);
+
+	std::vector<cv::DMatch> candidates;
+	candidates.reserve(query.rows);
+
+	for (int q = 0; q < query.rows; q++) {
+		const uint8_t * qd = query.ptr<uint8_t>(q);
+
+		int best = std::numeric_limits<int>::max();
+		int second = std::numeric_limits<int>::max();
+		int best_idx = -1;
+
+		for (int t = 0; t < train.rows; t++) {
+			int d = distance(qd, train.ptr<uint8_t>(t), size);
+
+			if (d < best) {
+				second = best;
+				best = d;
+				best_idx = t;
+			} else if (d < second) {
+				second = d;
+			}
+
+			if (d < train_best[t]) {
+				train_best[t] = d;
+				train_best_idx[t] = q;
+			}
+		}
+
+		// With one train row there is no second best to compare with.
+		if (train.rows > 1 && best >= ratio * second)
+			continue;
+
+		candidates.push_back(cv::DMatch(q, best_idx, best));
+	}
+
+	for (size_t i = 0; i < candidates.size(); i++) {
+		if (!cross_check
+				|| train_best_idx[candidates[i].trainIdx]
+						== candidates[i].queryIdx)
+			matches.push_back(candidates[i]);
+	}
+}
+
+void match_descriptors(const cv::Mat & query, const cv::Mat & train,
+		std::vector<cv::DMatch> & matches) {
+
+	matches.clear();
+
+	if (query.empty() || train.empty() || query.type() != train.type()
+			|| query.cols != train.cols)
+		return;
+
+	if (query.type() == CV_8U) {
+		hamming_matcher dm;
+		dm.match(query, train, matches);
+	} else {
+		cv::FlannBasedMatcher dm;
+		dm.match(query, train, matches);
+	}
+}
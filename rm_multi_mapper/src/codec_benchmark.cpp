@@ -0,0 +1,108 @@
+/*
+ * codec_benchmark.cpp
+ *
+ * Compares size and encode/decode time of keyframe image codecs on the
+ * keyframes of a saved map.
+ *
+ * Usage: codec_benchmark <map_dir>
+ */
+
+#include <keyframe_map.h>
+#include <keyframe_codec.h>
+#include <tbb/tick_count.h>
+#include <cstdio>
+
+struct codec_stats {
+	const char * name;
+	uint8_t codec;
+	size_t raw_bytes;
+	size_t bytes;
+	double encode_time;
+	double decode_time;
+	int num_failed;
+};
+
+static void run(codec_stats & s, const cv::Mat & image) {
+
+	std::vector<uint8_t> data;
+
+	tbb::tick_count t0 = tbb::tick_count::now();
+	bool encoded = encode_image(image, s.codec, data);
+	tbb::tick_count t1 = tbb::tick_count::now();
+
+	if (!encoded) {
+		s.num_failed++;
+		return;
+	}
+
+	cv::Mat res = decode_image(data, s.codec);
+	tbb::tick_count t2 = tbb::tick_count::now();
+
+	if (res.empty()) {
+		s.num_failed++;
+		return;
+	}
+
+	s.raw_bytes += image.rows * image.cols * image.elemSize();
+	s.bytes += data.size();
+	s.encode_time += (t1 - t0).seconds();
+	s.decode_time += (t2 - t1).seconds();
+}
+
+// Sizes and times only count the keyframes a codec encoded and decoded,
+// failures are reported separately.
+static void print(const char * image, const codec_stats * stats, int n,
+		int num_frames) {
+
+	for (int i = 0; i < n; i++) {
+		const codec_stats & s = stats[i];
+		int num_encoded = num_frames - s.num_failed;
+
+		if (num_encoded == 0) {
+			printf("%-6s %-10s failed on all %d keyframes\n", image, s.name,
+					num_frames);
+			continue;
+		}
+
+		printf("%-6s %-10s %12zu bytes  ratio %5.2f  encode %7.2f ms  "
+				"decode %7.2f ms  failed %d\n", image, s.name, s.bytes,
+				(double) s.raw_bytes / s.bytes,
+				1000 * s.encode_time / num_encoded,
+				1000 * s.decode_time / num_encoded, s.num_failed);
+	}
+}
+
+int main(int argc, char **argv) {
+
+	if (argc < 2) {
+		std::cerr << "Usage: " << argv[0] << " <map_dir>" << std::endl;
+		return 1;
+	}
+
+	keyframe_map map;
+	map.load(argv[1]);
+
+	typedef rm_localization::Keyframe msg;
+
+	codec_stats rgb_stats[] = { { "png", msg::CODEC_PNG }, { "raw",
+			msg::CODEC_RAW }, { "jpeg", msg::CODEC_JPEG } };
+	codec_stats depth_stats[] = { { "png", msg::CODEC_PNG }, { "raw",
+			msg::CODEC_RAW }, { "depth_rle", msg::CODEC_DEPTH_RLE } };
+
+	for (size_t i = 0; i < map.frames.size(); i++) {
+		cv::Mat rgb = map.frames[i]->get_rgb();
+		cv::Mat depth = map.frames[i]->get_d(0);
+
+		for (int j = 0; j < 3; j++) {
+			run(rgb_stats[j], rgb);
+			run(depth_stats[j], depth);
+		}
+	}
+
+	int num_frames = map.frames.size();
+	printf("%d keyframes, times are per encoded keyframe\n", num_frames);
+	print("rgb", rgb_stats, 3, num_frames);
+	print("depth", depth_stats, 3, num_frames);
+
+	return 0;
+}
@@ -4,17 +4,27 @@
 #include <pcl/common/transforms.h>
 #include <opencv2/imgproc/imgproc.hpp>
 #include <opencv2/highgui/highgui.hpp>
+#include <opencv2/features2d/features2d.hpp>
+#include <boost/filesystem.hpp>
+
+// Stored with saved features, increase when the settings of
+// detect_features change.
+static const int features_version = 2;
 
 color_keyframe::color_keyframe(const cv::Mat & rgb, const cv::Mat & gray,
 		const cv::Mat & depth, const Sophus::SE3f & position,
 		const Eigen::Vector3f & intrinsics, int max_level) :
-		keyframe(gray, depth, position, intrinsics, max_level), rgb(rgb) {
+		keyframe(gray, depth, position, intrinsics, max_level), rgb(rgb), features_type(
+				FEATURE_SURF) {
 
 	centroid.setZero();
 	int num_points = 0;
 
-	for (int i = 0; i < clouds[2].cols(); i++) {
-		Eigen::Vector4f vec = clouds[2].col(i);
+	geometry::Ptr g = get_geometry();
+	const cloud_map & cloud = g->clouds[2];
+
+	for (int i = 0; i < cloud.cols(); i++) {
+		Eigen::Vector4f vec = cloud.col(i);
 		if (vec(3) > 0) {
 			centroid += vec.segment<3>(0);
 			num_points++;
@@ -31,12 +41,18 @@ pcl::PointCloud<pcl::PointXYZ>::Ptr color_keyframe::get_pointcloud(
 	pcl::PointCloud<pcl::PointXYZ>::Ptr cloud(
 			new pcl::PointCloud<pcl::PointXYZ>);
 
+	// Held for the whole loop, update_intrinsics may replace it meanwhile.
+	// Evicted keyframes have no geometry.
+	geometry::Ptr g = get_geometry();
+	if (!g)
+		return cloud;
+
 	Eigen::Matrix<float, 4, 4, Eigen::ColMajor> transform = position.matrix();
 
 	for (int v = 0; v < rows; v += subsample) {
 		for (int u = 0; u < cols; u += subsample) {
 			int i = v * cols + u;
-			Eigen::Vector4f vec = clouds[0].col(i);
+			Eigen::Vector4f vec = g->clouds[0].col(i);
 			if (vec(3) > 0) {
 
 				pcl::PointXYZ p;
@@ -83,12 +99,16 @@ pcl::PointCloud<pcl::PointXYZRGB>::Ptr color_keyframe::get_colored_pointcloud(
 	pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud(
 			new pcl::PointCloud<pcl::PointXYZRGB>);
 
+	geometry::Ptr g = get_geometry();
+	if (!g)
+		return cloud;
+
 	Eigen::Matrix<float, 4, 4, Eigen::ColMajor> transform = position.matrix();
 
 	for (int v = 0; v < rows; v += subsample) {
 		for (int u = 0; u < cols; u += subsample) {
 			int i = v * cols + u;
-			Eigen::Vector4f vec = clouds[0].col(i);
+			Eigen::Vector4f vec = g->clouds[0].col(i);
 			if (vec(3) > 0 && vec(2) < 4) {
 
 				cv::Vec3b color = rgb.at<cv::Vec3b>(v, u);
@@ -112,8 +132,8 @@ color_keyframe::Ptr color_keyframe::from_msg(
 
 	cv::Mat rgb, gray, depth;
 
-	rgb = cv::imdecode(k->rgb_png_data, CV_LOAD_IMAGE_UNCHANGED);
-	depth = cv::imdecode(k->depth_png_data, CV_LOAD_IMAGE_UNCHANGED);
+	rgb = decode_image(k->rgb_png_data, k->rgb_codec);
+	depth = decode_image(k->depth_png_data, k->depth_codec);
 	cv::cvtColor(rgb, gray, CV_BGR2GRAY);
 
 	Eigen::Quaternionf orientation;
@@ -138,3 +158,108 @@ color_keyframe::Ptr color_keyframe::from_msg(
 	return res;
 
 }
+
+color_keyframe::features::ConstPtr color_keyframe::get_features() {
+
+	features::ConstPtr cached;
+	feature_type type;
+	{
+		tbb::spin_mutex::scoped_lock lock(features_mutex);
+		cached = cached_features;
+		type = features_type;
+	}
+
+	if (cached && cached->intrinsics == get_intrinsics(0))
+		return cached;
+
+	boost::shared_ptr<features> f;
+	if (cached) {
+		// Keypoints and descriptors do not depend on the intrinsics.
+		f.reset(new features(*cached));
+		compute_keypoints3d(*f);
+	} else {
+		f.reset(new features);
+		f->type = type;
+		compute_features(*f);
+	}
+
+	tbb::spin_mutex::scoped_lock lock(features_mutex);
+
+	// Published only if nothing changed since the snapshot. Otherwise the
+	// features of another caller are used if they match ours.
+	if (cached_features == cached && features_type == type) {
+		cached_features = f;
+	} else if (cached_features && cached_features->type == f->type
+			&& cached_features->intrinsics == f->intrinsics) {
+		return cached_features;
+	}
+
+	return f;
+}
+
+void color_keyframe::set_feature_type(feature_type type) {
+
+	tbb::spin_mutex::scoped_lock lock(features_mutex);
+
+	if (type != features_type) {
+		features_type = type;
+		cached_features.reset();
+	}
+}
+
+void color_keyframe::save_features(const std::string & filename) {
+
+	features::ConstPtr f = get_features();
+
+	cv::FileStorage fs(filename, cv::FileStorage::WRITE);
+	fs << "version" << features_version;
+	fs << "type" << (int) f->type;
+	cv::write(fs, "keypoints", f->keypoints);
+	fs << "descriptors" << f->descriptors;
+}
+
+bool color_keyframe::load_features(const std::string & filename) {
+
+	if (!boost::filesystem::exists(filename))
+		return false;
+
+	cv::FileStorage fs(filename, cv::FileStorage::READ);
+	if (!fs.isOpened() || (int) fs["version"] != features_version
+			|| (int) fs["type"] != features_type)
+		return false;
+
+	boost::shared_ptr<features> f(new features);
+	f->type = features_type;
+	cv::read(fs["keypoints"], f->keypoints);
+	fs["descriptors"] >> f->descriptors;
+
+	if (f->descriptors.rows != (int) f->keypoints.size())
+		return false;
+
+	compute_keypoints3d(*f);
+
+	tbb::spin_mutex::scoped_lock lock(features_mutex);
+	cached_features = f;
+
+	return true;
+}
+
+void color_keyframe::compute_features(features & f) {
+	detect_features(f.type, get_i(0), get_d(0), f.keypoints, f.descriptors);
+	compute_keypoints3d(f);
+}
+
+void color_keyframe::compute_keypoints3d(features & f) {
+
+	cv::Mat depth = get_d(0);
+	f.intrinsics = get_intrinsics(0);
+
+	f.keypoints3d.clear();
+	for (size_t i = 0; i < f.keypoints.size(); i++) {
+		pcl::PointXYZ p;
+		p.z = depth.at<unsigned short>(f.keypoints[i].pt) / 1000.0f;
+		p.x = (f.keypoints[i].pt.x - f.intrinsics[1]) * p.z / f.intrinsics[0];
+		p.y = (f.keypoints[i].pt.y - f.intrinsics[2]) * p.z / f.intrinsics[0];
+		f.keypoints3d.push_back(p);
+	}
+}
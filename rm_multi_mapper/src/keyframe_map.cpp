@@ -8,12 +8,12 @@
 
 #include <opencv2/imgproc/imgproc.hpp>
 #include <opencv2/features2d/features2d.hpp>
-#include <opencv2/nonfree/nonfree.hpp>
 
 #include <g2o/core/sparse_optimizer.h>
 #include <g2o/solvers/dense/linear_solver_dense.h>
 #include <g2o/solvers/pcg/linear_solver_pcg.h>
 #include <g2o/solvers/cholmod/linear_solver_cholmod.h>
+#include <Eigen/CholmodSupport>
 #include <g2o/core/block_solver.h>
 #include <g2o/core/solver.h>
 #include <g2o/core/optimization_algorithm_levenberg.h>
@@ -35,26 +35,6 @@
 #include <pcl/sample_consensus/model_types.h>
 #include <pcl/segmentation/sac_segmentation.h>
 
-void init_feature_detector(cv::Ptr<cv::FeatureDetector> & fd,
-		cv::Ptr<cv::DescriptorExtractor> & de,
-		cv::Ptr<cv::DescriptorMatcher> & dm) {
-	de = new cv::SurfDescriptorExtractor;
-	dm = new cv::FlannBasedMatcher;
-	fd = new cv::SurfFeatureDetector;
-
-	fd->setInt("hessianThreshold", 400);
-	fd->setInt("extended", 1);
-	fd->setInt("upright", 1);
-	fd->setInt("nOctaves", 8);
-	fd->setInt("nOctaveLayers", 2);
-
-	de->setInt("extended", 1);
-	de->setInt("upright", 1);
-	de->setInt("nOctaves", 8);
-	de->setInt("nOctaveLayers", 2);
-
-}
-
 bool estimate_transform_ransac(const pcl::PointCloud<pcl::PointXYZ> & src,
 		const pcl::PointCloud<pcl::PointXYZ> & dst,
 		const std::vector<cv::DMatch> matches, int num_iter,
@@ -150,110 +130,88 @@ bool estimate_transform_ransac(const pcl::PointCloud<pcl::PointXYZ> & src,
 	return true;
 
 }
-void compute_features(const cv::Mat & rgb, const cv::Mat & depth,
-		const Eigen::Vector3f & intrinsics, cv::Ptr<cv::FeatureDetector> & fd,
-		cv::Ptr<cv::DescriptorExtractor> & de,
-		std::vector<cv::KeyPoint> & filtered_keypoints,
-		pcl::PointCloud<pcl::PointXYZ> & keypoints3d, cv::Mat & descriptors) {
-	cv::Mat gray;
-
-	if (rgb.channels() != 1) {
-		cv::cvtColor(rgb, gray, cv::COLOR_BGR2GRAY);
-	} else {
-		gray = rgb;
-	}
-
-	cv::GaussianBlur(gray, gray, cv::Size(3, 3), 3);
-
-	int threshold = 400;
-	fd->setInt("hessianThreshold", threshold);
-
-	//int threshold = 100;
-	//fd->setInt("thres", threshold);
-
-	std::vector<cv::KeyPoint> keypoints;
+bool find_transform(color_keyframe::Ptr & fi, color_keyframe::Ptr & fj,
+		Sophus::SE3f & t) {
 
-	cv::Mat mask(depth.size(), CV_8UC1);
-	depth.convertTo(mask, CV_8U);
+	color_keyframe::features::ConstPtr features_i = fi->get_features();
+	color_keyframe::features::ConstPtr features_j = fj->get_features();
 
-	fd->detect(gray, keypoints, mask);
+	std::vector<cv::DMatch> matches;
+	match_descriptors(features_j->descriptors, features_i->descriptors,
+			matches);
 
-	for (int i = 0; i < 5; i++) {
-		if (keypoints.size() < 300) {
-			threshold = threshold / 2;
-			fd->setInt("hessianThreshold", threshold);
-			//fd->setInt("thres", threshold);
-			keypoints.clear();
-			fd->detect(gray, keypoints, mask);
-		} else {
-			break;
-		}
-	}
-
-	if (keypoints.size() > 400)
-		keypoints.resize(400);
+	Eigen::Affine3f transform;
+	std::vector<bool> inliers;
 
-	filtered_keypoints.clear();
-	keypoints3d.clear();
+	bool res = estimate_transform_ransac(features_j->keypoints3d,
+			features_i->keypoints3d, matches, 5000, 0.03 * 0.03, 20, transform,
+			inliers);
 
-	for (size_t i = 0; i < keypoints.size(); i++) {
-		if (depth.at<unsigned short>(keypoints[i].pt) != 0) {
-			filtered_keypoints.push_back(keypoints[i]);
+	t = Sophus::SE3f(transform.rotation(), transform.translation());
 
-			pcl::PointXYZ p;
-			p.z = depth.at<unsigned short>(keypoints[i].pt) / 1000.0f;
-			p.x = (keypoints[i].pt.x - intrinsics[1]) * p.z / intrinsics[0];
-			p.y = (keypoints[i].pt.y - intrinsics[2]) * p.z / intrinsics[0];
+	return res;
+}
 
-			//ROS_INFO("Point %f %f %f from  %f %f ", p.x, p.y, p.z, keypoints[i].pt.x, keypoints[i].pt.y);
+// Computes the features of a new frame on a worker thread, so matching
+// against it later costs only matching and RANSAC.
+struct compute_features_task {
+	color_keyframe::Ptr k;
 
-			keypoints3d.push_back(p);
+	compute_features_task(const color_keyframe::Ptr & k) :
+			k(k) {
+	}
 
-		}
+	void operator()() const {
+		k->get_features();
 	}
+};
 
-	de->compute(gray, filtered_keypoints, descriptors);
+keyframe_map::keyframe_map() :
+		features_type(FEATURE_SURF) {
 }
 
-bool find_transform(color_keyframe::Ptr & fi, color_keyframe::Ptr & fj,
-		Sophus::SE3f & t) {
-	cv::Ptr<cv::FeatureDetector> fd;
-	cv::Ptr<cv::DescriptorExtractor> de;
-	cv::Ptr<cv::DescriptorMatcher> dm;
-
-	init_feature_detector(fd, de, dm);
+// Features of frames that were not started yet are not needed anymore.
+keyframe_map::~keyframe_map() {
+	feature_tasks.cancel();
+	feature_tasks.wait();
+}
 
-	std::vector<cv::KeyPoint> keypoints_i, keypoints_j;
-	pcl::PointCloud<pcl::PointXYZ> keypoints3d_i, keypoints3d_j;
-	cv::Mat descriptors_i, descriptors_j;
+void keyframe_map::add_frame(const rm_localization::Keyframe::ConstPtr & k) {
+	color_keyframe::Ptr frame = color_keyframe::from_msg(k);
+	frame->set_feature_type(features_type);
+	frames.push_back(frame);
+	idx.push_back(k->idx);
 
-	compute_features(fi->get_i(0), fi->get_d(0), fi->get_intrinsics(0), fd, de,
-			keypoints_i, keypoints3d_i, descriptors_i);
+	feature_tasks.run(compute_features_task(frame));
+}
 
-	compute_features(fj->get_i(0), fj->get_d(0), fj->get_intrinsics(0), fd, de,
-			keypoints_j, keypoints3d_j, descriptors_j);
+void keyframe_map::set_feature_type(feature_type type) {
+	features_type = type;
 
-	std::vector<cv::DMatch> matches, matches_filtered;
-	dm->match(descriptors_j, descriptors_i, matches);
+	for (size_t i = 0; i < frames.size(); i++) {
+		frames[i]->set_feature_type(type);
+	}
+}
 
-	Eigen::Affine3f transform;
-	std::vector<bool> inliers;
+void keyframe_map::get_overlapping_pairs(float max_angle, float max_distance,
+		tbb::concurrent_vector<std::pair<int, int> > & pairs) {
 
-	bool res = estimate_transform_ransac(keypoints3d_j, keypoints3d_i, matches,
-			5000, 0.03 * 0.03, 20, transform, inliers);
+	boost::shared_ptr<overlap_index> & index = overlap_indices[std::make_pair(
+			max_angle, max_distance)];
+	if (!index)
+		index.reset(new overlap_index(max_angle, max_distance));
 
-	t = Sophus::SE3f(transform.rotation(), transform.translation());
+	// Frames were removed, for example by merge.
+	if (index->size() > frames.size())
+		index->clear();
 
-	return res;
-}
-
-keyframe_map::keyframe_map() {
-}
-
-void keyframe_map::add_frame(const rm_localization::Keyframe::ConstPtr & k) {
-	frames.push_back(color_keyframe::from_msg(k));
-	idx.push_back(k->idx);
+	for (size_t i = 0; i < frames.size(); i++) {
+		index->update(i, frames[i]->get_pos());
+	}
 
+	std::vector<std::pair<int, int> > p;
+	index->get_pairs(p);
+	pairs.assign(p.begin(), p.end());
 }
 
 void keyframe_map::align_z_axis() {
@@ -326,21 +284,7 @@ float keyframe_map::optimize_panorama(int level) {
 	int size = frames.size();
 
 	tbb::concurrent_vector<std::pair<int, int> > overlaping_keyframes;
-
-	for (int i = 0; i < size; i++) {
-		for (int j = 0; j < size; j++) {
-			if (i != j) {
-				float angle =
-						frames[i]->get_pos().unit_quaternion().angularDistance(
-								frames[j]->get_pos().unit_quaternion());
-
-				if (angle < M_PI / 6) {
-					overlaping_keyframes.push_back(std::make_pair(i, j));
-					//ROS_INFO("Images %d and %d intersect with angular distance %f", i, j, angle*180/M_PI);
-				}
-			}
-		}
-	}
+	get_overlapping_pairs(M_PI / 6, 0, overlaping_keyframes);
 
 	reduce_jacobian_rgb rj(frames, size, level);
 
@@ -357,10 +301,14 @@ float keyframe_map::optimize_panorama(int level) {
 	 overlaping_keyframes.begin(), overlaping_keyframes.end()));
 	 */
 
-	Eigen::VectorXf update = -rj.JtJ.ldlt().solve(rj.Jte);
-	//Eigen::VectorXf update =
-	///		-rj.JtJ.block(3, 3, (size - 1) * 3, (size - 1) * 3).ldlt().solve(
-	//				rj.Jte.segment(3, (size - 1) * 3));
+	// Rotation of the first frame fixes the gauge.
+	Eigen::VectorXf update;
+	if (!panorama.solve(rj, 1, update)) {
+		ROS_ERROR("Could not factorize panorama normal equations of %d frames",
+				size);
+		return -1;
+	}
+	update = -update;
 
 	iteration_max_update = std::max(std::abs(update.maxCoeff()),
 			std::abs(update.minCoeff()));
@@ -402,32 +350,20 @@ bool keyframe_map::find_transform(const keyframe_map & other,
 	//cv::imshow("j", other.frames[j]->get_rgb());
 	//cv::waitKey(3);
 
-	cv::Ptr<cv::FeatureDetector> fd;
-	cv::Ptr<cv::DescriptorExtractor> de;
-	cv::Ptr<cv::DescriptorMatcher> dm;
-
-	init_feature_detector(fd, de, dm);
-
-	std::vector<cv::KeyPoint> keypoints_i, keypoints_j;
-	pcl::PointCloud<pcl::PointXYZ> keypoints3d_i, keypoints3d_j;
-	cv::Mat descriptors_i, descriptors_j;
-
-	compute_features(frames[i]->get_rgb(), frames[i]->get_d(0),
-			frames[i]->get_intrinsics(0), fd, de, keypoints_i, keypoints3d_i,
-			descriptors_i);
-
-	compute_features(other.frames[j]->get_rgb(), other.frames[j]->get_d(0),
-			other.frames[j]->get_intrinsics(0), fd, de, keypoints_j,
-			keypoints3d_j, descriptors_j);
+	color_keyframe::features::ConstPtr features_i = frames[i]->get_features();
+	color_keyframe::features::ConstPtr features_j =
+			other.frames[j]->get_features();
 
 	std::vector<cv::DMatch> matches, matches_filtered;
-	dm->match(descriptors_j, descriptors_i, matches);
+	match_descriptors(features_j->descriptors, features_i->descriptors,
+			matches);
 
 	Eigen::Affine3f transform;
 	std::vector<bool> inliers;
 
-	bool res = estimate_transform_ransac(keypoints3d_j, keypoints3d_i, matches,
-			5000, 0.03 * 0.03, 20, transform, inliers);
+	bool res = estimate_transform_ransac(features_j->keypoints3d,
+			features_i->keypoints3d, matches, 5000, 0.03 * 0.03, 20, transform,
+			inliers);
 
 	if (res) {
 
@@ -460,6 +396,7 @@ void keyframe_map::merge(keyframe_map & other, const Sophus::SE3f & t) {
 
 	for (size_t iter = 0; iter < other.frames.size(); iter++) {
 		other.frames[iter]->get_pos() = t * other.frames[iter]->get_pos();
+		other.frames[iter]->set_feature_type(features_type);
 		frames.push_back(other.frames[iter]);
 	}
 
@@ -476,27 +413,9 @@ float keyframe_map::optimize_slam(int skip_n) {
 		return 0;
 
 	tbb::concurrent_vector<std::pair<int, int> > overlaping_keyframes;
+	get_overlapping_pairs(M_PI / 4, 1, overlaping_keyframes);
 
 	for (int i = 0; i < size; i++) {
-		for (int j = 0; j < size; j++) {
-			if (i != j) {
-				float angle =
-						frames[i]->get_pos().unit_quaternion().angularDistance(
-								frames[j]->get_pos().unit_quaternion());
-
-				//float centroid_distance = (frames[i]->get_centroid()
-				//		- frames[j]->get_centroid()).norm();
-
-				float distance = (frames[i]->get_pos().translation()
-						- frames[j]->get_pos().translation()).norm();
-
-				if (angle < M_PI / 4 && distance < 1) {
-					overlaping_keyframes.push_back(std::make_pair(i, j));
-					//ROS_INFO("Images %d and %d intersect with angular distance %f", i, j, angle*180/M_PI);
-				}
-			}
-		}
-
 		overlaping_keyframes.push_back(std::make_pair(i, -1));
 	}
 
@@ -514,12 +433,17 @@ float keyframe_map::optimize_slam(int skip_n) {
 					tbb::concurrent_vector<std::pair<int, int> >::iterator>(
 					overlaping_keyframes.begin(), overlaping_keyframes.end()));
 
-	int begin = skip_n * 6;
-	int length = (size - skip_n) * 6;
+	Eigen::SparseMatrix<double> JtJ;
+	Eigen::VectorXd Jte;
+	rj.get_system(skip_n, JtJ, Jte);
+
+	Eigen::CholmodSupernodalLLT<Eigen::SparseMatrix<double> > solver(JtJ);
+	if (solver.info() != Eigen::Success) {
+		ROS_ERROR("Could not factorize normal equations of %d frames", size);
+		return 0;
+	}
 
-	Eigen::VectorXf update =
-			-rj.JtJ.block(begin, begin, length, length).ldlt().solve(
-					rj.Jte.segment(begin, length));
+	Eigen::VectorXf update = -solver.solve(Jte).cast<float>();
 
 	iteration_max_update = std::max(std::abs(update.maxCoeff()),
 			std::abs(update.minCoeff()));
@@ -651,26 +575,10 @@ void keyframe_map::optimize_g2o() {
 	size_t size = frames.size();
 
 	tbb::concurrent_vector<std::pair<int, int> > overlaping_keyframes;
+	get_overlapping_pairs(M_PI / 4, 3, overlaping_keyframes);
 
-
-	for (int i = 0; i < size; i++) {
-		for (int j = 0; j < size; j++) {
-			if (i != j) {
-				float angle =
-						frames[i]->get_pos().unit_quaternion().angularDistance(
-								frames[j]->get_pos().unit_quaternion());
-
-				float distance = (frames[i]->get_pos().translation()
-						- frames[j]->get_pos().translation()).norm();
-
-				if (angle < M_PI / 4 && distance < 3) {
-					overlaping_keyframes.push_back(std::make_pair(i, j));
-					ROS_INFO("Images %d and %d intersect with angular distance %f", i, j, angle*180/M_PI);
-				}
-			}
-		}
-
-	}
+	ROS_INFO("Found %d overlapping keyframe pairs",
+			(int) overlaping_keyframes.size());
 
 	reduce_measurement_g2o rm(frames, size);
 
@@ -892,6 +800,7 @@ void keyframe_map::save(const std::string & dir_name) {
 	boost::filesystem::create_directory(dir_name);
 	boost::filesystem::create_directory(dir_name + "/rgb");
 	boost::filesystem::create_directory(dir_name + "/depth");
+	boost::filesystem::create_directory(dir_name + "/features");
 
 	for (size_t i = 0; i < frames.size(); i++) {
 		cv::imwrite(
@@ -900,6 +809,9 @@ void keyframe_map::save(const std::string & dir_name) {
 		cv::imwrite(
 				dir_name + "/depth/" + boost::lexical_cast<std::string>(i)
 						+ ".png", frames[i]->get_d(0));
+		frames[i]->save_features(
+				dir_name + "/features/" + boost::lexical_cast<std::string>(i)
+						+ ".yml.gz");
 
 	}
 
@@ -956,7 +868,14 @@ void keyframe_map::load(const std::string & dir_name) {
 		color_keyframe::Ptr k(
 				new color_keyframe(rgb, gray, depth, positions[i].first,
 						positions[i].second));
+		k->set_feature_type(features_type);
 		frames.push_back(k);
+
+		// Maps saved without features or with other detector settings get
+		// them on first use, tools that only read the frames never do.
+		k->load_features(
+				dir_name + "/features/" + boost::lexical_cast<std::string>(i)
+						+ ".yml.gz");
 	}
 
 	//add_keypoints();
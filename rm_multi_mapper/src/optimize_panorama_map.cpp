@@ -36,6 +36,9 @@ int main(int argc, char **argv) {
 		for (int i = 0; i < (level + 1) * (level + 1) * 50; i++) {
 			float max_update = map.optimize_panorama(level);
 
+			if (max_update < 0)
+				return 1;
+
 			pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud =
 					map.get_map_pointcloud();
 
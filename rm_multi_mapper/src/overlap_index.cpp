@@ -0,0 +1,107 @@
+#include <overlap_index.h>
+#include <algorithm>
+#include <cmath>
+
+overlap_index::overlap_index(float max_angle, float max_distance) :
+		max_angle(max_angle), max_distance(max_distance) {
+
+	// Viewing directions of rotations that differ by less than max_angle
+	// are closer than its chord.
+	max_chord = 2 * std::sin(std::min<float>(max_angle, M_PI) / 2);
+
+	if (max_distance > 0) {
+		cell_size = max_distance;
+	} else if (max_angle < M_PI) {
+		cell_size = max_chord;
+	} else {
+		cell_size = 0;
+	}
+}
+
+void overlap_index::update(int idx, const Sophus::SE3f & pos) {
+
+	if (idx >= (int) positions.size()) {
+		positions.resize(idx + 1);
+		directions.resize(idx + 1);
+	}
+
+	positions[idx] = pos;
+	directions[idx] = pos.unit_quaternion() * Eigen::Vector3f::UnitZ();
+
+	cells.insert(idx, get_cell(pos));
+}
+
+void overlap_index::clear() {
+	cells.clear();
+	positions.clear();
+	directions.clear();
+}
+
+void overlap_index::get_pairs(std::vector<std::pair<int, int> > & pairs) const {
+
+	pairs.clear();
+
+	int range = cell_size > 0 ? 1 : 0;
+	float max_chord2 = max_chord * max_chord;
+
+	for (cell_hash::map_type::const_iterator it = cells.begin();
+			it != cells.end(); it++) {
+
+		Eigen::Vector3i cell = cell_hash::get_cell(it->first);
+		const std::vector<int> & a = it->second;
+
+		for (int x = -range; x <= range; x++) {
+			for (int y = -range; y <= range; y++) {
+				for (int z = -range; z <= range; z++) {
+
+					const std::vector<int> * n = cells.find(
+							cell + Eigen::Vector3i(x, y, z));
+					if (!n)
+						continue;
+
+					const std::vector<int> & b = *n;
+
+					// Every pair is seen from the cells of both keyframes,
+					// only the smaller index emits it.
+					for (size_t k = 0; k < a.size(); k++) {
+						for (size_t l = 0; l < b.size(); l++) {
+							int i = a[k], j = b[l];
+							if (i < j
+									&& (directions[i] - directions[j]).squaredNorm()
+											<= max_chord2 && overlap(i, j))
+								pairs.push_back(std::make_pair(i, j));
+						}
+					}
+				}
+			}
+		}
+	}
+
+	std::sort(pairs.begin(), pairs.end());
+}
+
+bool overlap_index::overlap(int i, int j) const {
+
+	if (max_distance > 0
+			&& (positions[i].translation() - positions[j].translation()).norm()
+					>= max_distance)
+		return false;
+
+	return positions[i].unit_quaternion().angularDistance(
+			positions[j].unit_quaternion()) < max_angle;
+}
+
+Eigen::Vector3i overlap_index::get_cell(const Sophus::SE3f & pos) const {
+
+	if (cell_size <= 0)
+		return Eigen::Vector3i::Zero();
+
+	Eigen::Vector3f p;
+	if (max_distance > 0) {
+		p = pos.translation();
+	} else {
+		p = pos.unit_quaternion() * Eigen::Vector3f::UnitZ();
+	}
+
+	return (p / cell_size).array().floor().cast<int>();
+}
@@ -0,0 +1,92 @@
+#include <panorama_solver.h>
+#include <algorithm>
+
+const double panorama_solver::damping = 1e-4;
+
+panorama_solver::panorama_solver() :
+		pattern_size(-1), num_analyzed(0) {
+}
+
+bool panorama_solver::solve(const reduce_jacobian_rgb & rj, int skip_n,
+		Eigen::VectorXf & update) {
+
+	int size = rj.size;
+	int length = (size - skip_n) * 3;
+
+	update.setZero(size * 3 + 3);
+
+	std::vector<int64_t> blocks;
+	blocks.reserve(rj.JtJ.size());
+
+	std::vector<Eigen::Triplet<double> > triplets;
+	triplets.reserve(rj.JtJ.size() * 18 + length);
+
+	double trace = 0;
+
+	for (reduce_jacobian_rgb::block_map::const_iterator it = rj.JtJ.begin();
+			it != rj.JtJ.end(); it++) {
+		int i = it->first / size - skip_n;
+		int j = it->first % size - skip_n;
+
+		if (i < 0 || j < 0)
+			continue;
+
+		blocks.push_back(it->first);
+
+		if (i == j)
+			trace += it->second.trace();
+
+		// CHOLMOD reads the lower triangle.
+		for (int r = 0; r < 3; r++) {
+			for (int c = 0; c < 3; c++) {
+				if (i != j || r <= c)
+					triplets.push_back(
+							Eigen::Triplet<double>(j * 3 + c, i * 3 + r,
+									it->second(r, c)));
+			}
+		}
+	}
+
+	// Levenberg damping proportional to the mean diagonal entry, as in
+	// reduce_jacobian_slam_3d::get_system.
+	double lambda = trace > 0 ? damping * trace / length : 1;
+	for (int i = 0; i < length; i++) {
+		triplets.push_back(Eigen::Triplet<double>(i, i, lambda));
+	}
+
+	Eigen::SparseMatrix<double> R(length, length);
+	R.setFromTriplets(triplets.begin(), triplets.end());
+
+	std::sort(blocks.begin(), blocks.end());
+	if (size != pattern_size || blocks != pattern) {
+		solver.analyzePattern(R);
+		pattern.swap(blocks);
+		pattern_size = size;
+		num_analyzed++;
+	}
+
+	solver.factorize(R);
+	if (solver.info() != Eigen::Success) {
+		pattern_size = -1;
+		return false;
+	}
+
+	Eigen::MatrixXd C =
+			rj.JtJ_intrinsics_rotations.block(0, skip_n * 3, 3, length).transpose().cast<
+					double>();
+	Eigen::VectorXd br = rj.Jte.segment(skip_n * 3, length).cast<double>();
+	Eigen::Vector3d bk = rj.Jte.segment<3>(size * 3).cast<double>();
+
+	Eigen::MatrixXd RinvC = solver.solve(C);
+	Eigen::VectorXd Rinvbr = solver.solve(br);
+
+	Eigen::Matrix3d S = rj.JtJ_intrinsics.cast<double>()
+			- C.transpose() * RinvC;
+	Eigen::Vector3d dk = S.ldlt().solve(bk - C.transpose() * Rinvbr);
+	Eigen::VectorXd dr = Rinvbr - RinvC * dk;
+
+	update.segment(skip_n * 3, length) = dr.cast<float>();
+	update.segment<3>(size * 3) = dk.cast<float>();
+
+	return true;
+}
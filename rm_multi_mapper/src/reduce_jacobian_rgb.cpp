@@ -7,17 +7,32 @@ reduce_jacobian_rgb::reduce_jacobian_rgb(
 		int subsample_level) :
 		size(size), subsample_level(subsample_level), frames(frames) {
 
-	JtJ.setZero(size * 3 + 3, size * 3 + 3);
+	JtJ_intrinsics_rotations.setZero(3, size * 3);
+	JtJ_intrinsics.setZero();
 	Jte.setZero(size * 3 + 3);
 
 }
 
 reduce_jacobian_rgb::reduce_jacobian_rgb(reduce_jacobian_rgb& rb, tbb::split) :
 		size(rb.size), subsample_level(rb.subsample_level), frames(rb.frames) {
-	JtJ.setZero(size * 3 + 3, size * 3 + 3);
+	JtJ_intrinsics_rotations.setZero(3, size * 3);
+	JtJ_intrinsics.setZero();
 	Jte.setZero(size * 3 + 3);
 }
 
+void reduce_jacobian_rgb::add_block(int i, int j, const Eigen::Matrix3f & b) {
+
+	if (i > j) {
+		add_block(j, i, b.transpose());
+		return;
+	}
+
+	std::pair<block_map::iterator, bool> res = JtJ.insert(
+			std::make_pair(int64_t(i) * size + j, b));
+	if (!res.second)
+		res.first->second += b;
+}
+
 void reduce_jacobian_rgb::compute_frame_jacobian(const Eigen::Vector3f & i,
 		const Eigen::Matrix3f & Rwi, const Eigen::Matrix3f & Rwj,
 		Eigen::Matrix<float, 9, 3> & Ji, Eigen::Matrix<float, 9, 3> & Jj,
@@ -255,6 +270,13 @@ void reduce_jacobian_rgb::operator()(
 				frames[i]->get_pos().unit_quaternion().matrix(),
 				frames[j]->get_pos().unit_quaternion().matrix(), Jwi, Jwj, Jwk);
 
+		// Sums over the pixels of the pair, the blocks of i, j and the
+		// intrinsics are projected from them once. Pixel coordinates make
+		// the terms large, so they are summed in double.
+		Eigen::Matrix<double, 9, 9> JptJp =
+				Eigen::Matrix<double, 9, 9>::Zero();
+		Eigen::Matrix<double, 9, 1> Jpte = Eigen::Matrix<double, 9, 1>::Zero();
+
 		for (int v = 0; v < intensity_i.rows; v++) {
 			for (int u = 0; u < intensity_i.cols; u++) {
 				if (intensity_j_warped.at<float>(v, u) != 0) {
@@ -271,45 +293,49 @@ void reduce_jacobian_rgb::operator()(
 
 					float mudxmvdy = -udx - vdy;
 
-					Eigen::Matrix<float, 1, 9> Jp;
+					Eigen::Matrix<double, 1, 9> Jp;
 					Jp << udx, vdx, dx, udy, vdy, dy, u * mudxmvdy, v
 							* mudxmvdy, mudxmvdy;
 
-					Eigen::Matrix<float, 1, 3> Ji, Jj, Jk;
-					Ji = Jp * Jwi;
-					Jj = Jp * Jwj;
-					Jk = Jp * Jwk;
+					JptJp.noalias() += Jp.transpose() * Jp;
+					Jpte += Jp.transpose() * double(e);
 
-					//
-					JtJ.block<3, 3>(i * 3, i * 3) += Ji.transpose() * Ji;
-					JtJ.block<3, 3>(j * 3, j * 3) += Jj.transpose() * Jj;
-					JtJ.block<3, 3>(size * 3, size * 3) += Jk.transpose() * Jk;
-					// i and j
-					JtJ.block<3, 3>(i * 3, j * 3) += Ji.transpose() * Jj;
-					JtJ.block<3, 3>(j * 3, i * 3) += Jj.transpose() * Ji;
+				}
+			}
 
-					// i and k
-					JtJ.block<3, 3>(i * 3, size * 3) += Ji.transpose() * Jk;
-					JtJ.block<3, 3>(size * 3, i * 3) += Jk.transpose() * Ji;
+		}
 
-					// j and k
-					JtJ.block<3, 3>(size * 3, j * 3) += Jk.transpose() * Jj;
-					JtJ.block<3, 3>(j * 3, size * 3) += Jj.transpose() * Jk;
+		Eigen::Matrix<double, 9, 3> Jwid = Jwi.cast<double>();
+		Eigen::Matrix<double, 9, 3> Jwjd = Jwj.cast<double>();
+		Eigen::Matrix<double, 9, 3> Jwkd = Jwk.cast<double>();
 
-					// errors
-					Jte.segment<3>(i * 3) += Ji.transpose() * e;
-					Jte.segment<3>(j * 3) += Jj.transpose() * e;
-					Jte.segment<3>(size * 3) += Jk.transpose() * e;
+		//
+		add_block(i, i, (Jwid.transpose() * JptJp * Jwid).cast<float>());
+		add_block(j, j, (Jwjd.transpose() * JptJp * Jwjd).cast<float>());
+		JtJ_intrinsics += (Jwkd.transpose() * JptJp * Jwkd).cast<float>();
+		// i and j
+		add_block(i, j, (Jwid.transpose() * JptJp * Jwjd).cast<float>());
 
-				}
-			}
+		// i and k, j and k
+		JtJ_intrinsics_rotations.block<3, 3>(0, i * 3) += (Jwkd.transpose()
+				* JptJp * Jwid).cast<float>();
+		JtJ_intrinsics_rotations.block<3, 3>(0, j * 3) += (Jwkd.transpose()
+				* JptJp * Jwjd).cast<float>();
 
-		}
+		// errors
+		Jte.segment<3>(i * 3) += (Jwid.transpose() * Jpte).cast<float>();
+		Jte.segment<3>(j * 3) += (Jwjd.transpose() * Jpte).cast<float>();
+		Jte.segment<3>(size * 3) += (Jwkd.transpose() * Jpte).cast<float>();
 
 	}
 }
 
 void reduce_jacobian_rgb::join(reduce_jacobian_rgb& rb) {
-	JtJ += rb.JtJ;
+	for (block_map::const_iterator it = rb.JtJ.begin(); it != rb.JtJ.end();
+			it++) {
+		add_block(it->first / size, it->first % size, it->second);
+	}
+	JtJ_intrinsics_rotations += rb.JtJ_intrinsics_rotations;
+	JtJ_intrinsics += rb.JtJ_intrinsics;
 	Jte += rb.Jte;
 }
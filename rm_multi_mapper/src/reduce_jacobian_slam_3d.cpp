@@ -8,11 +8,12 @@
 
 #include <keyframe_map.h>
 
+const double reduce_jacobian_slam_3d::damping = 1e-4;
+
 reduce_jacobian_slam_3d::reduce_jacobian_slam_3d(
 		tbb::concurrent_vector<color_keyframe::Ptr> & frames, int size) :
 		size(size), frames(frames) {
 
-	JtJ.setZero(size * 6, size * 6);
 	Jte.setZero(size * 6);
 
 	icp.setMaxCorrespondenceDistance(0.5);
@@ -24,7 +25,6 @@ reduce_jacobian_slam_3d::reduce_jacobian_slam_3d(
 reduce_jacobian_slam_3d::reduce_jacobian_slam_3d(reduce_jacobian_slam_3d& rb,
 		tbb::split) :
 		size(rb.size), frames(rb.frames) {
-	JtJ.setZero(size * 6, size * 6);
 	Jte.setZero(size * 6);
 
 	icp.setMaxCorrespondenceDistance(0.5);
@@ -85,6 +85,65 @@ void reduce_jacobian_slam_3d::compute_frame_jacobian(
 
 }
 
+void reduce_jacobian_slam_3d::add_block(int i, int j,
+		const Sophus::Matrix6f & b) {
+
+	if (i > j) {
+		add_block(j, i, b.transpose());
+		return;
+	}
+
+	std::pair<block_map::iterator, bool> res = JtJ.insert(
+			std::make_pair(int64_t(i) * size + j, b));
+	if (!res.second)
+		res.first->second += b;
+}
+
+void reduce_jacobian_slam_3d::get_system(int skip_n,
+		Eigen::SparseMatrix<double> & A, Eigen::VectorXd & b) const {
+
+	int length = (size - skip_n) * 6;
+
+	std::vector<Eigen::Triplet<double> > triplets;
+	triplets.reserve(JtJ.size() * 72 + length);
+
+	double trace = 0;
+
+	for (block_map::const_iterator it = JtJ.begin(); it != JtJ.end(); it++) {
+		int i = it->first / size - skip_n;
+		int j = it->first % size - skip_n;
+
+		if (i < 0 || j < 0)
+			continue;
+
+		if (i == j)
+			trace += it->second.trace();
+
+		for (int r = 0; r < 6; r++) {
+			for (int c = 0; c < 6; c++) {
+				triplets.push_back(
+						Eigen::Triplet<double>(i * 6 + r, j * 6 + c,
+								it->second(r, c)));
+				if (i != j)
+					triplets.push_back(
+							Eigen::Triplet<double>(j * 6 + c, i * 6 + r,
+									it->second(r, c)));
+			}
+		}
+	}
+
+	// Levenberg damping proportional to the mean diagonal entry.
+	double lambda = trace > 0 ? damping * trace / length : 1;
+	for (int i = 0; i < length; i++) {
+		triplets.push_back(Eigen::Triplet<double>(i, i, lambda));
+	}
+
+	A.resize(length, length);
+	A.setFromTriplets(triplets.begin(), triplets.end());
+
+	b = Jte.segment(skip_n * 6, length).cast<double>();
+}
+
 void reduce_jacobian_slam_3d::add_icp_measurement(int i, int j) {
 
 	Sophus::SE3f Mij = frames[i]->get_pos().inverse() * frames[j]->get_pos();
@@ -153,11 +212,10 @@ void reduce_jacobian_slam_3d::add_icp_measurement(int i, int j) {
 		Jj = -Ji;
 
 		//
-		JtJ.block<6, 6>(i * 6, i * 6) += Ji.transpose() * Ji;
-		JtJ.block<6, 6>(j * 6, j * 6) += Jj.transpose() * Jj;
+		add_block(i, i, Ji.transpose() * Ji);
+		add_block(j, j, Jj.transpose() * Jj);
 		// i and j
-		JtJ.block<6, 6>(i * 6, j * 6) += Ji.transpose() * Jj;
-		JtJ.block<6, 6>(j * 6, i * 6) += Jj.transpose() * Ji;
+		add_block(i, j, Ji.transpose() * Jj);
 
 		// errors
 		Jte.segment<6>(i * 6) += Ji.transpose() * error;
@@ -188,11 +246,10 @@ void reduce_jacobian_slam_3d::add_rgbd_measurement(int i, int j) {
 		Jj = -Ji;
 
 		//
-		JtJ.block<6, 6>(i * 6, i * 6) += Ji.transpose() * Ji;
-		JtJ.block<6, 6>(j * 6, j * 6) += Jj.transpose() * Jj;
+		add_block(i, i, Ji.transpose() * Ji);
+		add_block(j, j, Jj.transpose() * Jj);
 		// i and j
-		JtJ.block<6, 6>(i * 6, j * 6) += Ji.transpose() * Jj;
-		JtJ.block<6, 6>(j * 6, i * 6) += Jj.transpose() * Ji;
+		add_block(i, j, Ji.transpose() * Jj);
 
 		// errors
 		Jte.segment<6>(i * 6) += Ji.transpose() * error;
@@ -270,7 +327,7 @@ void reduce_jacobian_slam_3d::add_floor_measurement(int i) {
 	Sophus::Vector3f error;
 	error << coefficients->values[0], coefficients->values[1], -coefficients->values[3];
 
-	JtJ.block<6, 6>(i * 6, i * 6) += Ji.transpose() * Ji;
+	add_block(i, i, Ji.transpose() * Ji);
 	Jte.segment<6>(i * 6) += Ji.transpose() * error;
 
 }
@@ -298,6 +355,9 @@ void reduce_jacobian_slam_3d::operator()(
 }
 
 void reduce_jacobian_slam_3d::join(reduce_jacobian_slam_3d& rb) {
-	JtJ += rb.JtJ;
+	for (block_map::const_iterator it = rb.JtJ.begin(); it != rb.JtJ.end();
+			it++) {
+		add_block(it->first / size, it->first % size, it->second);
+	}
 	Jte += rb.Jte;
 }
@@ -1,26 +1,11 @@
 #include <reduce_measurement_g2o.h>
 #include <opencv2/imgproc/imgproc.hpp>
-#include <opencv2/nonfree/features2d.hpp>
 
 #include <pcl/visualization/pcl_visualizer.h>
 #include <pcl/sample_consensus/method_types.h>
 #include <pcl/sample_consensus/model_types.h>
 #include <pcl/segmentation/sac_segmentation.h>
 
-void reduce_measurement_g2o::init_feature_detector() {
-	de = new cv::SurfDescriptorExtractor;
-	dm = new cv::FlannBasedMatcher;
-	fd = new cv::SurfFeatureDetector;
-
-	fd->setInt("hessianThreshold", 400);
-	fd->setInt("extended", 1);
-	fd->setInt("upright", 1);
-
-	de->setInt("extended", 1);
-	de->setInt("upright", 1);
-
-}
-
 bool reduce_measurement_g2o::estimate_transform_ransac(
 		const pcl::PointCloud<pcl::PointXYZ> & src,
 		const pcl::PointCloud<pcl::PointXYZ> & dst,
@@ -117,93 +102,22 @@ bool reduce_measurement_g2o::estimate_transform_ransac(
 	return true;
 
 }
-void reduce_measurement_g2o::compute_features(const cv::Mat & rgb,
-		const cv::Mat & depth, const Eigen::Vector3f & intrinsics,
-		cv::Ptr<cv::FeatureDetector> & fd,
-		cv::Ptr<cv::DescriptorExtractor> & de,
-		std::vector<cv::KeyPoint> & filtered_keypoints,
-		pcl::PointCloud<pcl::PointXYZ> & keypoints3d, cv::Mat & descriptors) {
-	cv::Mat gray;
-
-	if (rgb.channels() != 1) {
-		cv::cvtColor(rgb, gray, cv::COLOR_BGR2GRAY);
-	} else {
-		gray = rgb;
-	}
-
-	cv::GaussianBlur(gray, gray, cv::Size(3, 3), 3);
-
-	int threshold = 400;
-	fd->setInt("hessianThreshold", threshold);
-
-	//int threshold = 100;
-	//fd->setInt("thres", threshold);
-
-	std::vector<cv::KeyPoint> keypoints;
-
-	cv::Mat mask(depth.size(), CV_8UC1);
-	depth.convertTo(mask, CV_8U);
-
-	fd->detect(gray, keypoints, mask);
-
-	for (int i = 0; i < 5; i++) {
-		if (keypoints.size() < 300) {
-			threshold = threshold / 2;
-			fd->setInt("hessianThreshold", threshold);
-			//fd->setInt("thres", threshold);
-			keypoints.clear();
-			fd->detect(gray, keypoints, mask);
-		} else {
-			break;
-		}
-	}
-
-	if (keypoints.size() > 400)
-		keypoints.resize(400);
-
-	filtered_keypoints.clear();
-	keypoints3d.clear();
-
-	for (size_t i = 0; i < keypoints.size(); i++) {
-		if (depth.at<unsigned short>(keypoints[i].pt) != 0) {
-			filtered_keypoints.push_back(keypoints[i]);
-
-			pcl::PointXYZ p;
-			p.z = depth.at<unsigned short>(keypoints[i].pt) / 1000.0f;
-			p.x = (keypoints[i].pt.x - intrinsics[1]) * p.z / intrinsics[0];
-			p.y = (keypoints[i].pt.y - intrinsics[2]) * p.z / intrinsics[0];
-
-			//ROS_INFO("Point %f %f %f from  %f %f ", p.x, p.y, p.z, keypoints[i].pt.x, keypoints[i].pt.y);
-
-			keypoints3d.push_back(p);
-
-		}
-	}
-
-	de->compute(gray, filtered_keypoints, descriptors);
-}
-
 bool reduce_measurement_g2o::find_transform(const color_keyframe::Ptr & fi,
 		const color_keyframe::Ptr & fj, Sophus::SE3f & t) {
 
-	std::vector<cv::KeyPoint> keypoints_i, keypoints_j;
-	pcl::PointCloud<pcl::PointXYZ> keypoints3d_i, keypoints3d_j;
-	cv::Mat descriptors_i, descriptors_j;
-
-	compute_features(fi->get_i(0), fi->get_d(0), fi->get_intrinsics(0), fd, de,
-			keypoints_i, keypoints3d_i, descriptors_i);
+	color_keyframe::features::ConstPtr features_i = fi->get_features();
+	color_keyframe::features::ConstPtr features_j = fj->get_features();
 
-	compute_features(fj->get_i(0), fj->get_d(0), fj->get_intrinsics(0), fd, de,
-			keypoints_j, keypoints3d_j, descriptors_j);
-
-	std::vector<cv::DMatch> matches, matches_filtered;
-	dm->match(descriptors_j, descriptors_i, matches);
+	std::vector<cv::DMatch> matches;
+	match_descriptors(features_j->descriptors, features_i->descriptors,
+			matches);
 
 	Eigen::Affine3f transform;
 	std::vector<bool> inliers;
 
-	bool res = estimate_transform_ransac(keypoints3d_j, keypoints3d_i, matches,
-			100, 0.03 * 0.03, 20, transform, inliers);
+	bool res = estimate_transform_ransac(features_j->keypoints3d,
+			features_i->keypoints3d, matches, 100, 0.03 * 0.03, 20, transform,
+			inliers);
 
 	t = Sophus::SE3f(transform.rotation(), transform.translation());
 
@@ -214,8 +128,6 @@ reduce_measurement_g2o::reduce_measurement_g2o(
 		const tbb::concurrent_vector<color_keyframe::Ptr> & frames, int size) :
 		size(size), frames(frames) {
 
-	init_feature_detector();
-
 	icp.setMaxCorrespondenceDistance(0.5);
 	boost::shared_ptr<PointToPlane> point_to_plane(new PointToPlane);
 	icp.setTransformationEstimation(point_to_plane);
@@ -226,8 +138,6 @@ reduce_measurement_g2o::reduce_measurement_g2o(reduce_measurement_g2o& rb,
 		tbb::split) :
 		size(rb.size), frames(rb.frames) {
 
-	init_feature_detector();
-
 	icp.setMaxCorrespondenceDistance(0.5);
 	boost::shared_ptr<PointToPlane> point_to_plane(new PointToPlane);
 	icp.setTransformationEstimation(point_to_plane);
@@ -11,6 +11,18 @@ robot_mapper::robot_mapper(ros::NodeHandle & nh,
 
 	skip_first_n_in_optimization = 1;
 
+	std::string feature_type_name;
+	ros::NodeHandle("~").param<std::string>("feature_type", feature_type_name,
+			"surf");
+
+	feature_type type;
+	if (parse_feature_type(feature_type_name, type)) {
+		map->set_feature_type(type);
+	} else {
+		ROS_WARN("Unknown feature type %s, using surf",
+				feature_type_name.c_str());
+	}
+
 	world_to_odom.setIdentity();
 	world_to_odom.setOrigin(tf::Vector3(0, robot_num * 10.0, 0));
 
@@ -209,6 +221,10 @@ void robot_mapper::optmize_panorama() {
 		for (int i = 0; i < (level + 1) * (level + 1) * 10; i++) {
 			float max_update = map->optimize_panorama(level);
 
+			// The frames are left as they were, nothing is fixed yet.
+			if (max_update < 0)
+				return;
+
 			pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud =
 					map->get_map_pointcloud();
 
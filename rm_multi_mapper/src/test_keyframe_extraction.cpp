@@ -153,6 +153,9 @@ public:
 			for (int i = 0; i < (level + 1) * (level + 1) * 10; i++) {
 				float max_update = map->optimize_panorama(level);
 
+				if (max_update < 0)
+					return;
+
 				pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud =
 						map->get_map_pointcloud();
 
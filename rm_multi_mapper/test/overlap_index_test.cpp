@@ -0,0 +1,107 @@
+#include <overlap_index.h>
+#include <gtest/gtest.h>
+#include <cstdlib>
+
+static float frand(float min, float max) {
+	return min + (max - min) * rand() / RAND_MAX;
+}
+
+// Size 0 gives a panorama, all centers at the origin.
+static Sophus::SE3f random_pose(float size) {
+	Eigen::Quaternionf q(frand(-1, 1), frand(-1, 1), frand(-1, 1),
+			frand(-1, 1));
+	q.normalize();
+	return Sophus::SE3f(q,
+			Eigen::Vector3f(frand(-size, size), frand(-size, size),
+					frand(-size / 10, size / 10)));
+}
+
+// The loop over all pairs the index replaces.
+static void get_pairs_linear(
+		const std::vector<Sophus::SE3f,
+				Eigen::aligned_allocator<Sophus::SE3f> > & poses,
+		float max_angle, float max_distance,
+		std::vector<std::pair<int, int> > & pairs) {
+
+	pairs.clear();
+
+	for (size_t i = 0; i < poses.size(); i++) {
+		for (size_t j = i + 1; j < poses.size(); j++) {
+			if (max_distance > 0
+					&& (poses[i].translation() - poses[j].translation()).norm()
+							>= max_distance)
+				continue;
+
+			if (poses[i].unit_quaternion().angularDistance(
+					poses[j].unit_quaternion()) < max_angle)
+				pairs.push_back(std::make_pair(i, j));
+		}
+	}
+}
+
+static void check_pairs(float max_angle, float max_distance, float size) {
+
+	overlap_index index(max_angle, max_distance);
+	std::vector<Sophus::SE3f, Eigen::aligned_allocator<Sophus::SE3f> > poses;
+
+	for (int i = 0; i < 300; i++) {
+		poses.push_back(random_pose(size));
+		index.update(i, poses.back());
+	}
+
+	std::vector<std::pair<int, int> > pairs, pairs_linear;
+
+	// Optimizer iterations move frames a bit, some to another cell, and
+	// add new ones.
+	for (int iter = 0; iter < 5; iter++) {
+
+		index.get_pairs(pairs);
+		get_pairs_linear(poses, max_angle, max_distance, pairs_linear);
+
+		EXPECT_EQ(poses.size(), index.size());
+		EXPECT_FALSE(pairs_linear.empty());
+		EXPECT_TRUE(pairs_linear == pairs);
+
+		for (size_t i = 0; i < poses.size(); i++) {
+			Sophus::Vector6f update;
+			for (int k = 0; k < 6; k++)
+				update[k] = frand(-0.05, 0.05);
+
+			poses[i] = Sophus::SE3f::exp(update) * poses[i];
+			index.update(i, poses[i]);
+		}
+
+		for (int i = 0; i < 20; i++) {
+			poses.push_back(random_pose(size));
+			index.update(poses.size() - 1, poses.back());
+		}
+	}
+
+	index.clear();
+	index.get_pairs(pairs);
+	EXPECT_EQ(0, index.size());
+	EXPECT_TRUE(pairs.empty());
+}
+
+// Thresholds of optimize_panorama.
+TEST(OverlapIndexTest, panoramaTest) {
+	srand(42);
+	check_pairs(M_PI / 6, 0, 0);
+}
+
+// Thresholds of optimize_slam.
+TEST(OverlapIndexTest, slamTest) {
+	srand(42);
+	check_pairs(M_PI / 4, 1, 5);
+}
+
+// Thresholds of optimize_g2o.
+TEST(OverlapIndexTest, g2oTest) {
+	srand(42);
+	check_pairs(M_PI / 4, 3, 10);
+}
+
+int main(int argc, char **argv) {
+	testing::InitGoogleTest(&argc, argv);
+	return RUN_ALL_TESTS();
+}
@@ -0,0 +1,153 @@
+#include <panorama_solver.h>
+#include <Eigen/Dense>
+#include <gtest/gtest.h>
+#include <cstdlib>
+
+static const int num_frames = 40;
+
+// Photometric term of an overlapping pair (i, j) as accumulated by
+// reduce_jacobian_rgb, with random jacobians of 9 residuals. It only
+// depends on the relative rotation, like the real one. The same term is
+// added to the dense normal equations H x = g of all rotations followed by
+// the intrinsics.
+static void add_pair(reduce_jacobian_rgb & rj, Eigen::MatrixXd & H,
+		Eigen::VectorXd & g, int i, int j) {
+
+	Eigen::Matrix<float, 9, 3> Ji, Jj, Jk;
+	Ji.setRandom();
+	Jj = -Ji;
+	Jk.setRandom();
+	Eigen::Matrix<float, 9, 1> r;
+	r.setRandom();
+
+	rj.add_block(i, i, Ji.transpose() * Ji);
+	rj.add_block(j, j, Jj.transpose() * Jj);
+	rj.add_block(i, j, Ji.transpose() * Jj);
+	rj.JtJ_intrinsics += Jk.transpose() * Jk;
+	rj.JtJ_intrinsics_rotations.block<3, 3>(0, i * 3) += Jk.transpose() * Ji;
+	rj.JtJ_intrinsics_rotations.block<3, 3>(0, j * 3) += Jk.transpose() * Jj;
+	rj.Jte.segment<3>(i * 3) += Ji.transpose() * r;
+	rj.Jte.segment<3>(j * 3) += Jj.transpose() * r;
+	rj.Jte.segment<3>(num_frames * 3) += Jk.transpose() * r;
+
+	Eigen::Matrix<double, 9, 9> J;
+	J.setZero();
+	J.block<9, 3>(0, 0) = Ji.cast<double>();
+	J.block<9, 3>(0, 3) = Jj.cast<double>();
+	J.block<9, 3>(0, 6) = Jk.cast<double>();
+
+	Eigen::Matrix<double, 9, 9> JtJ = J.transpose() * J;
+	Eigen::Matrix<double, 9, 1> Jtr = J.transpose() * r.cast<double>();
+
+	int idx[3] = { i * 3, j * 3, num_frames * 3 };
+	for (int a = 0; a < 3; a++) {
+		for (int b = 0; b < 3; b++)
+			H.block<3, 3>(idx[a], idx[b]) += JtJ.block<3, 3>(a * 3, b * 3);
+		g.segment<3>(idx[a]) += Jtr.segment<3>(a * 3);
+	}
+}
+
+// Solution of H x = g with frame 0 fixed and the rotation part damped like
+// panorama_solver does.
+static Eigen::VectorXd solve_dense(const Eigen::MatrixXd & H,
+		const Eigen::VectorXd & g) {
+
+	int length = (num_frames - 1) * 3;
+
+	Eigen::MatrixXd A = H.bottomRightCorner(length + 3, length + 3);
+	double lambda = panorama_solver::damping * A.diagonal().head(length).sum()
+			/ length;
+	A.diagonal().head(length).array() += lambda;
+
+	Eigen::VectorXd x = Eigen::VectorXd::Zero(H.rows());
+	x.tail(length + 3) = A.ldlt().solve(g.tail(length + 3));
+	return x;
+}
+
+class PanoramaSolverTest: public ::testing::Test {
+
+protected:
+
+	PanoramaSolverTest() :
+			rj(frames, num_frames, 0), H(
+					Eigen::MatrixXd::Zero(num_frames * 3 + 3,
+							num_frames * 3 + 3)), g(
+					Eigen::VectorXd::Zero(num_frames * 3 + 3)) {
+		srand(42);
+	}
+
+	tbb::concurrent_vector<color_keyframe::Ptr> frames;
+	reduce_jacobian_rgb rj;
+	Eigen::MatrixXd H;
+	Eigen::VectorXd g;
+
+};
+
+TEST_F(PanoramaSolverTest, schurTest) {
+
+	// Neighbours overlap and so do frames half a turn apart.
+	for (int i = 0; i < num_frames; i++) {
+		add_pair(rj, H, g, i, (i + 1) % num_frames);
+		if (i < num_frames / 2)
+			add_pair(rj, H, g, i, i + num_frames / 2);
+	}
+
+	panorama_solver solver;
+	Eigen::VectorXf update;
+	ASSERT_TRUE(solver.solve(rj, 1, update));
+	ASSERT_EQ(num_frames * 3 + 3, update.size());
+
+	Eigen::VectorXd expected = solve_dense(H, g);
+	EXPECT_LE((update.cast<double>() - expected).norm(),
+			1e-4 * expected.norm());
+
+	// The first frame fixes the gauge.
+	EXPECT_EQ(0, update.head<3>().norm());
+	EXPECT_GT(update.segment<3>(3).norm(), 0);
+	EXPECT_GT(update.tail<3>().norm(), 0);
+
+	// New values with the same overlapping pairs reuse the analysis.
+	rj.JtJ_intrinsics += Eigen::Matrix3f::Identity();
+	for (reduce_jacobian_rgb::block_map::iterator it = rj.JtJ.begin();
+			it != rj.JtJ.end(); it++) {
+		it->second *= 2;
+	}
+
+	ASSERT_TRUE(solver.solve(rj, 1, update));
+	ASSERT_TRUE(solver.solve(rj, 1, update));
+	EXPECT_EQ(1, solver.get_num_analyzed());
+
+	add_pair(rj, H, g, 3, 11);
+	ASSERT_TRUE(solver.solve(rj, 1, update));
+	EXPECT_EQ(2, solver.get_num_analyzed());
+}
+
+TEST_F(PanoramaSolverTest, disconnectedTest) {
+
+	// Frames from 10 on only overlap with each other and the last frame
+	// overlaps with nothing, both leave R singular without damping.
+	for (int i = 0; i < num_frames - 2; i++) {
+		if (i != 9)
+			add_pair(rj, H, g, i, i + 1);
+	}
+
+	int length = (num_frames - 1) * 3;
+	EXPECT_NE(Eigen::Success,
+			H.bottomRightCorner(length, length).llt().info());
+
+	panorama_solver solver;
+	Eigen::VectorXf update;
+	ASSERT_TRUE(solver.solve(rj, 1, update));
+	ASSERT_TRUE((update.array() == update.array()).all());
+
+	Eigen::VectorXd expected = solve_dense(H, g);
+	EXPECT_LE((update.cast<double>() - expected).norm(),
+			1e-4 * expected.norm());
+
+	EXPECT_EQ(0, update.segment<3>((num_frames - 1) * 3).norm());
+}
+
+int main(int argc, char **argv) {
+	testing::InitGoogleTest(&argc, argv);
+	return RUN_ALL_TESTS();
+}
@@ -0,0 +1,100 @@
+#include <reduce_jacobian_slam_3d.h>
+#include <Eigen/SparseCholesky>
+#include <Eigen/Dense>
+#include <gtest/gtest.h>
+#include <cstdlib>
+
+// Adds a relative measurement between frames i and j with jacobian J for
+// frame i and -J for frame j, r is its residual.
+static void add_relative(reduce_jacobian_slam_3d & rj, int i, int j,
+		const Sophus::Matrix6f & J, const Sophus::Vector6f & r) {
+	Sophus::Matrix6f JtJ = J.transpose() * J;
+	rj.add_block(i, i, JtJ);
+	rj.add_block(j, j, JtJ);
+	rj.add_block(i, j, -JtJ);
+	rj.Jte.segment<6>(i * 6) += J.transpose() * r;
+	rj.Jte.segment<6>(j * 6) -= J.transpose() * r;
+}
+
+// The same measurement added to dense undamped normal equations of the
+// frames from 1 on, frame 0 is fixed.
+static void add_relative(Eigen::MatrixXd & H, Eigen::VectorXd & g, int i,
+		int j, const Sophus::Matrix6f & J, const Sophus::Vector6f & r) {
+	Eigen::Matrix<double, 6, 6> JtJ = (J.transpose() * J).cast<double>();
+	Eigen::Matrix<double, 6, 1> Jtr = (J.transpose() * r).cast<double>();
+	i--;
+	j--;
+	if (i >= 0) {
+		H.block<6, 6>(i * 6, i * 6) += JtJ;
+		g.segment<6>(i * 6) += Jtr;
+	}
+	if (j >= 0) {
+		H.block<6, 6>(j * 6, j * 6) += JtJ;
+		g.segment<6>(j * 6) -= Jtr;
+	}
+	if (i >= 0 && j >= 0) {
+		H.block<6, 6>(i * 6, j * 6) -= JtJ;
+		H.block<6, 6>(j * 6, i * 6) -= JtJ;
+	}
+}
+
+TEST(ReduceJacobianSlam3dTest, disconnectedKeyframeTest) {
+
+	srand(42);
+
+	tbb::concurrent_vector<color_keyframe::Ptr> frames;
+	reduce_jacobian_slam_3d rj(frames, 6);
+
+	Sophus::Matrix6f J[3];
+	Sophus::Vector6f r[3];
+	for (int k = 0; k < 3; k++) {
+		J[k] = Sophus::Matrix6f::Random() + 3 * Sophus::Matrix6f::Identity();
+		r[k] = Sophus::Vector6f::Random();
+	}
+
+	Eigen::MatrixXd H = Eigen::MatrixXd::Zero(30, 30);
+	Eigen::VectorXd g = Eigen::VectorXd::Zero(30);
+
+	// Frames 1 and 2 are connected to the fixed frame 0, frames 3 and 4
+	// only to each other and frame 5 has no measurements.
+	add_relative(rj, 0, 1, J[0], r[0]);
+	add_relative(rj, 1, 2, J[1], r[1]);
+	add_relative(rj, 3, 4, J[2], r[2]);
+	add_relative(H, g, 0, 1, J[0], r[0]);
+	add_relative(H, g, 1, 2, J[1], r[1]);
+	add_relative(H, g, 3, 4, J[2], r[2]);
+
+	// Without damping the system of all frames is singular.
+	EXPECT_NE(Eigen::Success, H.llt().info());
+
+	Eigen::SparseMatrix<double> JtJ;
+	Eigen::VectorXd Jte;
+	rj.get_system(1, JtJ, Jte);
+
+	EXPECT_LE((Jte - g).norm(), 1e-4 * g.norm());
+
+	// Has the same positive definiteness requirement as the CHOLMOD
+	// supernodal factorization of optimize_slam, without depending on it.
+	Eigen::SimplicialLLT<Eigen::SparseMatrix<double> > solver(JtJ);
+	ASSERT_EQ(Eigen::Success, solver.info());
+
+	Eigen::VectorXd update = -solver.solve(Jte);
+	ASSERT_TRUE((update.array() == update.array()).all());
+
+	// Frames connected to the fixed frame get about the undamped update.
+	Eigen::VectorXd expected = -H.topLeftCorner(12, 12).ldlt().solve(
+			g.head(12));
+	EXPECT_LE((update.head(12) - expected).norm(), 1e-2 * expected.norm());
+
+	// The disconnected pair only moves relative to each other.
+	EXPECT_GT(update.segment(12, 6).norm(), 0);
+	EXPECT_LE((update.segment(12, 6) + update.segment(18, 6)).norm(),
+			1e-6 * update.segment(12, 6).norm());
+
+	EXPECT_EQ(0, update.tail(6).norm());
+}
+
+int main(int argc, char **argv) {
+	testing::InitGoogleTest(&argc, argv);
+	return RUN_ALL_TESTS();
+}
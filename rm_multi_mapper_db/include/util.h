@@ -3,11 +3,11 @@
 #define UTIL_H
 
 #include <opencv2/core/core.hpp>
-#include <opencv2/nonfree/features2d.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
 #include <pcl_ros/point_cloud.h>
 #include <pcl/point_types.h>
 #include <keyframe_map.h>
+#include <binary_features.h>
 
 class util {
 public:
@@ -54,6 +54,14 @@ public:
 	virtual long get_random_keyframe_idx(int map) = 0;
 	virtual void merge_map(int old_map_id, int new_map_id) = 0;
 
+	// SURF by default. The descriptor type is stored with the keypoints,
+	// descriptors of different types do not match.
+	void set_feature_type(feature_type type);
+
+	inline feature_type get_feature_type() const {
+		return type;
+	}
+
 	virtual void compute_features(const cv::Mat & rgb, const cv::Mat & depth,
 			const Eigen::Vector3f & intrinsics,
 			std::vector<cv::KeyPoint> & filtered_keypoints,
@@ -72,9 +80,7 @@ public:
 			Eigen::Affine3f & trans, std::vector<bool> & inliers) const;
 
 protected:
-	cv::Ptr<cv::FeatureDetector> fd;
-	cv::Ptr<cv::DescriptorExtractor> de;
-	cv::Ptr<cv::DescriptorMatcher> dm;
+	feature_type type;
 
 };
 
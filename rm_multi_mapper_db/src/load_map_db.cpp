@@ -6,6 +6,17 @@
 int main(int argc, char **argv) {
 
 	util::Ptr U(new util_mysql);
+
+	// Matching workers read the descriptor type from the database.
+	if (argc > 2) {
+		feature_type type;
+		if (!parse_feature_type(argv[2], type)) {
+			std::cerr << "Unknown feature type " << argv[2] << std::endl;
+			return 1;
+		}
+		U->set_feature_type(type);
+	}
+
 	int robot_id = U->get_new_robot_id();
 	std::cerr << "New robot id " << robot_id << std::endl;
 
@@ -3,26 +3,15 @@
 using namespace std;
 
 util::util() {
-
-	// Classes for feature extraction
-	de = new cv::SurfDescriptorExtractor;
-	fd = new cv::SurfFeatureDetector;
-
-	fd->setInt("hessianThreshold", 400);
-	fd->setInt("extended", 1);
-	fd->setInt("upright", 1);
-
-	de->setInt("hessianThreshold", 400);
-	de->setInt("extended", 1);
-	de->setInt("upright", 1);
-
-	dm = new cv::FlannBasedMatcher;
-
+	set_feature_type(FEATURE_SURF);
 }
 
 util::~util() {
 }
 
+void util::set_feature_type(feature_type type) {
+	this->type = type;
+}
 
 void util::compute_features(const cv::Mat & rgb, const cv::Mat & depth,
 		const Eigen::Vector3f & intrinsics,
@@ -33,59 +22,25 @@ void util::compute_features(const cv::Mat & rgb, const cv::Mat & depth,
 	if (rgb.channels() != 1) {
 		cv::cvtColor(rgb, gray, cv::COLOR_BGR2GRAY);
 	} else {
-		gray = rgb.clone();
+		gray = rgb;
 	}
 
-	cv::GaussianBlur(gray, gray, cv::Size(3, 3), 3);
-
-	int threshold = 400;
-	fd->setInt("hessianThreshold", threshold);
-
-	//int threshold = 100;
-	//fd->setInt("thres", threshold);
-
-	std::vector<cv::KeyPoint> keypoints;
-
-	cv::Mat mask(depth.size(), CV_8UC1);
-	depth.convertTo(mask, CV_8U);
+	detect_features(type, gray, depth, filtered_keypoints, descriptors);
 
-	fd->detect(gray, keypoints, mask);
-
-	for (int i = 0; i < 5; i++) {
-		if (keypoints.size() < 300) {
-			threshold = threshold / 2;
-			fd->setInt("hessianThreshold", threshold);
-			//fd->setInt("thres", threshold);
-			keypoints.clear();
-			fd->detect(gray, keypoints, mask);
-		} else {
-			break;
-		}
-	}
-
-	if (keypoints.size() > 400)
-		keypoints.resize(400);
-
-	filtered_keypoints.clear();
 	keypoints3d.clear();
 
-	for (size_t i = 0; i < keypoints.size(); i++) {
-		if (depth.at<unsigned short>(keypoints[i].pt) != 0) {
-			filtered_keypoints.push_back(keypoints[i]);
+	for (size_t i = 0; i < filtered_keypoints.size(); i++) {
+		pcl::PointXYZ p;
+		p.z = depth.at<unsigned short>(filtered_keypoints[i].pt) / 1000.0f;
+		p.x = (filtered_keypoints[i].pt.x - intrinsics[1]) * p.z
+				/ intrinsics[0];
+		p.y = (filtered_keypoints[i].pt.y - intrinsics[2]) * p.z
+				/ intrinsics[0];
 
-			pcl::PointXYZ p;
-			p.z = depth.at<unsigned short>(keypoints[i].pt) / 1000.0f;
-			p.x = (keypoints[i].pt.x - intrinsics[1]) * p.z / intrinsics[0];
-			p.y = (keypoints[i].pt.y - intrinsics[2]) * p.z / intrinsics[0];
+		//ROS_INFO("Point %f %f %f from  %f %f ", p.x, p.y, p.z, keypoints[i].pt.x, keypoints[i].pt.y);
 
-			//ROS_INFO("Point %f %f %f from  %f %f ", p.x, p.y, p.z, keypoints[i].pt.x, keypoints[i].pt.y);
-
-			keypoints3d.push_back(p);
-
-		}
+		keypoints3d.push_back(p);
 	}
-
-	de->compute(gray, filtered_keypoints, descriptors);
 }
 
 bool util::find_transform(const pcl::PointCloud<pcl::PointXYZ> & keypoints3d_i,
@@ -94,7 +49,7 @@ bool util::find_transform(const pcl::PointCloud<pcl::PointXYZ> & keypoints3d_i,
 		Sophus::SE3f & t) const {
 
 	std::vector<cv::DMatch> matches, matches_filtered;
-	dm->match(descriptors_j, descriptors_i, matches);
+	match_descriptors(descriptors_j, descriptors_i, matches);
 
 	Eigen::Affine3f transform;
 	std::vector<bool> inliers;
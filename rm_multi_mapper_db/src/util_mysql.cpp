@@ -113,19 +113,6 @@ util_mysql::util_mysql() {
 								"UPDATE keyframe SET "
 								"`map_id`= ? WHERE `map_id` = ?"));
 
-
-	// Classes for feature extraction
-	de = new cv::SurfDescriptorExtractor;
-	fd = new cv::SurfFeatureDetector;
-
-	fd->setInt("hessianThreshold", 400);
-	fd->setInt("extended", 1);
-	fd->setInt("upright", 1);
-
-	de->setInt("hessianThreshold", 400);
-	de->setInt("extended", 1);
-	de->setInt("upright", 1);
-
 }
 
 util_mysql::~util_mysql() {
@@ -205,9 +192,9 @@ void util_mysql::add_keypoints(const color_keyframe::Ptr & k) {
 
 		insert_keypoints->setInt(1, keypoints3d.size());
 		insert_keypoints->setInt(2, descriptors.cols);
+		// CV_32F for SURF, CV_8U for binary descriptors.
 		insert_keypoints->setInt(3, descriptors.type());
 
-		assert(descriptors.type() == CV_32F);
 		//std::cerr << "Keypoints size " << keypoints3d.size() << " "
 		//		<< descriptors.size() << std::endl;
 
@@ -216,7 +203,7 @@ void util_mysql::add_keypoints(const color_keyframe::Ptr & k) {
 		std::istream keypoints_stream(&keypoints_buffer);
 
 		DataBuf descriptors_buffer((char*) descriptors.data,
-				descriptors.cols * descriptors.rows * sizeof(float));
+				descriptors.total() * descriptors.elemSize());
 		std::istream descriptors_stream(&descriptors_buffer);
 
 		insert_keypoints->setBlob(4, &keypoints_stream);
@@ -145,8 +145,38 @@ TEST(UtilTest, keyframeUpdateTest) {
 
 }
 
+TEST(UtilTest, hammingMatcherTest) {
 
+	cv::Mat train(300, 32, CV_8U), query(300, 32, CV_8U);
+	cv::randu(train, cv::Scalar(0), cv::Scalar(256));
 
+	// Query row i is train row 299 - i with one bit flipped.
+	for (int i = 0; i < query.rows; i++) {
+		train.row(query.rows - 1 - i).copyTo(query.row(i));
+		query.at<uint8_t>(i, i % 32) ^= 1 << (i % 8);
+	}
+
+	std::vector<cv::DMatch> matches;
+	match_descriptors(query, train, matches);
+
+	ASSERT_EQ(query.rows, (int) matches.size());
+	for (size_t i = 0; i < matches.size(); i++) {
+		EXPECT_EQ((int) i, matches[i].queryIdx);
+		EXPECT_EQ(query.rows - 1 - (int) i, matches[i].trainIdx);
+		EXPECT_EQ(1, matches[i].distance);
+	}
+
+	for (int i = 0; i < query.rows; i++) {
+		EXPECT_EQ(cv::norm(query.row(i), train.row(i), cv::NORM_HAMMING),
+				hamming_matcher::distance(query.ptr<uint8_t>(i),
+						train.ptr<uint8_t>(i), query.cols));
+	}
+
+	// Float and binary descriptors do not match.
+	match_descriptors(query, cv::Mat(300, 32, CV_32F), matches);
+	EXPECT_TRUE(matches.empty());
+
+}
 
 int main(int argc, char **argv) {
 	testing::InitGoogleTest(&argc, argv);